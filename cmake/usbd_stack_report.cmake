@@ -0,0 +1,148 @@
+# Worst-case stack of the USB interrupt, run by the usbd_stack_report target with
+# cmake -P. Reads the call graphs written by -fcallgraph-info=su and walks them
+# from USB_IRQHandler.
+#
+# Indirect calls are resolved with the dispatch tables of the usbd_core below,
+# every indirect call may also be a user callback, which is charged CALLBACK
+# bytes. Functions without stack usage (library calls) are charged CALLBACK too.
+#
+# Input variables:
+#   CI_FILES  List of .ci files.
+#   BUDGET    Stack available to the interrupt in bytes, the script fails above it.
+#   CALLBACK  Stack assumed for a user callback in bytes.
+#   FRAME     Exception frame pushed by the hardware in bytes.
+
+cmake_policy(SET CMP0057 NEW)
+
+set(USBD_STACK_ROOT USB_IRQHandler)
+
+# Targets of the indirect calls of the usbd_core, by caller. The callers are
+# listed with the functions they get inlined into.
+set(USBD_STACK_EP_HANDLERS usbd_ep0_handler)
+set(USBD_STACK_STAGES
+    usbd_setup_stage
+    usbd_data_in_stage
+    usbd_data_out_stage
+    usbd_status_in_stage
+    usbd_status_out_stage
+)
+set(USBD_STACK_REQUESTS
+    usbd_get_status
+    usbd_clear_feature
+    usbd_set_feature
+    usbd_set_address
+    usbd_get_descriptor
+    usbd_set_descriptor
+    usbd_get_configuration
+    usbd_set_configuration
+    usbd_get_interface
+    usbd_set_interface
+    usbd_synch_frame
+    usbd_class_request
+    usbd_vendor_request
+)
+set(USBD_STACK_INDIRECT_USB_IRQHandler ${USBD_STACK_EP_HANDLERS})
+set(USBD_STACK_INDIRECT_usbd_irq_handler ${USBD_STACK_EP_HANDLERS})
+set(USBD_STACK_INDIRECT_usbd_ep0_handler ${USBD_STACK_STAGES})
+set(USBD_STACK_INDIRECT_usbd_setup_stage ${USBD_STACK_REQUESTS})
+set(USBD_STACK_INDIRECT_usbd_parse_setup_packet ${USBD_STACK_REQUESTS})
+
+foreach(var CI_FILES BUDGET CALLBACK FRAME)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "usbd_stack_report: ${var} is not set.")
+    endif()
+endforeach()
+
+# Strips the file name from a node title.
+function(usbd_stack_name title out)
+    string(REGEX REPLACE "^.*:" "" name "${title}")
+    set(${out} ${name} PARENT_SCOPE)
+endfunction()
+
+set(USBD_STACK_NODES)
+foreach(ci IN LISTS CI_FILES)
+    file(STRINGS ${ci} lines)
+    foreach(line IN LISTS lines)
+        if(line MATCHES "^node: { title: \"([^\"]+)\" label: \"[^\"]*\\\\n([0-9]+) bytes \\(([a-z,]+)\\)")
+            usbd_stack_name("${CMAKE_MATCH_1}" name)
+            set(USBD_STACK_SIZE_${name} ${CMAKE_MATCH_2})
+            if(CMAKE_MATCH_3 STREQUAL "dynamic")
+                message(WARNING "usbd_stack_report: ${name} has an unbounded dynamic stack.")
+            endif()
+            list(APPEND USBD_STACK_NODES ${name})
+        elseif(line MATCHES "^edge: { sourcename: \"([^\"]+)\" targetname: \"([^\"]+)\"")
+            usbd_stack_name("${CMAKE_MATCH_1}" source)
+            usbd_stack_name("${CMAKE_MATCH_2}" target)
+            list(APPEND USBD_STACK_EDGES_${source} ${target})
+        endif()
+    endforeach()
+endforeach()
+
+if(NOT DEFINED USBD_STACK_SIZE_${USBD_STACK_ROOT})
+    message(FATAL_ERROR "usbd_stack_report: ${USBD_STACK_ROOT} isn't in the call graph.")
+endif()
+
+# Worst-case stack of a function and everything it calls, memoized in the
+# global property USBD_STACK_DEPTH_<name>. path holds the callers, to catch
+# recursion.
+function(usbd_stack_depth name path out)
+    get_property(depth GLOBAL PROPERTY USBD_STACK_DEPTH_${name})
+    if(DEFINED depth AND NOT depth STREQUAL "")
+        set(${out} ${depth} PARENT_SCOPE)
+        return()
+    endif()
+    if(name IN_LIST path)
+        message(FATAL_ERROR "usbd_stack_report: recursion through ${name}, the stack is unbounded.")
+    endif()
+    if(NOT DEFINED USBD_STACK_SIZE_${name})
+        set(${out} ${CALLBACK} PARENT_SCOPE)
+        return()
+    endif()
+
+    set(callees ${USBD_STACK_EDGES_${name}})
+    if("__indirect_call" IN_LIST callees)
+        list(REMOVE_ITEM callees "__indirect_call")
+        list(APPEND callees ${USBD_STACK_INDIRECT_${name}} __usbd_callback)
+    endif()
+    list(REMOVE_DUPLICATES callees)
+
+    set(worst 0)
+    foreach(callee IN LISTS callees)
+        if(callee STREQUAL "__usbd_callback")
+            set(depth ${CALLBACK})
+        else()
+            usbd_stack_depth(${callee} "${path};${name}" depth)
+        endif()
+        if(depth GREATER worst)
+            set(worst ${depth})
+        endif()
+    endforeach()
+    math(EXPR depth "${USBD_STACK_SIZE_${name}} + ${worst}")
+    set_property(GLOBAL PROPERTY USBD_STACK_DEPTH_${name} ${depth})
+    set(${out} ${depth} PARENT_SCOPE)
+endfunction()
+
+usbd_stack_depth(${USBD_STACK_ROOT} "" root_depth)
+
+# Stack used on the way down to the request handlers, up to the dispatcher.
+set(dispatch 0)
+foreach(name IN ITEMS ${USBD_STACK_ROOT} usbd_irq_handler usbd_ep0_handler usbd_setup_stage usbd_parse_setup_packet)
+    if(DEFINED USBD_STACK_SIZE_${name})
+        math(EXPR dispatch "${dispatch} + ${USBD_STACK_SIZE_${name}}")
+    endif()
+endforeach()
+
+message("Worst-case USB interrupt stack, ${FRAME} bytes of exception frame and ${CALLBACK} bytes per user callback included:")
+foreach(name IN LISTS USBD_STACK_REQUESTS)
+    get_property(depth GLOBAL PROPERTY USBD_STACK_DEPTH_${name})
+    if(NOT depth STREQUAL "")
+        math(EXPR total "${FRAME} + ${dispatch} + ${depth}")
+        message("  ${name}: ${total} bytes")
+    endif()
+endforeach()
+math(EXPR total "${FRAME} + ${root_depth}")
+message("  ${USBD_STACK_ROOT}: ${total} bytes, budget ${BUDGET} bytes")
+
+if(total GREATER BUDGET)
+    message(FATAL_ERROR "usbd_stack_report: the USB interrupt needs ${total} bytes of stack, over the budget of ${BUDGET} bytes.")
+endif()
@@ -0,0 +1,205 @@
+#ifndef USBD_AUDIO_H
+#define USBD_AUDIO_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD Audio class (UAC 1.0) definitions.
+ ******************************************************************************/
+
+/************************************************
+ *	bRequest
+ ***********************************************/
+#define USBD_AUDIO_SET_CUR 0x01U
+#define USBD_AUDIO_SET_MIN 0x02U
+#define USBD_AUDIO_SET_MAX 0x03U
+#define USBD_AUDIO_SET_RES 0x04U
+#define USBD_AUDIO_GET_CUR 0x81U
+#define USBD_AUDIO_GET_MIN 0x82U
+#define USBD_AUDIO_GET_MAX 0x83U
+#define USBD_AUDIO_GET_RES 0x84U
+
+/************************************************
+ *	Control selectors (high byte of wValue)
+ ***********************************************/
+#define USBD_AUDIO_FU_MUTE_CONTROL 0x01U
+#define USBD_AUDIO_FU_VOLUME_CONTROL 0x02U
+#define USBD_AUDIO_EP_SAMPLING_FREQ_CONTROL 0x01U
+
+/************************************************
+ *	wLength
+ ***********************************************/
+#define USBD_AUDIO_MUTE_LENGTH 1
+#define USBD_AUDIO_VOLUME_LENGTH 2
+#define USBD_AUDIO_SAMPLING_FREQ_LENGTH 3
+
+/************************************************
+ *	Interface bInterfaceSubClass
+ ***********************************************/
+#define USBD_AUDIO_SUBCLASS_AUDIOCONTROL 0x1U
+#define USBD_AUDIO_SUBCLASS_AUDIOSTREAMING 0x2U
+#define USBD_AUDIO_SUBCLASS_MIDISTREAMING 0x3U
+
+/************************************************
+ *	bDescriptorSubtype
+ ***********************************************/
+#define USBD_AUDIO_AC_HEADER 0x1U
+#define USBD_AUDIO_AC_INPUT_TERMINAL 0x2U
+#define USBD_AUDIO_AC_OUTPUT_TERMINAL 0x3U
+#define USBD_AUDIO_AC_FEATURE_UNIT 0x6U
+#define USBD_AUDIO_AS_GENERAL 0x1U
+#define USBD_AUDIO_AS_FORMAT_TYPE 0x2U
+#define USBD_AUDIO_EP_GENERAL 0x1U
+
+#define USBD_AUDIO_FORMAT_TYPE_I 0x1U
+#define USBD_AUDIO_FORMAT_PCM 0x0001U
+
+/************************************************
+ *	bLength
+ ***********************************************/
+#define USBD_LENGTH_AUDIO_ENDPOINT_DESC 9
+#define USBD_LENGTH_AUDIO_CS_ENDPOINT_DESC 7
+
+#define USBD_BCD_AUDIO10 0x0100
+
+/************************************************
+ * @brief Maximum packet size of a stream, with
+ * room for one extra sample per frame, so the
+ * host can follow the feedback endpoint.
+ ***********************************************/
+#define USBD_AUDIO_PACKET_SIZE(rate, channels, subframe_size) ((((rate) / 1000U) + 1U) * (channels) * (subframe_size))
+
+/************************************************
+ * @brief Size of the ring buffers between the
+ * application and the iso endpoints, has to be
+ * a power of 2. Largest packet of a stream.
+ * Gain of the feedback loop, a fill level error
+ * of 1 sample changes the feedback value by
+ * 2^USBD_AUDIO_FB_GAIN_SHIFT (1/64 sample per
+ * frame by default). Volume range of the feature
+ * units in 1/256 dB.
+ *
+ * @note The user can overide them.
+ ***********************************************/
+#ifndef USBD_AUDIO_FIFO_SIZE
+	#define USBD_AUDIO_FIFO_SIZE 1024U
+#endif
+#ifndef USBD_AUDIO_MAX_PACKET_SIZE
+	#define USBD_AUDIO_MAX_PACKET_SIZE USBD_AUDIO_PACKET_SIZE(48000U, 2U, 3U)
+#endif
+#ifndef USBD_AUDIO_FB_GAIN_SHIFT
+	#define USBD_AUDIO_FB_GAIN_SHIFT 8U
+#endif
+#ifndef USBD_AUDIO_VOLUME_MIN
+	#define USBD_AUDIO_VOLUME_MIN ((int16_t)0xA000)
+#endif
+#ifndef USBD_AUDIO_VOLUME_MAX
+	#define USBD_AUDIO_VOLUME_MAX ((int16_t)0x0000)
+#endif
+#ifndef USBD_AUDIO_VOLUME_RES
+	#define USBD_AUDIO_VOLUME_RES ((int16_t)0x0100)
+#endif
+
+#if (USBD_AUDIO_FIFO_SIZE & (USBD_AUDIO_FIFO_SIZE - 1U))
+	#error "USBD_AUDIO_FIFO_SIZE has to be a power of 2."
+#endif
+
+/************************************************
+ *  Standard AS Isochronous Audio Data Endpoint
+ *  Descriptor
+ ***********************************************/
+struct __PACKED usbd_audio_endpoint_descriptor_type
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bEndpointAddress;
+	uint8_t bmAttributes;
+	uint16_t wMaxPacketSize;
+	uint8_t bInterval;
+	uint8_t bRefresh;
+	uint8_t bSynchAddress;
+};
+
+/************************************************
+ *  Class-Specific AS Isochronous Audio Data
+ *  Endpoint Descriptor
+ ***********************************************/
+struct __PACKED usbd_audio_cs_endpoint_descriptor_type
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bDescriptorSubtype;
+	uint8_t bmAttributes;
+	uint8_t bLockDelayUnits;
+	uint16_t wLockDelay;
+};
+
+/************************************************
+ * @brief Configuration of a single audio stream
+ * (AudioStreaming interface).
+ *
+ * @note Alternate setting 0 is the zero bandwidth
+ * setting, alternate setting n uses
+ * subframe_size[n - 1] bytes per sample. Set ep
+ * to 0 if the stream is not present.
+ * The Packet Memory Area buffers have to fit
+ * USBD_AUDIO_PACKET_SIZE() rounded up to 32 bytes.
+ ***********************************************/
+struct usbd_audio_stream_config
+{
+	uint8_t interface_num; /*!< bInterfaceNumber of the AudioStreaming interface.*/
+	uint8_t ep; /*!< Isochronous endpoint number.*/
+	uint16_t buf0_addr; /*!< The address offset of the endpoint's buffer 0 inside the Packet Memory Area.*/
+	uint16_t buf1_addr; /*!< The address offset of the endpoint's buffer 1 inside the Packet Memory Area.*/
+	uint8_t channels; /*!< Number of channels.*/
+	uint8_t alt_count; /*!< Number of non zero bandwidth alternate settings.*/
+	const uint8_t *subframe_size; /*!< Bytes per sample of each non zero bandwidth alternate setting.*/
+	uint8_t feature_unit_id; /*!< ID of the feature unit (mute/volume) of the stream, 0 if none.*/
+};
+
+/************************************************
+ * @brief Configuration of the Audio function,
+ * provided by the user during initialization.
+ ***********************************************/
+struct usbd_audio_config
+{
+	uint8_t ac_interface_num; /*!< bInterfaceNumber of the AudioControl interface.*/
+	uint32_t sample_rate; /*!< Default and highest sampling frequency in Hz, the Packet Memory Area buffers are sized for it.*/
+	struct usbd_audio_stream_config speaker; /*!< OUT stream (host to device).*/
+	struct usbd_audio_stream_config microphone; /*!< IN stream (device to host).*/
+	uint8_t fb_ep; /*!< Explicit feedback IN endpoint number of the speaker, 0 if none.*/
+	uint16_t fb0_addr; /*!< The address offset of the feedback endpoint's buffer 0 inside the Packet Memory Area.*/
+	uint16_t fb1_addr; /*!< The address offset of the feedback endpoint's buffer 1 inside the Packet Memory Area.*/
+	void (*stream_changed)(uint8_t interface_num, uint8_t alt, uint32_t sample_rate); /*!< Callback for alternate setting or sampling frequency changes.*/
+	void (*feature_changed)(uint8_t unit_id, bool mute, int16_t volume); /*!< Callback for mute or volume changes.*/
+};
+
+/************************************************
+ * @brief Stream error counters.
+ ***********************************************/
+struct usbd_audio_stats
+{
+	uint32_t speaker_underrun; /*!< The application read more than the host has sent.*/
+	uint32_t speaker_overrun; /*!< The host has sent more than the ring buffer could hold.*/
+	uint32_t microphone_underrun; /*!< A packet has been padded with silence.*/
+	uint32_t microphone_overrun; /*!< The application wrote more than the ring buffer could hold.*/
+};
+
+/*******************************************************************************
+ * Audio functions.
+ ******************************************************************************/
+void usbd_audio_init(const struct usbd_audio_config *config);
+void usbd_audio_configure(void);
+bool usbd_audio_set_interface(uint8_t num, uint8_t alt);
+bool usbd_audio_is_alternate_valid(uint8_t num, uint8_t alt);
+bool usbd_audio_get_interface(uint8_t num, uint8_t *alt);
+bool usbd_audio_class_request(struct usbd_setup_packet_type setup);
+void usbd_audio_sof(void);
+uint32_t usbd_audio_read(uint8_t *buf, uint32_t len);
+uint32_t usbd_audio_write(const uint8_t *buf, uint32_t len);
+void usbd_audio_get_stats(struct usbd_audio_stats *stats);
+
+#endif /*USBD_AUDIO_H*/
@@ -0,0 +1,93 @@
+#ifndef USBD_CAPTURE_H
+#define USBD_CAPTURE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD Transaction capture definitions, enabled by USBD_CAPTURE.
+ *
+ * Every SETUP, IN and OUT completion is stored as a pcap record with a 64 byte
+ * Linux usbmon (mmapped) header. Draining the records after the header of
+ * usbd_capture_pcap_header() gives a file that Wireshark opens directly.
+ *
+ * SETUP packets are 'S' events with the setup bytes. IN and OUT completions
+ * are 'C' events with the payload, status holds the handshake the endpoint
+ * is left with after the endpoint callback: 0 for VALID, -11 (EAGAIN) for NAK
+ * and -32 (EPIPE) for STALL.
+ ******************************************************************************/
+
+/************************************************
+ * @brief Size of the ring buffer in bytes, has
+ * to be a power of 2, and the number of payload
+ * bytes stored per record.
+ *
+ * @note The user can overide them.
+ ***********************************************/
+#ifndef USBD_CAPTURE_SIZE
+	#define USBD_CAPTURE_SIZE 4096U
+#endif
+#ifndef USBD_CAPTURE_PAYLOAD
+	#define USBD_CAPTURE_PAYLOAD 64U
+#endif
+
+#if (USBD_CAPTURE_SIZE & (USBD_CAPTURE_SIZE - 1U))
+	#error "USBD_CAPTURE_SIZE has to be a power of 2."
+#endif
+
+#define USBD_CAPTURE_PCAP_HEADER_SIZE 24U
+#define USBD_CAPTURE_LINKTYPE_USB_LINUX_MMAPPED 220U
+
+/************************************************
+ * @brief pcap record header followed by the
+ * usbmon header.
+ ***********************************************/
+struct __PACKED usbd_capture_record_type
+{
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t incl_len;
+	uint32_t orig_len;
+	uint64_t id;
+	uint8_t type;
+	uint8_t xfer_type;
+	uint8_t epnum;
+	uint8_t devnum;
+	uint16_t busnum;
+	int8_t flag_setup;
+	int8_t flag_data;
+	int64_t mon_ts_sec;
+	int32_t mon_ts_usec;
+	int32_t status;
+	uint32_t length;
+	uint32_t len_cap;
+	uint8_t setup[8];
+	int32_t interval;
+	int32_t start_frame;
+	uint32_t xfer_flags;
+	uint32_t ndesc;
+};
+
+/************************************************
+ * @brief Capture counters.
+ ***********************************************/
+struct usbd_capture_stats
+{
+	uint32_t records; /*!< Records stored.*/
+	uint32_t dropped; /*!< Records dropped because the ring buffer was full.*/
+};
+
+/*******************************************************************************
+ * Capture functions, usbd_capture_begin, usbd_capture_end and
+ * usbd_capture_tick are called by the usbd_core.
+ ******************************************************************************/
+void usbd_capture_begin(uint8_t ep, uint8_t dir);
+void usbd_capture_end(uint8_t ep, uint8_t dir);
+void usbd_capture_tick(void);
+void usbd_capture_pcap_header(uint8_t *buf);
+uint32_t usbd_capture_read(uint8_t *buf, uint32_t len);
+void usbd_capture_get_stats(struct usbd_capture_stats *stats);
+
+#endif /*USBD_CAPTURE_H*/
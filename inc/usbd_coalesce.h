@@ -0,0 +1,83 @@
+#ifndef USBD_COALESCE_H
+#define USBD_COALESCE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD IN coalescing definitions.
+ *
+ * Small writes to a bulk or interrupt IN endpoint are gathered in a ring
+ * buffer and sent as max_packet_size packets. A partial packet is held until
+ * flush_sof start of frames have passed, or until usbd_coalesce_flush() is
+ * called for data that can't wait. A flush ends the transfer: the data left is
+ * sent as a short packet, or as a zero length packet when the transfer ended
+ * on a full one.
+ *
+ * Each endpoint has its own usbd_coalesce struct. The application registers
+ * the endpoint with usbd_coalesce_configure() and calls usbd_coalesce_ep_in()
+ * from the IN callback and usbd_coalesce_sof() from the sof callback.
+ ******************************************************************************/
+
+/************************************************
+ * @brief Configuration of a coalesced endpoint,
+ * provided by the user during initialization.
+ ***********************************************/
+struct usbd_coalesce_config
+{
+	uint8_t ep; /*!< IN endpoint number.*/
+	uint32_t type; /*!< USB_EP_TYPE_BULK or USB_EP_TYPE_INTERRUPT.*/
+	uint16_t tx_addr; /*!< The address offset of the IN buffer inside the Packet Memory Area.*/
+	uint16_t max_packet_size; /*!< wMaxPacketSize of the endpoint.*/
+	uint8_t flush_sof; /*!< Start of frames a partial packet waits for, 0 waits for usbd_coalesce_flush().*/
+	uint8_t *buf; /*!< Ring buffer of the written data.*/
+	uint32_t size; /*!< Size of the ring buffer, a power of 2 of at least max_packet_size.*/
+};
+
+/************************************************
+ * @brief Coalescing counters.
+ * Average payload per packet: bytes / packets.
+ ***********************************************/
+struct usbd_coalesce_stats
+{
+	uint32_t bytes; /*!< Bytes sent to the host.*/
+	uint32_t packets; /*!< IN packets, zero length packets included.*/
+	uint32_t full; /*!< Packets of max_packet_size bytes.*/
+	uint32_t zlp; /*!< Zero length packets that ended a transfer.*/
+	uint32_t deadlines; /*!< Flushes by the start of frame deadline.*/
+	uint32_t flushes; /*!< Flushes by usbd_coalesce_flush().*/
+	uint32_t dropped; /*!< Bytes rejected because the ring buffer was full.*/
+};
+
+/************************************************
+ * @brief State of a coalesced endpoint. The
+ * application writes head, the interrupt handler
+ * tail.
+ ***********************************************/
+struct usbd_coalesce
+{
+	const struct usbd_coalesce_config *cfg; /*!< Pointer to the configuration.*/
+	__IO uint32_t head; /*!< Write index.*/
+	__IO uint32_t tail; /*!< Read index.*/
+	__IO bool busy; /*!< A packet is armed on the endpoint.*/
+	__IO bool flush; /*!< Send the data left, ending the transfer.*/
+	bool open; /*!< The last packet was full, the transfer hasn't ended.*/
+	uint8_t age; /*!< Start of frames the data left has waited.*/
+	uint16_t tx_len; /*!< Bytes of the packet armed on the endpoint.*/
+	struct usbd_coalesce_stats stats; /*!< Counters.*/
+};
+
+/*******************************************************************************
+ * Coalescing functions.
+ ******************************************************************************/
+void usbd_coalesce_init(struct usbd_coalesce *co, const struct usbd_coalesce_config *config);
+void usbd_coalesce_configure(struct usbd_coalesce *co, void (*ep_in)(void));
+void usbd_coalesce_ep_in(struct usbd_coalesce *co);
+void usbd_coalesce_sof(struct usbd_coalesce *co);
+uint32_t usbd_coalesce_write(struct usbd_coalesce *co, const uint8_t *data, uint32_t len);
+void usbd_coalesce_flush(struct usbd_coalesce *co);
+void usbd_coalesce_get_stats(struct usbd_coalesce *co, struct usbd_coalesce_stats *stats_out);
+
+#endif /*USBD_COALESCE_H*/
@@ -0,0 +1,120 @@
+#ifndef USBD_COMPOSITE_H
+#define USBD_COMPOSITE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD composite device definitions.
+ ******************************************************************************/
+
+/************************************************
+ * @brief Maximum number of functions, interfaces,
+ * endpoints per function and size of the
+ * generated configuration descriptor.
+ *
+ * @note The user can overide them.
+ ***********************************************/
+#ifndef USBD_COMPOSITE_MAX_FUNCTIONS
+	#define USBD_COMPOSITE_MAX_FUNCTIONS 4U
+#endif
+#ifndef USBD_COMPOSITE_MAX_INTERFACES
+	#define USBD_COMPOSITE_MAX_INTERFACES 8U
+#endif
+#ifndef USBD_FUNCTION_MAX_EP
+	#define USBD_FUNCTION_MAX_EP 4U
+#endif
+#ifndef USBD_COMPOSITE_DESC_SIZE
+	#define USBD_COMPOSITE_DESC_SIZE 512U
+#endif
+
+/************************************************
+ * @brief Interface Association Descriptor
+ * initializer, can be placed inside a
+ * configuration descriptor array.
+ ***********************************************/
+#define USBD_IAD_DESCRIPTOR(first, count, class, subclass, protocol, str) \
+	USBD_LENGTH_IAD_DESC, USBD_DESC_TYPE_INTERFACE_ASSOCIATION, (first), (count), (class), (subclass), (protocol), (str)
+
+/************************************************
+ * @brief A function of a composite device. It
+ * claims interface_count consecutive interfaces
+ * starting from first_interface and the
+ * endpoints of ep_address. The callbacks have
+ * the same signatures as the class modules
+ * (usbd_hid, usbd_audio, usbd_ncm, usbd_zero),
+ * every one of them is optional.
+ *
+ * @note descriptor holds the interface, class
+ * specific and endpoint descriptors of the
+ * function. An Interface Association Descriptor
+ * is generated in front of it when the function
+ * has more than one interface.
+ ***********************************************/
+struct usbd_function
+{
+	uint8_t first_interface; /*!< bInterfaceNumber of the first interface.*/
+	uint8_t interface_count; /*!< Number of consecutive interfaces.*/
+	uint8_t ep_address[USBD_FUNCTION_MAX_EP]; /*!< Endpoint addresses (number and direction bit), the list ends at the first 0.*/
+	uint8_t function_class; /*!< bFunctionClass of the IAD.*/
+	uint8_t function_subclass; /*!< bFunctionSubClass of the IAD.*/
+	uint8_t function_protocol; /*!< bFunctionProtocol of the IAD.*/
+	uint8_t function_string; /*!< iFunction of the IAD.*/
+	const uint8_t *descriptor; /*!< Interface and endpoint descriptors of the function.*/
+	uint16_t descriptor_length; /*!< Size of descriptor.*/
+	void (*configure)(void); /*!< Called when the configuration is selected.*/
+	bool (*class_request)(struct usbd_setup_packet_type setup); /*!< Class request addressed to one of the interfaces or endpoints, return false to stall.*/
+	bool (*vendor_request)(struct usbd_setup_packet_type setup); /*!< Vendor request addressed to one of the interfaces or endpoints, return false to stall.*/
+	bool (*is_alternate_valid)(uint8_t num, uint8_t alt); /*!< If NULL only the alternate setting 0 is valid.*/
+	bool (*set_interface)(uint8_t num, uint8_t alt); /*!< Alternate setting change of one of the interfaces.*/
+	void (*clear_stall)(uint8_t num, uint8_t dir); /*!< CLEAR_FEATURE(ENDPOINT_HALT) of one of the endpoints. If NULL the endpoint is resumed.*/
+	uint8_t *(*class_descriptor)(struct usbd_setup_packet_type setup, uint16_t *len); /*!< Class specific descriptor of one of the interfaces.*/
+	void (*sof)(void); /*!< Start of frame.*/
+};
+
+/************************************************
+ * @brief Configuration of the composite device,
+ * provided by the user during initialization.
+ ***********************************************/
+struct usbd_composite_config
+{
+	struct usbd_function *const *functions; /*!< Array of pointers to the functions.*/
+	uint8_t function_count; /*!< Number of functions.*/
+	uint8_t configuration_string; /*!< iConfiguration.*/
+	uint8_t attributes; /*!< bmAttributes.*/
+	uint8_t max_power; /*!< bMaxPower in 2mA units.*/
+	bool (*vendor_request)(struct usbd_setup_packet_type setup); /*!< Optional, vendor request addressed to the device (for example usbd_msos20_vendor_request), return false to stall.*/
+};
+
+/*******************************************************************************
+ * Composite device functions.
+ ******************************************************************************/
+void usbd_composite_init(const struct usbd_composite_config *config, struct usbd_core_driver *core_driver);
+uint8_t *usbd_composite_configuration_descriptor(uint8_t index);
+
+/*******************************************************************************
+ * Composite device callbacks, usbd_composite_init points the core driver to
+ * them. When USBD_STATIC_DRIVER is set the matching usbd_driver_ functions
+ * should forward to them instead.
+ ******************************************************************************/
+#if USBD_STATIC_DRIVER
+bool usbd_composite_is_interface_valid(uint8_t num);
+bool usbd_composite_is_endpoint_valid(uint8_t num, uint8_t dir);
+void usbd_composite_clear_stall(uint8_t num, uint8_t dir);
+uint8_t usbd_composite_get_configuration(void);
+bool usbd_composite_is_configuration_valid(uint8_t num);
+void usbd_composite_set_configuration(uint8_t num);
+uint8_t usbd_composite_get_interface(uint8_t num);
+bool usbd_composite_is_alternate_valid(uint8_t num, uint8_t alt);
+void usbd_composite_set_interface(uint8_t num, uint8_t alt);
+void usbd_composite_class_request(struct usbd_setup_packet_type setup);
+#if USBD_ENABLE_VENDOR_REQUEST
+void usbd_composite_vendor_request(struct usbd_setup_packet_type setup);
+#endif
+uint8_t *usbd_composite_class_descriptor(struct usbd_setup_packet_type setup, uint16_t *len);
+void usbd_composite_sof(void);
+#endif
+
+#endif /*USBD_COMPOSITE_H*/
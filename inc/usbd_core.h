@@ -28,6 +28,184 @@
 	#define EP0_COUNT USBD_FS_MAX_PACKET_SIZE
 #endif
 
+/************************************************
+ * @brief Set to 1 to let the core count the
+ * interrupts, the cycles spent in the interrupt
+ * handler (using the DWT cycle counter), the
+ * frames and the bytes copied from/to the PMA.
+ * 
+ * @note The user can overide it.
+ ***********************************************/
+#ifndef USBD_CORE_STATS
+	#define USBD_CORE_STATS 0
+#endif
+
+/************************************************
+ * @brief Set to 1 to let the core put the
+ * transceiver in force suspend and low power
+ * mode when the bus gets suspended. The
+ * endpoints are restored from the state saved
+ * at suspend when the bus resumes, without a
+ * bus reset. Set to 0 to leave it to the
+ * suspend callback.
+ * 
+ * @note The user can overide it.
+ ***********************************************/
+#ifndef USBD_SUSPEND_LOW_POWER
+	#define USBD_SUSPEND_LOW_POWER 1
+#endif
+
+/************************************************
+ * @brief Set to 1 to record every SETUP, IN and
+ * OUT completion into a RAM ring buffer, in the
+ * pcap format with the Linux usbmon link type,
+ * see usbd_capture.h.
+ * 
+ * @note The user can overide it.
+ ***********************************************/
+#ifndef USBD_CAPTURE
+	#define USBD_CAPTURE 0
+#endif
+
+/************************************************
+ * @brief Set to 1 to log the interrupt events
+ * seen by the core, with their timestamps, so
+ * the same sequence can be replayed later, see
+ * usbd_record.h.
+ * 
+ * @note The user can overide it.
+ ***********************************************/
+#ifndef USBD_RECORD
+	#define USBD_RECORD 0
+#endif
+
+/************************************************
+ * @brief Length of the RESUME signaling of
+ * usbd_remote_wakeup() in ESOF periods (ms),
+ * the pulse lasts between USBD_REMOTE_WAKEUP_MS
+ * - 1 and USBD_REMOTE_WAKEUP_MS ms.
+ * 
+ * @note The user can overide it.
+ ***********************************************/
+#ifndef USBD_REMOTE_WAKEUP_MS
+	#define USBD_REMOTE_WAKEUP_MS 4U
+#endif
+
+#if (USBD_REMOTE_WAKEUP_MS < 2) || (USBD_REMOTE_WAKEUP_MS > 15)
+	#error "USBD_REMOTE_WAKEUP_MS has to be between 2 and 15."
+#endif
+
+/************************************************
+ * @brief Set to 1 to bind the callbacks at link
+ * time, the core calls the usbd_driver_
+ * functions declared below directly instead of
+ * going through usbd_core_driver. With LTO the
+ * trivial callbacks get inlined into the request
+ * handlers.
+ * 
+ * @note The user can overide it.
+ ***********************************************/
+#ifndef USBD_STATIC_DRIVER
+	#define USBD_STATIC_DRIVER 0
+#endif
+
+/************************************************
+ * @brief Set to 0 to compile out a request the
+ * device never serves, together with its
+ * callback in usbd_core_driver. The request is
+ * then stalled like any unsupported request.
+ * USBD_ENABLE_SET_DESCRIPTOR: SET_DESCRIPTOR.
+ * USBD_ENABLE_SYNCH_FRAME: SYNCH_FRAME.
+ * USBD_ENABLE_VENDOR_REQUEST: vendor requests.
+ * USBD_ENABLE_BOS: GET_DESCRIPTOR of the BOS
+ * descriptor, needed by USBD_LPM.
+ * 
+ * @note The user can overide them.
+ ***********************************************/
+#ifndef USBD_ENABLE_SET_DESCRIPTOR
+	#define USBD_ENABLE_SET_DESCRIPTOR 1
+#endif
+#ifndef USBD_ENABLE_SYNCH_FRAME
+	#define USBD_ENABLE_SYNCH_FRAME 1
+#endif
+#ifndef USBD_ENABLE_VENDOR_REQUEST
+	#define USBD_ENABLE_VENDOR_REQUEST 1
+#endif
+#ifndef USBD_ENABLE_BOS
+	#define USBD_ENABLE_BOS 1
+#endif
+
+/************************************************
+ * @brief Set to 1 to enable Link Power
+ * Management. The device ACKs the L1 requests of
+ * the host, enters L1 and reports the baseline
+ * and deep BESL values (0 to 15, 125us to 10ms)
+ * in the USB 2.0 Extension capability. The
+ * device descriptor needs a bcdUSB of at least
+ * USBD_BCD_USB21 and the bos_descriptor callback
+ * has to include the capability.
+ * 
+ * @note The user can overide them.
+ ***********************************************/
+#ifndef USBD_LPM
+	#define USBD_LPM 0
+#endif
+#ifndef USBD_LPM_BASELINE_BESL
+	#define USBD_LPM_BASELINE_BESL 0x4U
+#endif
+#ifndef USBD_LPM_DEEP_BESL
+	#define USBD_LPM_DEEP_BESL 0x8U
+#endif
+
+#if USBD_LPM && !USBD_ENABLE_BOS
+	#error "USBD_LPM needs USBD_ENABLE_BOS, the host reads the LPM support from the BOS descriptor."
+#endif
+
+/************************************************
+ * @brief bmAttributes of the USB 2.0 Extension
+ * capability, for the bos descriptor.
+ ***********************************************/
+#if USBD_LPM
+	#define USBD_USB20_EXTENSION_ATTRIBUTES (USBD_USB20_EXT_LPM | USBD_USB20_EXT_BESL | \
+		USBD_USB20_EXT_BASELINE_BESL_VALID | USBD_USB20_EXT_DEEP_BESL_VALID | \
+		USBD_USB20_EXT_BASELINE_BESL(USBD_LPM_BASELINE_BESL) | USBD_USB20_EXT_DEEP_BESL(USBD_LPM_DEEP_BESL))
+#else
+	#define USBD_USB20_EXTENSION_ATTRIBUTES 0x0UL
+#endif
+
+/************************************************
+ * @brief Set to 1 to run the Battery Charging
+ * 1.2 detection in usbd_core_init(), before the
+ * pull-up is enabled. The port type and the
+ * current the device may draw are reported
+ * through the charger_detected callback.
+ * The durations are in ms, timed with the DWT
+ * cycle counter from SystemCoreClock.
+ * 
+ * @note The user can overide them.
+ ***********************************************/
+#ifndef USBD_BCD
+	#define USBD_BCD 0
+#endif
+#ifndef USBD_BCD_DCD_TIMEOUT_MS
+	#define USBD_BCD_DCD_TIMEOUT_MS 300U
+#endif
+#ifndef USBD_BCD_DCD_DEBOUNCE_MS
+	#define USBD_BCD_DCD_DEBOUNCE_MS 10U
+#endif
+#ifndef USBD_BCD_DETECTION_MS
+	#define USBD_BCD_DETECTION_MS 50U
+#endif
+
+/************************************************
+ * @brief Port types reported by the Battery
+ * Charging detection.
+ ***********************************************/
+#define USBD_BCD_PORT_SDP 0x1U /*!< Standard downstream port, 100 mA, 500 mA once configured.*/
+#define USBD_BCD_PORT_CDP 0x2U /*!< Charging downstream port, 1.5 A.*/
+#define USBD_BCD_PORT_DCP 0x3U /*!< Dedicated charging port, 1.5 A, there is no host to enumerate.*/
+#define USBD_BCD_PORT_PS2 0x4U /*!< PS2 port or proprietary charger, treated as 500 mA.*/
+
 /************************************************
  * @brief This is a series of callbacks that
  * should be implemented from the user,
@@ -48,19 +226,115 @@ struct usbd_core_driver
     void (*clear_stall)(uint8_t num, uint8_t dir); /*!< CLEAR_STALL request callback. Use it to resume an endpoint.*/
     uint8_t *(*device_descriptor)(void); /*!< Notifies the usbd_core of the device descriptor.*/
 	uint8_t *(*configuration_descriptor)(uint8_t index); /*!< Notifies the usbd_core of a configuration descriptor.*/
-	uint8_t *(*string_descriptor)(uint8_t index, uint16_t lang_id); /*!< Notifies the usbd_core of a string descriptor.*/
-	uint8_t *(*bos_descriptor)(void); /*!< Notifies the usbd_core of the bos descriptor.*/
+	uint8_t *(*string_descriptor)(uint8_t index, uint16_t lang_id); /*!< Notifies the usbd_core of a string descriptor. Return NULL to stall the request.*/
+#if USBD_ENABLE_BOS
+	uint8_t *(*bos_descriptor)(void); /*!< Notifies the usbd_core of the bos descriptor. Return NULL to stall the request.*/
+#endif
+#if USBD_ENABLE_SET_DESCRIPTOR
 	void (*set_descriptor)(struct usbd_setup_packet_type setup); /*!< SET_DESCRIPTOR request callback.*/
+#endif
 	uint8_t (*get_configuration)(void); /*!< Notifies the usbd_core of current configuration number.*/
 	bool (*is_configuration_valid)(uint8_t num); /*!< Notifies the usbd_core if the selected configuration is valid.*/
 	void (*set_configuration)(uint8_t num); /*!< Callback that sets a configuration.*/
 	uint8_t (*get_interface)(uint8_t num); /*!< Notifies the usbd_core of the alternative interface number for a selected interface.*/
 	void (*set_interface)(uint8_t num, uint8_t alt); /*!< Callback that sets an alternate interface for a selected interface.*/
 	void (*class_request)(struct usbd_setup_packet_type setup); /*!< type CLASS request callback.*/
+#if USBD_ENABLE_VENDOR_REQUEST
 	void (*vendor_request)(struct usbd_setup_packet_type setup); /*!< type VENDOR request callback.*/
+#endif
 	void (*suspend)(void); /*!< Callback that suspends the device.*/
 	void (*wakeup)(void); /*!< Callback that wakesup the device.*/
 	void (*sof)(void); /*!< Callback for start of frame.*/
+	void (*sof_frame)(uint16_t frame, uint8_t missed); /*!< Optional, called after the sof callback with the 11-bit frame number and the SOFs missed since the previous one.*/
+#if USBD_ENABLE_SYNCH_FRAME
+	uint16_t (*synch_frame)(uint8_t num, uint8_t dir); /*!< Optional, returns the frame number the pattern of an isochronous endpoint starts, for SYNCH_FRAME. If NULL the current frame number is returned.*/
+#endif
+	uint8_t *(*class_descriptor)(struct usbd_setup_packet_type setup, uint16_t *len); /*!< Notifies the usbd_core of a class specific descriptor (for example a HID report descriptor). Return NULL to stall the request.*/
+	bool (*is_alternate_valid)(uint8_t num, uint8_t alt); /*!< Notifies the usbd_core if the selected alternate setting of an interface is valid. If NULL every alternate setting is accepted.*/
+	void (*l1_enter)(uint8_t besl, bool remote_wakeup); /*!< Callback for entering the L1 (sleep) state, with the BESL and bRemoteWake of the LPM request (USBD_LPM).*/
+	void (*l1_exit)(void); /*!< Callback for leaving the L1 state (USBD_LPM).*/
+	void (*charger_detected)(uint8_t port, uint16_t current_ma, bool contact); /*!< Optional, reports the port type, the current in mA and if the data pins made contact before the timeout (USBD_BCD).*/
+	void (*stop_mode)(void); /*!< Optional, called by usbd_low_power_poll() with interrupts disabled while suspended. Should enter the MCU stop mode and restore the clocks before returning.*/
+};
+
+/************************************************
+ * @brief Callbacks bound at link time, used
+ * instead of usbd_core_driver when
+ * USBD_STATIC_DRIVER is set. Each one has the
+ * name of the usbd_core_driver member with the
+ * usbd_driver_ prefix. They are weak references,
+ * a callback that isn't defined anywhere has a
+ * NULL address and is treated like a NULL
+ * member of usbd_core_driver.
+ ***********************************************/
+#if USBD_STATIC_DRIVER
+__WEAK bool usbd_driver_is_selfpowered(void);
+__WEAK void usbd_driver_set_remote_wakeup(bool en);
+__WEAK bool usbd_driver_get_remote_wakeup(void);
+__WEAK bool usbd_driver_is_interface_valid(uint8_t num);
+__WEAK bool usbd_driver_is_endpoint_valid(uint8_t num, uint8_t dir);
+__WEAK void usbd_driver_clear_stall(uint8_t num, uint8_t dir);
+__WEAK uint8_t *usbd_driver_device_descriptor(void);
+__WEAK uint8_t *usbd_driver_configuration_descriptor(uint8_t index);
+__WEAK uint8_t *usbd_driver_string_descriptor(uint8_t index, uint16_t lang_id);
+#if USBD_ENABLE_BOS
+__WEAK uint8_t *usbd_driver_bos_descriptor(void);
+#endif
+#if USBD_ENABLE_SET_DESCRIPTOR
+__WEAK void usbd_driver_set_descriptor(struct usbd_setup_packet_type setup);
+#endif
+__WEAK uint8_t usbd_driver_get_configuration(void);
+__WEAK bool usbd_driver_is_configuration_valid(uint8_t num);
+__WEAK void usbd_driver_set_configuration(uint8_t num);
+__WEAK uint8_t usbd_driver_get_interface(uint8_t num);
+__WEAK void usbd_driver_set_interface(uint8_t num, uint8_t alt);
+__WEAK void usbd_driver_class_request(struct usbd_setup_packet_type setup);
+#if USBD_ENABLE_VENDOR_REQUEST
+__WEAK void usbd_driver_vendor_request(struct usbd_setup_packet_type setup);
+#endif
+__WEAK void usbd_driver_suspend(void);
+__WEAK void usbd_driver_wakeup(void);
+__WEAK void usbd_driver_sof(void);
+__WEAK void usbd_driver_sof_frame(uint16_t frame, uint8_t missed);
+#if USBD_ENABLE_SYNCH_FRAME
+__WEAK uint16_t usbd_driver_synch_frame(uint8_t num, uint8_t dir);
+#endif
+__WEAK uint8_t *usbd_driver_class_descriptor(struct usbd_setup_packet_type setup, uint16_t *len);
+__WEAK bool usbd_driver_is_alternate_valid(uint8_t num, uint8_t alt);
+__WEAK void usbd_driver_l1_enter(uint8_t besl, bool remote_wakeup);
+__WEAK void usbd_driver_l1_exit(void);
+__WEAK void usbd_driver_charger_detected(uint8_t port, uint16_t current_ma, bool contact);
+__WEAK void usbd_driver_stop_mode(void);
+#endif
+
+/************************************************
+ * @brief Core counters, only updated when
+ * USBD_CORE_STATS is set. The L1 counters also
+ * need USBD_LPM.
+ ***********************************************/
+struct usbd_core_stats
+{
+	uint32_t irq_count; /*!< Number of USB interrupts.*/
+	uint32_t irq_cycles; /*!< Cycles spent in the USB interrupt handler.*/
+	uint32_t irq_cycles_max; /*!< Largest number of cycles of a single USB interrupt.*/
+	uint32_t sof_count; /*!< Number of start of frame interrupts.*/
+	uint32_t pma_read_bytes; /*!< Bytes copied from the PMA.*/
+	uint32_t pma_write_bytes; /*!< Bytes copied to the PMA.*/
+	uint32_t ep0_aborts; /*!< Control transfers aborted by a new SETUP.*/
+	uint32_t l1_count; /*!< Number of L1 entries (USBD_LPM).*/
+	uint32_t l1_frames; /*!< Frames spent in L1, from the frame numbers around it (USBD_LPM).*/
+	uint32_t missed_sof; /*!< SOFs missed (ESOF) while the frame timer was locked.*/
+	uint32_t iso_late; /*!< Scheduled isochronous packets dropped because their frame had already passed.*/
+	uint32_t resume_count; /*!< Number of resumes from suspend followed by a serviced packet.*/
+	uint32_t resume_cycles; /*!< Cycles from the resumes to the first serviced packets.*/
+	uint32_t resume_cycles_max; /*!< Largest number of cycles from a resume to the first serviced packet.*/
+	uint32_t setup_count; /*!< Number of setup packets.*/
+	uint32_t enum_count; /*!< Number of enumerations, last bus reset up to the status stage of a non zero SET_CONFIGURATION.*/
+	uint32_t enum_cycles; /*!< Cycles of the last enumeration.*/
+	uint32_t enum_irq_cycles; /*!< Cycles spent in the USB interrupt handler during the last enumeration.*/
+	uint32_t enum_setups; /*!< Setup packets of the last enumeration.*/
+	uint32_t enum_pma_bytes; /*!< Bytes copied from/to the PMA during the last enumeration.*/
+	uint32_t request_cycles_max[USBD_SYNCH_FRAME + 1U]; /*!< Largest number of cycles to serve each standard request, indexed by bRequest, user callbacks included.*/
 };
 
 /*******************************************************************************
@@ -93,5 +367,11 @@ void usbd_prepare_status_in_stage(void);
  ******************************************************************************/
 
 void usbd_core_init(struct usbd_core_driver* core_driver);
+bool usbd_remote_wakeup(void);
+bool usbd_low_power_poll(void);
+uint16_t usbd_get_frame_number(void);
+bool usbd_iso_schedule_tx(uint8_t ep, const uint8_t *buf, uint16_t cnt, uint16_t frame);
+void usbd_core_get_stats(struct usbd_core_stats *stats);
+void usbd_core_reset_stats(void);
 
 #endif /*USBD_CORE_H*/
\ No newline at end of file
@@ -79,6 +79,9 @@
 #define USBD_LENGTH_INTERFACE_DESC 9
 #define USBD_LENGTH_ENDPOINT_DESC 7
 #define USBD_LENGTH_BOS_DESC 5
+#define USBD_LENGTH_IAD_DESC 8
+#define USBD_LENGTH_USB20_EXTENSION_DESC 7
+#define USBD_LENGTH_MSOS20_PLATFORM_DESC 28
 
 /************************************************
  *	bDescriptorType
@@ -88,8 +91,11 @@
 #define USBD_DESC_TYPE_STRING 3
 #define USBD_DESC_TYPE_INTERFACE 4
 #define USBD_DESC_TYPE_ENDPOINT 5
+#define USBD_DESC_TYPE_INTERFACE_ASSOCIATION 11
 #define USBD_DESC_TYPE_BOS 15
 #define USBD_DESC_TYPE_DEVICE_CAPABILITY 16
+#define USBD_DESC_TYPE_CS_INTERFACE 36
+#define USBD_DESC_TYPE_CS_ENDPOINT 37
 
 /************************************************
  *  Device bDeviceClass
@@ -174,8 +180,33 @@
 /************************************************
  *  BOS bDevCapabilityType
  ***********************************************/
+#define USBD_DEV_CAPABILITY_TYPE_USB20_EXTENSION 0x2U
 #define USBD_DEV_CAPABILITY_TYPE_PLATFORM_CAPABILITY 0x5U
 
+/************************************************
+ *  USB 2.0 Extension bmAttributes
+ ***********************************************/
+#define USBD_USB20_EXT_LPM (0x1UL << 1)
+#define USBD_USB20_EXT_BESL (0x1UL << 2)
+#define USBD_USB20_EXT_BASELINE_BESL_VALID (0x1UL << 3)
+#define USBD_USB20_EXT_DEEP_BESL_VALID (0x1UL << 4)
+#define USBD_USB20_EXT_BASELINE_BESL(besl) (((uint32_t)(besl) & 0xFUL) << 8)
+#define USBD_USB20_EXT_DEEP_BESL(besl) (((uint32_t)(besl) & 0xFUL) << 12)
+
+/************************************************
+ *  Microsoft OS 2.0 descriptors
+ ***********************************************/
+#define USBD_MSOS20_PLATFORM_CAPABILITY_UUID 0xDFU, 0x60U, 0xDDU, 0xD8U, 0x89U, 0x45U, 0xC7U, 0x4CU, \
+	0x9CU, 0xD2U, 0x65U, 0x9DU, 0x9EU, 0x64U, 0x8AU, 0x9FU /*!< {D8DD60DF-4589-4CC7-9CD2-659D9E648A9F}*/
+#define USBD_MSOS20_WINDOWS_VERSION_8_1 0x06030000UL
+#define USBD_MSOS20_DESCRIPTOR_INDEX 0x7U /*!< wIndex of the descriptor set request.*/
+#define USBD_MSOS20_SET_HEADER_DESCRIPTOR 0x0U
+#define USBD_MSOS20_SUBSET_HEADER_CONFIGURATION 0x1U
+#define USBD_MSOS20_SUBSET_HEADER_FUNCTION 0x2U
+#define USBD_MSOS20_FEATURE_COMPATIBLE_ID 0x3U
+#define USBD_MSOS20_FEATURE_REG_PROPERTY 0x4U
+#define USBD_MSOS20_REG_MULTI_SZ 0x7U
+
 /*******************************************************************************
  * USBD Descriptors structs
  ******************************************************************************/
@@ -245,6 +276,21 @@ struct __PACKED usbd_std_endpoint_descriptor_type
     uint8_t bInterval;
 };
 
+/************************************************
+ *  Standard Interface Association Descriptor
+ ***********************************************/
+struct __PACKED usbd_std_iad_descriptor_type
+{
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bFirstInterface;
+    uint8_t bInterfaceCount;
+    uint8_t bFunctionClass;
+    uint8_t bFunctionSubClass;
+    uint8_t bFunctionProtocol;
+    uint8_t iFunction;
+};
+
 /************************************************
  *  Standard String Descriptor
  ***********************************************/
@@ -266,6 +312,17 @@ struct __PACKED usbd_std_bos_descriptor_type
     uint8_t bNumDeviceCaps;
 };
 
+/************************************************
+ * USB 2.0 Extension Descriptor
+ ***********************************************/
+struct __PACKED usbd_std_usb20_extension_descriptor_type
+{
+    uint8_t bLength;
+    uint8_t	bDescriptorType;
+    uint8_t bDevCapabilityType;
+    uint32_t bmAttributes;
+};
+
 /************************************************
  * Standard Platform Capability Descriptor
  ***********************************************/
@@ -279,6 +336,81 @@ struct __PACKED usbd_std_platform_capability_descriptor_type
     /*CapabilityData is not included in the struct.*/
 };
 
+/************************************************
+ * Microsoft OS 2.0 Platform Capability
+ * Descriptor
+ ***********************************************/
+struct __PACKED usbd_msos20_platform_capability_descriptor_type
+{
+    uint8_t bLength;
+    uint8_t	bDescriptorType;
+    uint8_t bDevCapabilityType;
+    uint8_t bReserved;
+    uint8_t PlatformCapabilityUUID[16];
+    uint32_t dwWindowsVersion;
+    uint16_t wMSOSDescriptorSetTotalLength;
+    uint8_t bMS_VendorCode;
+    uint8_t bAltEnumCode;
+};
+
+/************************************************
+ * Microsoft OS 2.0 Descriptor Set Header
+ ***********************************************/
+struct __PACKED usbd_msos20_set_header_type
+{
+    uint16_t wLength;
+    uint16_t wDescriptorType;
+    uint32_t dwWindowsVersion;
+    uint16_t wTotalLength;
+};
+
+/************************************************
+ * Microsoft OS 2.0 Configuration Subset Header
+ ***********************************************/
+struct __PACKED usbd_msos20_configuration_subset_header_type
+{
+    uint16_t wLength;
+    uint16_t wDescriptorType;
+    uint8_t bConfigurationValue;
+    uint8_t bReserved;
+    uint16_t wTotalLength;
+};
+
+/************************************************
+ * Microsoft OS 2.0 Function Subset Header
+ ***********************************************/
+struct __PACKED usbd_msos20_function_subset_header_type
+{
+    uint16_t wLength;
+    uint16_t wDescriptorType;
+    uint8_t bFirstInterface;
+    uint8_t bReserved;
+    uint16_t wSubsetLength;
+};
+
+/************************************************
+ * Microsoft OS 2.0 Compatible ID Descriptor
+ ***********************************************/
+struct __PACKED usbd_msos20_compatible_id_type
+{
+    uint16_t wLength;
+    uint16_t wDescriptorType;
+    uint8_t CompatibleID[8];
+    uint8_t SubCompatibleID[8];
+};
+
+/************************************************
+ * Microsoft OS 2.0 Registry Property Descriptor
+ ***********************************************/
+struct __PACKED usbd_msos20_registry_property_type
+{
+    uint16_t wLength;
+    uint16_t wDescriptorType;
+    uint16_t wPropertyDataType;
+    uint16_t wPropertyNameLength;
+    /*PropertyName, wPropertyDataLength and PropertyData are not included in the struct.*/
+};
+
 /************************************************
  *  Setup packet
  ***********************************************/
@@ -0,0 +1,176 @@
+#ifndef USBD_DESC_BUILDER_H
+#define USBD_DESC_BUILDER_H
+
+#include <stdint.h>
+#include "usbd_desc.h"
+
+/*******************************************************************************
+ * USBD Declarative configuration descriptor builder.
+ *
+ * A configuration is described by a list macro that takes an X argument and
+ * calls it once per descriptor, in the order they are sent to the host. The
+ * first argument of each entry is the descriptor kind, the second the name of
+ * the descriptor inside the generated struct:
+ *
+ * X(IAD, name, bFirstInterface, bInterfaceCount, bFunctionClass, bFunctionSubClass, bFunctionProtocol, iFunction)
+ * X(INTERFACE, name, bInterfaceNumber, bAlternateSetting, bNumEndpoints, bInterfaceClass, bInterfaceSubClass, bInterfaceProtocol, iInterface)
+ * X(ENDPOINT, name, bEndpointAddress, bmAttributes, wMaxPacketSize, bInterval)
+ * X(ENDPOINT_ALT, name, bEndpointAddress, bmAttributes, wMaxPacketSize, bInterval)
+ * X(CLASS, name, bytes...)
+ *
+ * ENDPOINT_ALT is an endpoint of another alternate setting that reuses the
+ * address of an ENDPOINT, declare the alternate setting with the largest
+ * packet as ENDPOINT. CLASS holds the bytes of a class specific descriptor,
+ * USBD_DESC_U16 and USBD_DESC_U24 split wider fields.
+ *
+ * Example:
+ * #define VENDOR_CONFIG(X) \
+ *     X(INTERFACE, intf, 0, 0, 2, USBD_CLASS_VENDOR, 0, 0, 0) \
+ *     X(ENDPOINT, ep_in, 0x81, USBD_ATTRIBUTES_TRANSFER_TYPE_BULK, 64, 0) \
+ *     X(ENDPOINT, ep_out, 0x01, USBD_ATTRIBUTES_TRANSFER_TYPE_BULK, 64, 0)
+ *
+ * USBD_CONFIGURATION_DESCRIPTOR(config_desc, VENDOR_CONFIG, 1, 0, USBD_ATTRIBUTES_CONFIGURATION(0, 0), USBD_MAX_POWER(100));
+ *
+ * wTotalLength and bNumInterfaces are computed by the compiler and the
+ * following is checked at compile time:
+ * - Endpoint numbers are between 1 and 7, and each address is used once.
+ * - wMaxPacketSize fits the transfer type at full speed and bInterval is
+ * valid for periodic endpoints.
+ * - The bNumEndpoints of the interfaces add up to the endpoint descriptors.
+ * - The periodic (interrupt and isochronous) packets, protocol overhead
+ * included, fit in the 90% of a 1 ms frame reserved for them.
+ ******************************************************************************/
+
+/************************************************
+ * Full speed periodic bandwidth, in bytes per
+ * frame.
+ ***********************************************/
+#define USBD_DESC_FS_PERIODIC_BYTES 1350U /*!< 90% of the 1500 bytes of a full speed frame.*/
+#define USBD_DESC_ISO_OVERHEAD 9U /*!< Protocol overhead of a full speed isochronous transaction.*/
+#define USBD_DESC_INTERRUPT_OVERHEAD 13U /*!< Protocol overhead of a full speed interrupt transaction.*/
+
+#define USBD_DESC_U16(x) ((x) & 0xFFU), (((x) >> 0x8U) & 0xFFU)
+#define USBD_DESC_U24(x) ((x) & 0xFFU), (((x) >> 0x8U) & 0xFFU), (((x) >> 0x10U) & 0xFFU)
+
+/************************************************
+ * Helpers, not to be used directly.
+ ***********************************************/
+#define USBD_DESC_EP_TYPE(attr) ((attr) & USBD_ATTRIBUTES_TRANSFER_TYPE)
+#define USBD_DESC_EP_BIT(addr) (1UL << (((addr) & 0x7U) + (((addr) & USBD_EP_ADDRESS_EP_DIRECTION) ? 0x8U : 0x0U)))
+
+/*Struct members.*/
+#define USBD_DESC_FIELD(kind, ...) USBD_DESC_FIELD_##kind(__VA_ARGS__)
+#define USBD_DESC_FIELD_IAD(name, ...) struct usbd_std_iad_descriptor_type name;
+#define USBD_DESC_FIELD_INTERFACE(name, ...) struct usbd_std_interface_descriptor_type name;
+#define USBD_DESC_FIELD_ENDPOINT(name, ...) struct usbd_std_endpoint_descriptor_type name;
+#define USBD_DESC_FIELD_ENDPOINT_ALT(name, ...) struct usbd_std_endpoint_descriptor_type name;
+#define USBD_DESC_FIELD_CLASS(name, ...) uint8_t name[sizeof((const uint8_t[]){ __VA_ARGS__ })];
+
+/*Initializers.*/
+#define USBD_DESC_INIT(kind, ...) USBD_DESC_INIT_##kind(__VA_ARGS__)
+#define USBD_DESC_INIT_IAD(name, first, count, cls, subcls, protocol, str) \
+	.name = { USBD_LENGTH_IAD_DESC, USBD_DESC_TYPE_INTERFACE_ASSOCIATION, (first), (count), (cls), (subcls), (protocol), (str) },
+#define USBD_DESC_INIT_INTERFACE(name, num, alt, eps, cls, subcls, protocol, str) \
+	.name = { USBD_LENGTH_INTERFACE_DESC, USBD_DESC_TYPE_INTERFACE, (num), (alt), (eps), (cls), (subcls), (protocol), (str) },
+#define USBD_DESC_INIT_ENDPOINT(name, addr, attr, mps, interval) \
+	.name = { USBD_LENGTH_ENDPOINT_DESC, USBD_DESC_TYPE_ENDPOINT, (addr), (attr), (mps), (interval) },
+#define USBD_DESC_INIT_ENDPOINT_ALT(name, ...) USBD_DESC_INIT_ENDPOINT(name, __VA_ARGS__)
+#define USBD_DESC_INIT_CLASS(name, ...) .name = { __VA_ARGS__ },
+
+/*Interfaces, counted once per bInterfaceNumber.*/
+#define USBD_DESC_INTERFACES(kind, ...) USBD_DESC_INTERFACES_##kind(__VA_ARGS__)
+#define USBD_DESC_INTERFACES_IAD(...)
+#define USBD_DESC_INTERFACES_INTERFACE(name, num, alt, ...) + ((alt) == 0)
+#define USBD_DESC_INTERFACES_ENDPOINT(...)
+#define USBD_DESC_INTERFACES_ENDPOINT_ALT(...)
+#define USBD_DESC_INTERFACES_CLASS(...)
+
+/*bNumEndpoints of the interfaces.*/
+#define USBD_DESC_NUM_EPS(kind, ...) USBD_DESC_NUM_EPS_##kind(__VA_ARGS__)
+#define USBD_DESC_NUM_EPS_IAD(...)
+#define USBD_DESC_NUM_EPS_INTERFACE(name, num, alt, eps, ...) + (eps)
+#define USBD_DESC_NUM_EPS_ENDPOINT(...)
+#define USBD_DESC_NUM_EPS_ENDPOINT_ALT(...)
+#define USBD_DESC_NUM_EPS_CLASS(...)
+
+/*Endpoint descriptors.*/
+#define USBD_DESC_EPS(kind, ...) USBD_DESC_EPS_##kind(__VA_ARGS__)
+#define USBD_DESC_EPS_IAD(...)
+#define USBD_DESC_EPS_INTERFACE(...)
+#define USBD_DESC_EPS_ENDPOINT(...) + 1
+#define USBD_DESC_EPS_ENDPOINT_ALT(...) + 1
+#define USBD_DESC_EPS_CLASS(...)
+
+/*Endpoint addresses, summed and or'ed. A duplicate makes them differ.*/
+#define USBD_DESC_EP_SUM(kind, ...) USBD_DESC_EP_SUM_##kind(__VA_ARGS__)
+#define USBD_DESC_EP_SUM_IAD(...)
+#define USBD_DESC_EP_SUM_INTERFACE(...)
+#define USBD_DESC_EP_SUM_ENDPOINT(name, addr, ...) + USBD_DESC_EP_BIT(addr)
+#define USBD_DESC_EP_SUM_ENDPOINT_ALT(...)
+#define USBD_DESC_EP_SUM_CLASS(...)
+
+#define USBD_DESC_EP_OR(kind, ...) USBD_DESC_EP_OR_##kind(__VA_ARGS__)
+#define USBD_DESC_EP_OR_IAD(...)
+#define USBD_DESC_EP_OR_INTERFACE(...)
+#define USBD_DESC_EP_OR_ENDPOINT(name, addr, ...) | USBD_DESC_EP_BIT(addr)
+#define USBD_DESC_EP_OR_ENDPOINT_ALT(...)
+#define USBD_DESC_EP_OR_CLASS(...)
+
+#define USBD_DESC_EP_ALT_OR(kind, ...) USBD_DESC_EP_ALT_OR_##kind(__VA_ARGS__)
+#define USBD_DESC_EP_ALT_OR_IAD(...)
+#define USBD_DESC_EP_ALT_OR_INTERFACE(...)
+#define USBD_DESC_EP_ALT_OR_ENDPOINT(...)
+#define USBD_DESC_EP_ALT_OR_ENDPOINT_ALT(name, addr, ...) | USBD_DESC_EP_BIT(addr)
+#define USBD_DESC_EP_ALT_OR_CLASS(...)
+
+/*Periodic bytes per frame.*/
+#define USBD_DESC_PERIODIC(kind, ...) USBD_DESC_PERIODIC_##kind(__VA_ARGS__)
+#define USBD_DESC_PERIODIC_IAD(...)
+#define USBD_DESC_PERIODIC_INTERFACE(...)
+#define USBD_DESC_PERIODIC_ENDPOINT(name, addr, attr, mps, interval) \
+	+ ((USBD_DESC_EP_TYPE(attr) == USBD_ATTRIBUTES_TRANSFER_TYPE_ISOCHRONOUS) ? ((mps) + USBD_DESC_ISO_OVERHEAD) : \
+	(USBD_DESC_EP_TYPE(attr) == USBD_ATTRIBUTES_TRANSFER_TYPE_INTERRUPT) ? ((mps) + USBD_DESC_INTERRUPT_OVERHEAD) : 0U)
+#define USBD_DESC_PERIODIC_ENDPOINT_ALT(...)
+#define USBD_DESC_PERIODIC_CLASS(...)
+
+/*Checks of each endpoint.*/
+#define USBD_DESC_CHECK(kind, ...) USBD_DESC_CHECK_##kind(__VA_ARGS__)
+#define USBD_DESC_CHECK_IAD(...)
+#define USBD_DESC_CHECK_INTERFACE(...)
+#define USBD_DESC_CHECK_ENDPOINT(name, addr, attr, mps, interval) \
+	_Static_assert(((addr) & 0x7FU) >= 1U && ((addr) & 0x7FU) <= 7U, "Endpoint " #name ": the number has to be between 1 and 7."); \
+	_Static_assert(USBD_DESC_EP_TYPE(attr) != USBD_ATTRIBUTES_TRANSFER_TYPE_BULK || \
+		(mps) == 8U || (mps) == 16U || (mps) == 32U || (mps) == 64U, "Endpoint " #name ": bulk wMaxPacketSize has to be 8, 16, 32 or 64."); \
+	_Static_assert(USBD_DESC_EP_TYPE(attr) != USBD_ATTRIBUTES_TRANSFER_TYPE_INTERRUPT || \
+		((mps) <= USBD_FS_MAX_PACKET_SIZE && (interval) >= 1U), "Endpoint " #name ": interrupt wMaxPacketSize is at most 64 and bInterval at least 1."); \
+	_Static_assert(USBD_DESC_EP_TYPE(attr) != USBD_ATTRIBUTES_TRANSFER_TYPE_ISOCHRONOUS || \
+		((mps) <= 1023U && (interval) >= 1U && (interval) <= 16U), "Endpoint " #name ": isochronous wMaxPacketSize is at most 1023 and bInterval between 1 and 16.");
+#define USBD_DESC_CHECK_ENDPOINT_ALT(...) USBD_DESC_CHECK_ENDPOINT(__VA_ARGS__)
+#define USBD_DESC_CHECK_CLASS(...)
+
+/************************************************
+ * @brief Defines the configuration descriptor
+ * name from the list macro list, see above.
+ * The descriptor is placed in flash and can be
+ * returned from the configuration_descriptor
+ * callback with (uint8_t*)&name.
+ ***********************************************/
+#define USBD_CONFIGURATION_DESCRIPTOR(name, list, value, str, attributes, max_power) \
+	static const struct __PACKED \
+	{ \
+		struct usbd_std_configuration_descriptor_type configuration; \
+		list(USBD_DESC_FIELD) \
+	} name = \
+	{ \
+		.configuration = { USBD_LENGTH_CONFIGURATION_DESC, USBD_DESC_TYPE_CONFIGURATION, sizeof(name), \
+			(0 list(USBD_DESC_INTERFACES)), (value), (str), (attributes), (max_power) }, \
+		list(USBD_DESC_INIT) \
+	}; \
+	list(USBD_DESC_CHECK) \
+	_Static_assert((0 list(USBD_DESC_INTERFACES)) >= 1, #name ": at least one interface is needed."); \
+	_Static_assert((0 list(USBD_DESC_NUM_EPS)) == (0 list(USBD_DESC_EPS)), #name ": bNumEndpoints doesn't match the endpoint descriptors."); \
+	_Static_assert((0UL list(USBD_DESC_EP_SUM)) == (0UL list(USBD_DESC_EP_OR)), #name ": an endpoint address is used twice."); \
+	_Static_assert(((0UL list(USBD_DESC_EP_ALT_OR)) & ~(0UL list(USBD_DESC_EP_OR))) == 0UL, #name ": an ENDPOINT_ALT address has no ENDPOINT."); \
+	_Static_assert((0U list(USBD_DESC_PERIODIC)) <= USBD_DESC_FS_PERIODIC_BYTES, #name ": the periodic endpoints don't fit in a frame.")
+
+#endif /*USBD_DESC_BUILDER_H*/
@@ -0,0 +1,173 @@
+#ifndef USBD_DFU_H
+#define USBD_DFU_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD Device Firmware Upgrade 1.1 class definitions (DFU mode).
+ ******************************************************************************/
+
+/************************************************
+ *	bRequest
+ ***********************************************/
+#define USBD_DFU_DETACH 0x00U
+#define USBD_DFU_DNLOAD 0x01U
+#define USBD_DFU_UPLOAD 0x02U
+#define USBD_DFU_GETSTATUS 0x03U
+#define USBD_DFU_CLRSTATUS 0x04U
+#define USBD_DFU_GETSTATE 0x05U
+#define USBD_DFU_ABORT 0x06U
+
+/************************************************
+ *	wLength
+ ***********************************************/
+#define USBD_DFU_GETSTATUS_LENGTH 6
+#define USBD_DFU_GETSTATE_LENGTH 1
+
+/************************************************
+ *	bState
+ ***********************************************/
+#define USBD_DFU_STATE_APP_IDLE 0x00U
+#define USBD_DFU_STATE_APP_DETACH 0x01U
+#define USBD_DFU_STATE_IDLE 0x02U
+#define USBD_DFU_STATE_DNLOAD_SYNC 0x03U
+#define USBD_DFU_STATE_DNBUSY 0x04U
+#define USBD_DFU_STATE_DNLOAD_IDLE 0x05U
+#define USBD_DFU_STATE_MANIFEST_SYNC 0x06U
+#define USBD_DFU_STATE_MANIFEST 0x07U
+#define USBD_DFU_STATE_MANIFEST_WAIT_RESET 0x08U
+#define USBD_DFU_STATE_UPLOAD_IDLE 0x09U
+#define USBD_DFU_STATE_ERROR 0x0AU
+
+/************************************************
+ *	bStatus
+ ***********************************************/
+#define USBD_DFU_STATUS_OK 0x00U
+#define USBD_DFU_STATUS_ERR_TARGET 0x01U
+#define USBD_DFU_STATUS_ERR_FILE 0x02U
+#define USBD_DFU_STATUS_ERR_WRITE 0x03U
+#define USBD_DFU_STATUS_ERR_ERASE 0x04U
+#define USBD_DFU_STATUS_ERR_CHECK_ERASED 0x05U
+#define USBD_DFU_STATUS_ERR_PROG 0x06U
+#define USBD_DFU_STATUS_ERR_VERIFY 0x07U
+#define USBD_DFU_STATUS_ERR_ADDRESS 0x08U
+#define USBD_DFU_STATUS_ERR_NOTDONE 0x09U
+#define USBD_DFU_STATUS_ERR_FIRMWARE 0x0AU
+#define USBD_DFU_STATUS_ERR_VENDOR 0x0BU
+#define USBD_DFU_STATUS_ERR_USBR 0x0CU
+#define USBD_DFU_STATUS_ERR_POR 0x0DU
+#define USBD_DFU_STATUS_ERR_UNKNOWN 0x0EU
+#define USBD_DFU_STATUS_ERR_STALLEDPKT 0x0FU
+
+/************************************************
+ *	bDescriptorType
+ ***********************************************/
+#define USBD_DESC_TYPE_DFU_FUNCTIONAL 0x21U
+
+/************************************************
+ *	bLength
+ ***********************************************/
+#define USBD_LENGTH_DFU_FUNCTIONAL_DESC 9
+
+/************************************************
+ *	Functional descriptor bmAttributes
+ ***********************************************/
+#define USBD_DFU_ATTR_CAN_DNLOAD 0x01U
+#define USBD_DFU_ATTR_CAN_UPLOAD 0x02U
+#define USBD_DFU_ATTR_MANIFESTATION_TOLERANT 0x04U
+#define USBD_DFU_ATTR_WILL_DETACH 0x08U
+
+/************************************************
+ *	Interface bInterfaceClass, bInterfaceSubClass
+ *  and bInterfaceProtocol
+ ***********************************************/
+#define USBD_DFU_CLASS 0xFEU
+#define USBD_DFU_SUBCLASS 0x01U
+#define USBD_DFU_PROTOCOL_RUNTIME 0x01U
+#define USBD_DFU_PROTOCOL_DFU 0x02U
+
+#define USBD_BCD_DFU11 0x0110
+
+/************************************************
+ * @brief Size of each of the two block buffers,
+ * the largest wTransferSize.
+ *
+ * @note The user can overide it.
+ ***********************************************/
+#ifndef USBD_DFU_TRANSFER_SIZE
+	#define USBD_DFU_TRANSFER_SIZE 1024U
+#endif
+
+/************************************************
+ *  DFU Functional Descriptor
+ ***********************************************/
+struct __PACKED usbd_dfu_functional_descriptor_type
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bmAttributes;
+	uint16_t wDetachTimeOut;
+	uint16_t wTransferSize;
+	uint16_t bcdDFUVersion;
+};
+
+/************************************************
+ *  GETSTATUS data stage
+ ***********************************************/
+struct __PACKED usbd_dfu_status_type
+{
+	uint8_t bStatus;
+	uint8_t bwPollTimeout[3];
+	uint8_t bState;
+	uint8_t iString;
+};
+
+/************************************************
+ * @brief Configuration of the DFU function,
+ * provided by the user during initialization.
+ *
+ * @note write and manifest are called from
+ * usbd_dfu_poll() in the main loop, the next
+ * block is received while write programs the
+ * previous one. read is called from the
+ * interrupt handler.
+ ***********************************************/
+struct usbd_dfu_config
+{
+	uint8_t interface_num; /*!< bInterfaceNumber of the DFU interface.*/
+	uint16_t transfer_size; /*!< wTransferSize of the functional descriptor, up to USBD_DFU_TRANSFER_SIZE.*/
+	uint16_t poll_timeout; /*!< Initial estimate of the time needed to program a block in ms.*/
+	bool manifestation_tolerant; /*!< Matches bitManifestationTolerant of the functional descriptor.*/
+	uint8_t (*write)(uint16_t block, const uint8_t *buf, uint16_t len); /*!< Erase if needed and program a block, returns one of USBD_DFU_STATUS.*/
+	uint16_t (*read)(uint16_t block, uint8_t *buf, uint16_t len); /*!< Optional, read back a block for UPLOAD. Returns the size, less than len after the end of the firmware.*/
+	uint8_t (*manifest)(void); /*!< Optional, called after the last block has been programmed. Returns one of USBD_DFU_STATUS.*/
+};
+
+/************************************************
+ * @brief DFU counters, times are in frames (ms).
+ * Blocks per second: blocks * 1000 / download_ms.
+ ***********************************************/
+struct usbd_dfu_stats
+{
+	uint32_t blocks; /*!< Blocks programmed.*/
+	uint32_t bytes; /*!< Bytes programmed.*/
+	uint32_t busy; /*!< GETSTATUS requests answered with dfuDNBUSY.*/
+	uint32_t program_ms; /*!< Time spent inside the write callback.*/
+	uint32_t download_ms; /*!< Time from the first DNLOAD to the end of manifestation.*/
+};
+
+/*******************************************************************************
+ * DFU functions.
+ ******************************************************************************/
+void usbd_dfu_init(const struct usbd_dfu_config *config);
+void usbd_dfu_configure(void);
+bool usbd_dfu_class_request(struct usbd_setup_packet_type setup);
+void usbd_dfu_sof(void);
+void usbd_dfu_poll(void);
+uint8_t usbd_dfu_get_state(void);
+void usbd_dfu_get_stats(struct usbd_dfu_stats *stats);
+
+#endif /*USBD_DFU_H*/
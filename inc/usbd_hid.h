@@ -0,0 +1,126 @@
+#ifndef USBD_HID_H
+#define USBD_HID_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD HID class definitions.
+ ******************************************************************************/
+
+/************************************************
+ *	bRequest
+ ***********************************************/
+#define USBD_HID_GET_REPORT 0x01U
+#define USBD_HID_GET_IDLE 0x02U
+#define USBD_HID_GET_PROTOCOL 0x03U
+#define USBD_HID_SET_REPORT 0x09U
+#define USBD_HID_SET_IDLE 0x0AU
+#define USBD_HID_SET_PROTOCOL 0x0BU
+
+/************************************************
+ *	wLength
+ ***********************************************/
+#define USBD_HID_GET_IDLE_LENGTH 1
+#define USBD_HID_GET_PROTOCOL_LENGTH 1
+
+/************************************************
+ *	bDescriptorType
+ ***********************************************/
+#define USBD_DESC_TYPE_HID 0x21U
+#define USBD_DESC_TYPE_HID_REPORT 0x22U
+#define USBD_DESC_TYPE_HID_PHYSICAL 0x23U
+
+/************************************************
+ *	bLength
+ ***********************************************/
+#define USBD_LENGTH_HID_DESC 9
+
+/************************************************
+ *	Interface bInterfaceSubClass and
+ *  bInterfaceProtocol
+ ***********************************************/
+#define USBD_HID_SUBCLASS_NONE 0x0U
+#define USBD_HID_SUBCLASS_BOOT 0x1U
+#define USBD_HID_PROTOCOL_NONE 0x0U
+#define USBD_HID_PROTOCOL_KEYBOARD 0x1U
+#define USBD_HID_PROTOCOL_MOUSE 0x2U
+
+/************************************************
+ *	Report types (high byte of wValue for
+ *  GET_REPORT/SET_REPORT).
+ ***********************************************/
+#define USBD_HID_REPORT_TYPE_INPUT 0x1U
+#define USBD_HID_REPORT_TYPE_OUTPUT 0x2U
+#define USBD_HID_REPORT_TYPE_FEATURE 0x3U
+
+/************************************************
+ *	Protocol values for GET_PROTOCOL/SET_PROTOCOL.
+ ***********************************************/
+#define USBD_HID_BOOT_PROTOCOL 0x0U
+#define USBD_HID_REPORT_PROTOCOL 0x1U
+
+#define USBD_BCD_HID111 0x0111
+
+/************************************************
+ * @brief Number of distinct input reports (one per
+ * report ID) that can be queued at the same time
+ * and the maximum size of a single report.
+ *
+ * @note The user can overide them.
+ ***********************************************/
+#ifndef USBD_HID_REPORT_SLOTS
+	#define USBD_HID_REPORT_SLOTS 1
+#endif
+#ifndef USBD_HID_MAX_REPORT_SIZE
+	#define USBD_HID_MAX_REPORT_SIZE USBD_FS_MAX_PACKET_SIZE
+#endif
+
+/************************************************
+ *  HID Descriptor
+ ***********************************************/
+struct __PACKED usbd_hid_descriptor_type
+{
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint16_t bcdHID;
+	uint8_t bCountryCode;
+	uint8_t bNumDescriptors;
+	uint8_t bReportDescriptorType;
+	uint16_t wDescriptorLength;
+};
+
+/************************************************
+ * @brief Configuration of the HID function,
+ * provided by the user during initialization.
+ *
+ * @note interval must match the bInterval of
+ * the interrupt IN endpoint descriptor.
+ ***********************************************/
+struct usbd_hid_config
+{
+	uint8_t interface_num; /*!< bInterfaceNumber of the HID interface.*/
+	uint8_t ep; /*!< Interrupt IN endpoint number.*/
+	uint16_t tx_addr; /*!< The address offset of the endpoint's IN buffer inside the Packet Memory Area.*/
+	uint8_t interval; /*!< bInterval of the interrupt IN endpoint in frames.*/
+	uint8_t *hid_descriptor; /*!< Pointer to the HID descriptor (usually inside the configuration descriptor).*/
+	uint8_t *report_descriptor; /*!< Pointer to the report descriptor.*/
+	uint16_t report_descriptor_length; /*!< Size of the report descriptor.*/
+	uint16_t (*get_report)(uint8_t type, uint8_t id, uint8_t *buf, uint16_t len); /*!< GET_REPORT callback for reports not found in the queue. Returns the report size, 0 to stall.*/
+	void (*set_report)(uint8_t type, uint8_t id, uint8_t *buf, uint16_t len); /*!< SET_REPORT callback, called after the data stage has been completed.*/
+	void (*set_protocol)(uint8_t protocol); /*!< SET_PROTOCOL callback.*/
+};
+
+/*******************************************************************************
+ * HID functions.
+ ******************************************************************************/
+void usbd_hid_init(const struct usbd_hid_config *config);
+void usbd_hid_configure(void);
+bool usbd_hid_class_request(struct usbd_setup_packet_type setup);
+uint8_t *usbd_hid_get_descriptor(struct usbd_setup_packet_type setup, uint16_t *len);
+bool usbd_hid_send_report(uint8_t id, const uint8_t *buf, uint16_t len);
+void usbd_hid_sof(void);
+
+#endif /*USBD_HID_H*/
@@ -121,6 +121,10 @@
 #define USBD_PMA_SET_TX1_COUNT(ep, count) *USBD_PMA_REG_HELPER(ep, 6) = ((uint16_t)(count) & USBD_PMA_COUNT)
 #define USBD_PMA_SET_TX_ADDR(ep, addr) USBD_PMA_SET_TX0_ADDR(ep, addr)
 #define USBD_PMA_SET_TX_COUNT(ep, count) USBD_PMA_SET_TX0_COUNT(ep, count)
+#define USBD_PMA_GET_TX0_ADDR(ep) (*USBD_PMA_REG_HELPER(ep, 0))
+#define USBD_PMA_GET_TX0_COUNT(ep) ((*USBD_PMA_REG_HELPER(ep, 2)) & USBD_PMA_COUNT)
+#define USBD_PMA_GET_TX1_ADDR(ep) (*USBD_PMA_REG_HELPER(ep, 4))
+#define USBD_PMA_GET_TX1_COUNT(ep) ((*USBD_PMA_REG_HELPER(ep, 6)) & USBD_PMA_COUNT)
 
 /************************************************
  * @brief Create the Buffer Descriptor Table by
@@ -146,6 +150,8 @@
 #define USBD_PMA_SET_RX1_ADDR(ep, addr) *USBD_PMA_REG_HELPER(ep, 4) = ((uint16_t)(addr))
 #define USBD_PMA_SET_RX1_COUNT(ep, count) *USBD_PMA_REG_HELPER(ep, 6) = USBD_PMA_RX_COUNT_ALLOC(count)
 #define USBD_PMA_GET_RX1_COUNT(ep) ((*USBD_PMA_REG_HELPER(ep, 6)) & USBD_PMA_COUNT)
+#define USBD_PMA_GET_RX0_ADDR(ep) (*USBD_PMA_REG_HELPER(ep, 0))
+#define USBD_PMA_GET_RX1_ADDR(ep) (*USBD_PMA_REG_HELPER(ep, 4))
 #define USBD_PMA_SET_RX_ADDR(ep, addr) USBD_PMA_SET_RX1_ADDR(ep, addr)
 #define USBD_PMA_SET_RX_COUNT(ep, count) USBD_PMA_SET_RX1_COUNT(ep, count)
 #define USBD_PMA_GET_RX_COUNT(ep) USBD_PMA_GET_RX1_COUNT(ep)
@@ -213,7 +219,7 @@
 	USBD_PMA_SET_RX0_ADDR(ep, rx0_addr); \
 	USBD_PMA_SET_RX0_COUNT(ep, rx_count); \
 	USBD_PMA_SET_RX1_ADDR(ep, rx1_addr); \
-	USBD_PMA_SET_RX0_COUNT(ep, rx_count); \
+	USBD_PMA_SET_RX1_COUNT(ep, rx_count); \
 	*USBD_EP_REG(ep) = USBD_EP_CONFIGURATION(ep_val, type, USB_EP_KIND, ep, (USB_EP_STAT_TX_DISABLED | USB_EP_STAT_RX_DISABLED), USBD_EP_T); \
 }while(0)
 
@@ -223,7 +229,7 @@
 #define USBD_EP_SET_TX_STALL(ep) do \
 { \
 	uint16_t ep_val = *USBD_EP_REG(ep); \
-	if (GET(ep, USB_EP_STAT_TX) != USB_EP_STAT_TX_DISABLED) \
+	if (GET(ep_val, USB_EP_STAT_TX) != USB_EP_STAT_TX_DISABLED) \
 	*USBD_EP_REG(ep) = USBD_EP_SET_TOGGLE(ep_val, USB_EP_STAT_TX_STALL, USB_EP_STAT_TX); \
 }while(0)
 
@@ -233,7 +239,7 @@
 #define USBD_EP_SET_RX_STALL(ep) do \
 { \
 	uint16_t ep_val = *USBD_EP_REG(ep); \
-	if (GET(ep, USB_EP_STAT_RX) != USB_EP_STAT_RX_DISABLED) \
+	if (GET(ep_val, USB_EP_STAT_RX) != USB_EP_STAT_RX_DISABLED) \
 	{ \
 		*USBD_EP_REG(ep) = USBD_EP_SET_TOGGLE(ep_val, USB_EP_STAT_RX_STALL, USB_EP_STAT_RX); \
 	}\
@@ -246,7 +252,7 @@
 #define USBD_EP_CLEAR_TX_STALL(ep) do \
 { \
 	uint16_t ep_val = *USBD_EP_REG(ep); \
-	if (GET(ep, USB_EP_STAT_TX) == USB_EP_STAT_TX_STALL) \
+	if (GET(ep_val, USB_EP_STAT_TX) == USB_EP_STAT_TX_STALL) \
 	{ \
 		*USBD_EP_REG(ep) = USBD_EP_SET_TOGGLE(ep_val, USB_EP_STAT_TX_NAK, (USB_EP_STAT_TX | USB_EP_DTOG_TX)); \
 	} \
@@ -259,7 +265,7 @@
 #define USBD_EP_CLEAR_RX_STALL(ep) do \
 { \
 	uint16_t ep_val = *USBD_EP_REG(ep); \
-	if (GET(ep, USB_EP_STAT_RX) == USB_EP_STAT_RX_STALL) \
+	if (GET(ep_val, USB_EP_STAT_RX) == USB_EP_STAT_RX_STALL) \
 	{ \
 		*USBD_EP_REG(ep) = USBD_EP_SET_TOGGLE(ep_val, USB_EP_STAT_RX_VALID, (USB_EP_STAT_RX | USB_EP_DTOG_RX)); \
 	} \
@@ -269,9 +275,9 @@
 * @brief Get the stall condition of the selected
 * direction of an endpoint.
 ***********************************************/
-#define USBD_EP_GET_STALL(ep, dir) !(dir) \
+#define USBD_EP_GET_STALL(ep, dir) (!(dir) \
 	? (GET(*USBD_EP_REG(ep), USB_EP_STAT_RX) == USB_EP_STAT_RX_STALL) \
-	: (GET(*USBD_EP_REG(ep), USB_EP_STAT_TX) == USB_EP_STAT_TX_STALL)
+	: (GET(*USBD_EP_REG(ep), USB_EP_STAT_TX) == USB_EP_STAT_TX_STALL))
 
 /************************************************
 * @brief Set the status of an IN endpoint.
@@ -0,0 +1,119 @@
+#ifndef USBD_MIDI_H
+#define USBD_MIDI_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD MIDI class (USB-MIDI 1.0) definitions.
+ ******************************************************************************/
+
+/************************************************
+ *	bDescriptorSubtype
+ ***********************************************/
+#define USBD_MIDI_MS_HEADER 0x1U
+#define USBD_MIDI_IN_JACK 0x2U
+#define USBD_MIDI_OUT_JACK 0x3U
+#define USBD_MIDI_ELEMENT 0x4U
+#define USBD_MIDI_MS_GENERAL 0x1U
+
+/************************************************
+ *	bJackType
+ ***********************************************/
+#define USBD_MIDI_JACK_EMBEDDED 0x1U
+#define USBD_MIDI_JACK_EXTERNAL 0x2U
+
+#define USBD_BCD_MIDI10 0x0100
+
+/************************************************
+ *	Code Index Number (low nibble of the first
+ *  byte of an event packet)
+ ***********************************************/
+#define USBD_MIDI_CIN_MISC 0x0U
+#define USBD_MIDI_CIN_CABLE_EVENT 0x1U
+#define USBD_MIDI_CIN_SYSCOM_2 0x2U
+#define USBD_MIDI_CIN_SYSCOM_3 0x3U
+#define USBD_MIDI_CIN_SYSEX_START 0x4U
+#define USBD_MIDI_CIN_SYSEX_END_1 0x5U
+#define USBD_MIDI_CIN_SYSEX_END_2 0x6U
+#define USBD_MIDI_CIN_SYSEX_END_3 0x7U
+#define USBD_MIDI_CIN_NOTE_OFF 0x8U
+#define USBD_MIDI_CIN_NOTE_ON 0x9U
+#define USBD_MIDI_CIN_POLY_KEYPRESS 0xAU
+#define USBD_MIDI_CIN_CONTROL_CHANGE 0xBU
+#define USBD_MIDI_CIN_PROGRAM_CHANGE 0xCU
+#define USBD_MIDI_CIN_CHANNEL_PRESSURE 0xDU
+#define USBD_MIDI_CIN_PITCH_BEND 0xEU
+#define USBD_MIDI_CIN_SINGLE_BYTE 0xFU
+
+#define USBD_MIDI_EVENT_SIZE 4U /*!< Size of a USB-MIDI event packet.*/
+
+/************************************************
+ * @brief Builds a 32-bit event packet, the byte
+ * order on the bus is cable/CIN, midi0, midi1,
+ * midi2.
+ ***********************************************/
+#define USBD_MIDI_EVENT(cable, cin, midi0, midi1, midi2) \
+	((uint32_t)((((cable) & 0xFU) << 0x4U) | ((cin) & 0xFU)) | ((uint32_t)((midi0) & 0xFFU) << 0x8U) | \
+	((uint32_t)((midi1) & 0xFFU) << 0x10U) | ((uint32_t)((midi2) & 0xFFU) << 0x18U))
+
+/************************************************
+ * @brief Number of event packets of each ring
+ * buffer, has to be a power of 2.
+ *
+ * @note The user can overide it.
+ ***********************************************/
+#ifndef USBD_MIDI_FIFO_SIZE
+	#define USBD_MIDI_FIFO_SIZE 128U
+#endif
+
+#if (USBD_MIDI_FIFO_SIZE & (USBD_MIDI_FIFO_SIZE - 1U))
+	#error "USBD_MIDI_FIFO_SIZE has to be a power of 2."
+#endif
+
+/************************************************
+ * @brief Configuration of the MIDI function,
+ * provided by the user during initialization.
+ ***********************************************/
+struct usbd_midi_config
+{
+	uint8_t interface_num; /*!< bInterfaceNumber of the MIDIStreaming interface.*/
+	uint8_t in_ep; /*!< Bulk IN endpoint number.*/
+	uint8_t out_ep; /*!< Bulk OUT endpoint number.*/
+	uint16_t tx_addr; /*!< The address offset of the IN buffer inside the Packet Memory Area.*/
+	uint16_t rx_addr; /*!< The address offset of the OUT buffer inside the Packet Memory Area.*/
+	uint16_t max_packet_size; /*!< wMaxPacketSize of both endpoints, a multiple of 4.*/
+	void (*rx_ready)(void); /*!< Optional callback (interrupt context), events are ready to be read with usbd_midi_receive().*/
+};
+
+/************************************************
+ * @brief MIDI counters. Latency is the number of
+ * frames the oldest event of a packet waited in
+ * the ring buffer.
+ * Events per second: events_in * 1000 / frames.
+ ***********************************************/
+struct usbd_midi_stats
+{
+	uint32_t events_in; /*!< Events sent to the host.*/
+	uint32_t events_out; /*!< Events received from the host.*/
+	uint32_t packets_in; /*!< Bulk IN packets.*/
+	uint32_t packets_out; /*!< Bulk OUT packets.*/
+	uint32_t dropped; /*!< Events rejected because the IN ring buffer was full.*/
+	uint32_t frames; /*!< Start of frames.*/
+	uint32_t latency_sum; /*!< Sum of the packet latencies in frames.*/
+	uint32_t latency_max; /*!< Largest packet latency in frames.*/
+};
+
+/*******************************************************************************
+ * MIDI functions.
+ ******************************************************************************/
+void usbd_midi_init(const struct usbd_midi_config *config);
+void usbd_midi_configure(void);
+void usbd_midi_sof(void);
+uint32_t usbd_midi_send(const uint32_t *events, uint32_t n);
+uint32_t usbd_midi_receive(uint32_t *events, uint32_t n);
+void usbd_midi_get_stats(struct usbd_midi_stats *stats);
+
+#endif /*USBD_MIDI_H*/
@@ -0,0 +1,59 @@
+#ifndef USBD_MSOS20_H
+#define USBD_MSOS20_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD Microsoft OS 2.0 descriptors definitions. Windows 8.1 and newer bind
+ * the driver given by the compatible ID (for example WinUSB) without an INF.
+ * The device descriptor needs a bcdUSB of at least USBD_BCD_USB21.
+ ******************************************************************************/
+
+/************************************************
+ * @brief Maximum size of the generated
+ * descriptor set, in bytes.
+ *
+ * @note The user can overide it.
+ ***********************************************/
+#ifndef USBD_MSOS20_DESC_SIZE
+	#define USBD_MSOS20_DESC_SIZE 512U
+#endif
+
+#define USBD_MSOS20_COMPATIBLE_ID_WINUSB "WINUSB"
+
+/************************************************
+ * @brief Microsoft OS 2.0 properties of a
+ * function.
+ ***********************************************/
+struct usbd_msos20_function
+{
+	uint8_t first_interface; /*!< bFirstInterface of the function, only used by composite devices.*/
+	const char *compatible_id; /*!< Up to 8 characters, for example USBD_MSOS20_COMPATIBLE_ID_WINUSB.*/
+	const char *sub_compatible_id; /*!< Optional, up to 8 characters.*/
+	const char *interface_guid; /*!< Optional, DeviceInterfaceGUIDs registry property, "{xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}".*/
+};
+
+/************************************************
+ * @brief Configuration of the Microsoft OS 2.0
+ * descriptors, provided by the user during
+ * initialization.
+ ***********************************************/
+struct usbd_msos20_config
+{
+	uint8_t vendor_code; /*!< bMS_VendorCode, bRequest of the descriptor set request.*/
+	bool composite; /*!< Adds the configuration and function subset headers, each function applies to its own interfaces. Otherwise the single function applies to the whole device.*/
+	const struct usbd_msos20_function *functions; /*!< Array of the functions.*/
+	uint8_t function_count; /*!< Number of functions, 1 unless composite.*/
+};
+
+/*******************************************************************************
+ * Microsoft OS 2.0 functions.
+ ******************************************************************************/
+void usbd_msos20_init(const struct usbd_msos20_config *config);
+uint8_t *usbd_msos20_bos_descriptor(void);
+bool usbd_msos20_vendor_request(struct usbd_setup_packet_type setup);
+
+#endif /*USBD_MSOS20_H*/
@@ -0,0 +1,159 @@
+#ifndef USBD_NCM_H
+#define USBD_NCM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD CDC Network Control Model definitions.
+ ******************************************************************************/
+
+/************************************************
+ *	bRequest
+ ***********************************************/
+#define USBD_CDC_SET_ETHERNET_MULTICAST_FILTERS 0x40U
+#define USBD_CDC_SET_ETHERNET_PACKET_FILTER 0x43U
+#define USBD_NCM_GET_NTB_PARAMETERS 0x80U
+#define USBD_NCM_GET_NTB_FORMAT 0x83U
+#define USBD_NCM_SET_NTB_FORMAT 0x84U
+#define USBD_NCM_GET_NTB_INPUT_SIZE 0x85U
+#define USBD_NCM_SET_NTB_INPUT_SIZE 0x86U
+#define USBD_NCM_GET_MAX_DATAGRAM_SIZE 0x87U
+
+/************************************************
+ *	bNotification
+ ***********************************************/
+#define USBD_CDC_NETWORK_CONNECTION 0x00U
+#define USBD_CDC_CONNECTION_SPEED_CHANGE 0x2AU
+
+/************************************************
+ *	wLength
+ ***********************************************/
+#define USBD_NCM_GET_NTB_FORMAT_LENGTH 2
+#define USBD_NCM_NTB_INPUT_SIZE_LENGTH 4
+#define USBD_NCM_MAX_DATAGRAM_SIZE_LENGTH 2
+
+/************************************************
+ *	Interface bInterfaceSubClass and
+ *  bInterfaceProtocol
+ ***********************************************/
+#define USBD_CDC_SUBCLASS_NCM 0x0DU
+#define USBD_CDC_PROTOCOL_NONE 0x00U
+#define USBD_CDC_DATA_PROTOCOL_NCM 0x01U
+
+/************************************************
+ *	bDescriptorSubtype
+ ***********************************************/
+#define USBD_CDC_FUNC_HEADER 0x00U
+#define USBD_CDC_FUNC_UNION 0x06U
+#define USBD_CDC_FUNC_ETHERNET 0x0FU
+#define USBD_CDC_FUNC_NCM 0x1AU
+
+#define USBD_BCD_CDC120 0x0120
+#define USBD_BCD_NCM100 0x0100
+
+/************************************************
+ *	NTB definitions
+ ***********************************************/
+#define USBD_NCM_NTH16_SIGNATURE 0x484D434EUL /*!< "NCMH"*/
+#define USBD_NCM_NDP16_SIGNATURE 0x304D434EUL /*!< "NCM0" (no CRC)*/
+#define USBD_NCM_NTH16_LENGTH 12U
+#define USBD_NCM_NDP16_LENGTH 8U
+#define USBD_NCM_FORMAT_NTB16 0x0001U
+#define USBD_NCM_MAX_DATAGRAM_SIZE 1514U
+#define USBD_NCM_NDP_DIVISOR 4U
+
+/************************************************
+ * @brief Size of each NTB buffer (two per
+ * direction), maximum datagrams aggregated in an
+ * IN NTB, and frames an IN NTB waits for more
+ * datagrams before it's sent.
+ *
+ * @note The user can overide them.
+ ***********************************************/
+#ifndef USBD_NCM_NTB_IN_SIZE
+	#define USBD_NCM_NTB_IN_SIZE 2048U
+#endif
+#ifndef USBD_NCM_NTB_OUT_SIZE
+	#define USBD_NCM_NTB_OUT_SIZE 2048U
+#endif
+#ifndef USBD_NCM_MAX_DATAGRAMS
+	#define USBD_NCM_MAX_DATAGRAMS 16U
+#endif
+#ifndef USBD_NCM_TX_FLUSH_FRAMES
+	#define USBD_NCM_TX_FLUSH_FRAMES 1U
+#endif
+
+/************************************************
+ *  NTB Parameter Structure (GET_NTB_PARAMETERS)
+ ***********************************************/
+struct __PACKED usbd_ncm_ntb_parameters_type
+{
+	uint16_t wLength;
+	uint16_t bmNtbFormatsSupported;
+	uint32_t dwNtbInMaxSize;
+	uint16_t wNdpInDivisor;
+	uint16_t wNdpInPayloadRemainder;
+	uint16_t wNdpInAlignment;
+	uint16_t wReserved;
+	uint32_t dwNtbOutMaxSize;
+	uint16_t wNdpOutDivisor;
+	uint16_t wNdpOutPayloadRemainder;
+	uint16_t wNdpOutAlignment;
+	uint16_t wNtbOutMaxDatagrams;
+};
+
+/************************************************
+ * @brief Configuration of the NCM function,
+ * provided by the user during initialization.
+ *
+ * @note The notification endpoint needs a
+ * wMaxPacketSize of at least 16.
+ ***********************************************/
+struct usbd_ncm_config
+{
+	uint8_t comm_interface_num; /*!< bInterfaceNumber of the communication interface.*/
+	uint8_t data_interface_num; /*!< bInterfaceNumber of the data interface.*/
+	uint8_t notify_ep; /*!< Interrupt IN endpoint number.*/
+	uint8_t in_ep; /*!< Bulk IN endpoint number.*/
+	uint8_t out_ep; /*!< Bulk OUT endpoint number.*/
+	uint16_t notify_tx_addr; /*!< The address offset of the interrupt IN buffer inside the Packet Memory Area.*/
+	uint16_t tx_addr; /*!< The address offset of the bulk IN buffer inside the Packet Memory Area.*/
+	uint16_t rx_addr; /*!< The address offset of the bulk OUT buffer inside the Packet Memory Area.*/
+	uint16_t max_packet_size; /*!< wMaxPacketSize of the bulk endpoints.*/
+	void (*rx_ready)(void); /*!< Optional callback (interrupt context), an OUT NTB is ready to be read with usbd_ncm_rx_frame().*/
+};
+
+/************************************************
+ * @brief NCM counters.
+ ***********************************************/
+struct usbd_ncm_stats
+{
+	uint32_t rx_frames; /*!< Datagrams handed to the network stack.*/
+	uint32_t rx_ntbs; /*!< OUT NTBs received.*/
+	uint32_t rx_errors; /*!< OUT NTBs dropped because of an invalid header or size.*/
+	uint32_t tx_frames; /*!< Datagrams sent.*/
+	uint32_t tx_ntbs; /*!< IN NTBs sent.*/
+	uint32_t tx_dropped; /*!< Datagrams committed after the data interface was reset, see usbd_ncm_tx_commit().*/
+};
+
+/*******************************************************************************
+ * NCM functions.
+ ******************************************************************************/
+void usbd_ncm_init(const struct usbd_ncm_config *config);
+void usbd_ncm_configure(void);
+bool usbd_ncm_set_interface(uint8_t num, uint8_t alt);
+bool usbd_ncm_is_alternate_valid(uint8_t num, uint8_t alt);
+bool usbd_ncm_get_interface(uint8_t num, uint8_t *alt);
+bool usbd_ncm_class_request(struct usbd_setup_packet_type setup);
+void usbd_ncm_sof(void);
+void usbd_ncm_set_link(bool up);
+uint8_t *usbd_ncm_rx_frame(uint16_t *len);
+uint8_t *usbd_ncm_tx_alloc(uint16_t len);
+void usbd_ncm_tx_commit(uint16_t len);
+void usbd_ncm_tx_flush(void);
+void usbd_ncm_get_stats(struct usbd_ncm_stats *stats);
+
+#endif /*USBD_NCM_H*/
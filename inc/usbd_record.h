@@ -0,0 +1,68 @@
+#ifndef USBD_RECORD_H
+#define USBD_RECORD_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD Interrupt recorder definitions, enabled by USBD_RECORD.
+ *
+ * Each entry of the usbd_core interrupt handler is logged with the cycles
+ * elapsed since the previous one, ISTR, FNR, the non zero endpoint registers
+ * and, for OUT and SETUP transactions, the received payload. The log is linear
+ * and starts at usbd_core_init() so it always describes the device from power
+ * up, recording stops when it is full.
+ *
+ * usbd_record_replay() feeds a log back into the usbd_core. It needs the USB
+ * registers and the Packet Memory Area to be plain memory, as in a host build
+ * with a stubbed device header, where a profiler can run on the exact event
+ * stream captured in the field.
+ ******************************************************************************/
+
+/************************************************
+ * @brief Size of the log in bytes.
+ *
+ * @note The user can overide it.
+ ***********************************************/
+#ifndef USBD_RECORD_SIZE
+	#define USBD_RECORD_SIZE 8192U
+#endif
+
+#define USBD_RECORD_RX_COUNT 0x03FFU /*!< Received bytes, in the rx field of an entry.*/
+#define USBD_RECORD_RX_BUF0 0x8000U /*!< The payload is in the RX0 buffer of a double buffered endpoint.*/
+
+/************************************************
+ * @brief Entry header, followed by a uint16_t
+ * for each bit of ep_mask and by the payload.
+ ***********************************************/
+struct __PACKED usbd_record_entry_type
+{
+	uint32_t cycles; /*!< DWT cycles since the previous entry.*/
+	uint16_t istr; /*!< ISTR at the entry of the interrupt handler.*/
+	uint16_t fnr; /*!< FNR at the entry of the interrupt handler.*/
+	uint8_t ep_mask; /*!< Endpoint registers that follow, the others were zero.*/
+	uint16_t rx; /*!< Payload bytes that follow and their buffer.*/
+};
+
+/************************************************
+ * @brief Recorder counters.
+ ***********************************************/
+struct usbd_record_stats
+{
+	uint32_t entries; /*!< Entries logged.*/
+	uint32_t dropped; /*!< Entries lost because the log was full.*/
+};
+
+/*******************************************************************************
+ * Recorder functions, usbd_record_start and usbd_record_irq are called by
+ * the usbd_core.
+ ******************************************************************************/
+void usbd_record_start(void);
+void usbd_record_irq(uint16_t istr);
+const uint8_t *usbd_record_log(uint32_t *len);
+void usbd_record_replay(const uint8_t *log, uint32_t len);
+void usbd_record_get_stats(struct usbd_record_stats *stats_out);
+
+#endif /*USBD_RECORD_H*/
@@ -0,0 +1,59 @@
+#ifndef USBD_STRING_H
+#define USBD_STRING_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD String descriptor definitions.
+ ******************************************************************************/
+
+/************************************************
+ * @brief Defines a string descriptor named name,
+ * converted from the UTF-8 string literal str to
+ * UTF-16LE by the compiler. It is placed in flash.
+ * The string has to be at most 126 characters
+ * long.
+ *
+ * Example:
+ * USBD_STRING_DESCRIPTOR(product_string, "Température");
+ * return (uint8_t*)&product_string;
+ ***********************************************/
+#define USBD_STRING_DESCRIPTOR(name, str) \
+	static const struct __PACKED \
+	{ \
+		struct usbd_std_string_descriptor_type header; \
+		uint16_t bString[(sizeof(u"" str) >> 0x1U) - 1U]; \
+	} name = { { sizeof(u"" str), USBD_DESC_TYPE_STRING }, u"" str }; \
+	_Static_assert(sizeof(u"" str) <= 0xFFU, "String descriptor " #name " is too long.")
+
+/************************************************
+ * @brief Defines the string descriptor of index
+ * 0 named name, with the list of the supported
+ * wLANGID.
+ *
+ * Example:
+ * USBD_LANGID_DESCRIPTOR(lang_ids, USBD_LANGID_ENGLISH_US);
+ ***********************************************/
+#define USBD_LANGID_DESCRIPTOR(name, ...) \
+	static const struct __PACKED \
+	{ \
+		struct usbd_std_string_descriptor_type header; \
+		uint16_t wLANGID[sizeof((const uint16_t[]){ __VA_ARGS__ }) >> 0x1U]; \
+	} name = { { sizeof(struct usbd_std_string_descriptor_type) + sizeof((const uint16_t[]){ __VA_ARGS__ }), USBD_DESC_TYPE_STRING }, { __VA_ARGS__ } }
+
+/************************************************
+ * @brief Number of hexadecimal characters of the
+ * serial number, 96-bit unique ID.
+ ***********************************************/
+#define USBD_STRING_SERIAL_LENGTH 24U
+
+/*******************************************************************************
+ * String functions.
+ ******************************************************************************/
+void usbd_string_serial_init(void);
+uint8_t *usbd_string_serial(void);
+
+#endif /*USBD_STRING_H*/
@@ -0,0 +1,143 @@
+#ifndef USBD_UVC_H
+#define USBD_UVC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD Video class (UVC 1.1) definitions, bulk streaming.
+ ******************************************************************************/
+
+/************************************************
+ *	bRequest
+ ***********************************************/
+#define USBD_UVC_SET_CUR 0x01U
+#define USBD_UVC_GET_CUR 0x81U
+#define USBD_UVC_GET_MIN 0x82U
+#define USBD_UVC_GET_MAX 0x83U
+#define USBD_UVC_GET_RES 0x84U
+#define USBD_UVC_GET_LEN 0x85U
+#define USBD_UVC_GET_INFO 0x86U
+#define USBD_UVC_GET_DEF 0x87U
+
+/************************************************
+ *	VideoStreaming control selectors (high
+ *  byte of wValue)
+ ***********************************************/
+#define USBD_UVC_VS_PROBE_CONTROL 0x01U
+#define USBD_UVC_VS_COMMIT_CONTROL 0x02U
+
+/************************************************
+ *	wLength
+ ***********************************************/
+#define USBD_UVC_GET_LEN_LENGTH 2
+#define USBD_UVC_GET_INFO_LENGTH 1
+
+/************************************************
+ *	Interface bInterfaceClass, bInterfaceSubClass
+ *  and bFunctionSubClass
+ ***********************************************/
+#define USBD_UVC_CLASS 0x0EU
+#define USBD_UVC_SUBCLASS_VIDEOCONTROL 0x01U
+#define USBD_UVC_SUBCLASS_VIDEOSTREAMING 0x02U
+#define USBD_UVC_SUBCLASS_INTERFACE_COLLECTION 0x03U
+
+/************************************************
+ *	bDescriptorSubtype
+ ***********************************************/
+#define USBD_UVC_VC_HEADER 0x01U
+#define USBD_UVC_VC_INPUT_TERMINAL 0x02U
+#define USBD_UVC_VC_OUTPUT_TERMINAL 0x03U
+#define USBD_UVC_VS_INPUT_HEADER 0x01U
+#define USBD_UVC_VS_FORMAT_UNCOMPRESSED 0x04U
+#define USBD_UVC_VS_FRAME_UNCOMPRESSED 0x05U
+#define USBD_UVC_VS_COLORFORMAT 0x0DU
+
+/************************************************
+ *	wTerminalType
+ ***********************************************/
+#define USBD_UVC_TT_STREAMING 0x0101U
+#define USBD_UVC_ITT_CAMERA 0x0201U
+
+#define USBD_BCD_UVC11 0x0110
+
+/************************************************
+ *	Payload header
+ ***********************************************/
+#define USBD_UVC_HEADER_LENGTH 2U
+#define USBD_UVC_HEADER_FID 0x01U
+#define USBD_UVC_HEADER_EOF 0x02U
+#define USBD_UVC_HEADER_EOH 0x80U
+
+/************************************************
+ *  Video Probe and Commit Controls
+ ***********************************************/
+struct __PACKED usbd_uvc_probe_type
+{
+	uint16_t bmHint;
+	uint8_t bFormatIndex;
+	uint8_t bFrameIndex;
+	uint32_t dwFrameInterval;
+	uint16_t wKeyFrameRate;
+	uint16_t wPFrameRate;
+	uint16_t wCompQuality;
+	uint16_t wCompWindowSize;
+	uint16_t wDelay;
+	uint32_t dwMaxVideoFrameSize;
+	uint32_t dwMaxPayloadTransferSize;
+	uint32_t dwClockFrequency;
+	uint8_t bmFramingInfo;
+	uint8_t bPreferedVersion;
+	uint8_t bMinVersion;
+	uint8_t bMaxVersion;
+};
+
+/************************************************
+ * @brief Configuration of the Video function,
+ * provided by the user during initialization.
+ * A single uncompressed format with a single
+ * frame (bFormatIndex and bFrameIndex 1).
+ *
+ * @note Frames are sent straight from the frame
+ * buffer, it has to stay untouched until
+ * frame_done is called.
+ ***********************************************/
+struct usbd_uvc_config
+{
+	uint8_t vs_interface_num; /*!< bInterfaceNumber of the VideoStreaming interface.*/
+	uint8_t ep; /*!< Bulk IN endpoint number.*/
+	uint16_t tx0_addr; /*!< The address offset of the first IN buffer inside the Packet Memory Area.*/
+	uint16_t tx1_addr; /*!< The address offset of the second IN buffer inside the Packet Memory Area.*/
+	uint16_t max_packet_size; /*!< wMaxPacketSize of the bulk endpoint.*/
+	uint32_t frame_size; /*!< dwMaxVideoFrameSize, size of a frame in bytes.*/
+	uint32_t frame_interval; /*!< Shortest dwFrameInterval in 100 ns units.*/
+	const uint8_t *(*get_frame)(void); /*!< Interrupt context, returns the next frame or NULL if none is ready yet.*/
+	void (*frame_done)(const uint8_t *frame); /*!< Optional, interrupt context, the frame buffer can be reused.*/
+	void (*stream_changed)(bool on, uint32_t frame_interval); /*!< Optional, streaming has been started by COMMIT or stopped by CLEAR_FEATURE(ENDPOINT_HALT).*/
+};
+
+/************************************************
+ * @brief Video counters.
+ * Frames per second: frames * 1000 / sof.
+ ***********************************************/
+struct usbd_uvc_stats
+{
+	uint32_t frames; /*!< Frames sent.*/
+	uint32_t bytes; /*!< Payload bytes sent, headers included.*/
+	uint32_t sof; /*!< Start of frames while streaming.*/
+	uint32_t starved; /*!< Start of frames while streaming without a frame to send.*/
+};
+
+/*******************************************************************************
+ * Video functions.
+ ******************************************************************************/
+void usbd_uvc_init(const struct usbd_uvc_config *config);
+void usbd_uvc_configure(void);
+bool usbd_uvc_class_request(struct usbd_setup_packet_type setup);
+void usbd_uvc_clear_stall(uint8_t num, uint8_t dir);
+void usbd_uvc_sof(void);
+void usbd_uvc_get_stats(struct usbd_uvc_stats *stats);
+
+#endif /*USBD_UVC_H*/
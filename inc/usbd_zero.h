@@ -0,0 +1,99 @@
+#ifndef USBD_ZERO_H
+#define USBD_ZERO_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "usbd_core.h"
+
+/*******************************************************************************
+ * USBD vendor bulk test function ("gadget zero") definitions.
+ ******************************************************************************/
+
+/************************************************
+ *	bRequest (vendor, recipient interface)
+ ***********************************************/
+#define USBD_ZERO_SET_PARAMS 0x01U
+#define USBD_ZERO_GET_PARAMS 0x02U
+#define USBD_ZERO_GET_STATS 0x03U
+#define USBD_ZERO_RESET_STATS 0x04U
+
+/************************************************
+ *	Modes
+ ***********************************************/
+#define USBD_ZERO_MODE_IDLE 0x0U /*!< Both endpoints NAK.*/
+#define USBD_ZERO_MODE_SOURCE 0x1U /*!< The IN endpoint sends data continuously.*/
+#define USBD_ZERO_MODE_SINK 0x2U /*!< The OUT endpoint accepts data continuously.*/
+#define USBD_ZERO_MODE_LOOPBACK 0x3U /*!< Every OUT packet is sent back on the IN endpoint.*/
+
+/************************************************
+ *	Data patterns
+ ***********************************************/
+#define USBD_ZERO_PATTERN_ZERO 0x0U /*!< All bytes are 0.*/
+#define USBD_ZERO_PATTERN_MOD63 0x1U /*!< Byte n of a transfer is n % 63.*/
+
+/************************************************
+ *	Parameters (data stage of SET_PARAMS and
+ *  GET_PARAMS).
+ ***********************************************/
+struct __PACKED usbd_zero_params
+{
+	uint8_t mode; /*!< One of USBD_ZERO_MODE.*/
+	uint8_t pattern; /*!< One of USBD_ZERO_PATTERN.*/
+	uint8_t verify; /*!< Compare received data against the pattern (sink mode).*/
+	uint8_t reserved;
+	uint16_t packet_size; /*!< Size of a full packet, up to the max packet size.*/
+	uint16_t reserved1;
+	uint32_t transfer_size; /*!< Size of a transfer, the last packet of a transfer can be short.*/
+};
+
+/************************************************
+ *	Counters (data stage of GET_STATS). The
+ *  core fields are zero unless USBD_CORE_STATS
+ *  is set.
+ *  Bytes per frame: (bytes_in + bytes_out) / frames.
+ *  Cycles per packet: irq_cycles / (packets_in + packets_out).
+ *  CPU headroom: 1 - irq_cycles / (frames * core_clock / 1000).
+ ***********************************************/
+struct __PACKED usbd_zero_stats
+{
+	uint32_t bytes_in; /*!< Bytes sent to the host.*/
+	uint32_t bytes_out; /*!< Bytes received from the host.*/
+	uint32_t packets_in; /*!< Packets sent to the host.*/
+	uint32_t packets_out; /*!< Packets received from the host.*/
+	uint32_t errors; /*!< Packets that failed verification.*/
+	uint32_t frames; /*!< Start of frames.*/
+	uint32_t irq_count; /*!< USB interrupts (core).*/
+	uint32_t irq_cycles; /*!< Cycles spent in the USB interrupt handler (core).*/
+	uint32_t pma_bytes; /*!< Bytes copied from/to the PMA (core).*/
+	uint32_t core_clock; /*!< Core clock in Hz.*/
+};
+
+/************************************************
+ * @brief Configuration of the test function,
+ * provided by the user during initialization.
+ *
+ * @note in_ep and out_ep can be the same
+ * endpoint number.
+ ***********************************************/
+struct usbd_zero_config
+{
+	uint8_t interface_num; /*!< bInterfaceNumber of the vendor interface.*/
+	uint8_t in_ep; /*!< Bulk IN endpoint number.*/
+	uint8_t out_ep; /*!< Bulk OUT endpoint number.*/
+	uint16_t tx_addr; /*!< The address offset of the IN buffer inside the Packet Memory Area.*/
+	uint16_t rx_addr; /*!< The address offset of the OUT buffer inside the Packet Memory Area.*/
+	uint16_t max_packet_size; /*!< wMaxPacketSize of both endpoints.*/
+	uint32_t core_clock; /*!< Core clock in Hz, reported to the host.*/
+};
+
+/*******************************************************************************
+ * Test function functions.
+ ******************************************************************************/
+void usbd_zero_init(const struct usbd_zero_config *config);
+void usbd_zero_configure(void);
+bool usbd_zero_vendor_request(struct usbd_setup_packet_type setup);
+void usbd_zero_sof(void);
+void usbd_zero_set_params(const struct usbd_zero_params *params);
+
+#endif /*USBD_ZERO_H*/
@@ -0,0 +1,739 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_audio.h"
+
+/************************************************
+ * Single producer, single consumer ring buffer
+ * between the application and an iso endpoint.
+ * head is only written by the producer and tail
+ * only by the consumer, so no locking is needed.
+ ***********************************************/
+struct usbd_audio_fifo
+{
+	uint8_t buf[USBD_AUDIO_FIFO_SIZE];
+	__IO uint32_t head;
+	__IO uint32_t tail;
+};
+
+/************************************************
+ * Runtime state of an audio stream.
+ ***********************************************/
+struct usbd_audio_stream
+{
+	const struct usbd_audio_stream_config *cfg; /*!< Pointer to the stream configuration.*/
+	struct usbd_audio_fifo fifo; /*!< Ring buffer of the stream.*/
+	uint8_t alt; /*!< Current alternate setting, 0 if the stream is idle.*/
+	uint32_t sample_rate; /*!< Current sampling frequency.*/
+	uint16_t frame_bytes; /*!< Size of a sample for all channels.*/
+	uint16_t frame_rem; /*!< Accumulator of the fractional samples per frame (e.g. 44.1 kHz).*/
+	__IO bool primed; /*!< Speaker: the ring buffer has reached its target level. Microphone: the last packet has been sent.*/
+	__IO uint8_t flush_req; /*!< Speaker: incremented by the USB interrupt to have the consumer empty the ring buffer.*/
+	__IO uint8_t flush_ack; /*!< Speaker: flush_req handled by the consumer, the ring buffer is empty when they are equal.*/
+	bool mute; /*!< Feature unit mute.*/
+	int16_t volume; /*!< Feature unit volume.*/
+};
+
+/************************************************
+ * Static variables used by the Audio class.
+ ***********************************************/
+static const struct usbd_audio_config *cfg; /*!< Pointer to the configuration provided by the user during initialization.*/
+static struct usbd_audio_stream spk; /*!< Speaker (OUT) stream.*/
+static struct usbd_audio_stream mic; /*!< Microphone (IN) stream.*/
+static struct usbd_audio_stats stats; /*!< Stream error counters.*/
+static uint8_t pkt_buf[USBD_AUDIO_MAX_PACKET_SIZE]; /*!< Bounce buffer between the PMA and the ring buffers.*/
+static uint8_t ctrl_buf[4]; /*!< Buffer used for endpoint 0 data stages.*/
+static struct usbd_audio_stream *ctrl_stream; /*!< Stream of the pending SET_CUR request.*/
+static uint8_t ctrl_cs; /*!< Control selector of the pending SET_CUR request.*/
+static bool ctrl_ep; /*!< The pending SET_CUR request is addressed to an endpoint.*/
+
+/************************************************
+ * Function prototypes.
+ ***********************************************/
+static uint32_t usbd_audio_fifo_put(struct usbd_audio_fifo *fifo, const uint8_t *buf, uint32_t len);
+static uint32_t usbd_audio_fifo_get(struct usbd_audio_fifo *fifo, uint8_t *buf, uint32_t len);
+static uint16_t usbd_audio_next_frame_samples(struct usbd_audio_stream *s);
+static void usbd_audio_start(struct usbd_audio_stream *s, uint8_t alt, bool in);
+static void usbd_audio_speaker_out(void);
+static void usbd_audio_microphone_in(void);
+static void usbd_audio_feedback_in(void);
+static void usbd_audio_feedback(void);
+static void usbd_audio_microphone_packet(void);
+static void usbd_audio_set_cur_cplt(void);
+static void usbd_audio_feature_request(struct usbd_audio_stream *s, struct usbd_setup_packet_type setup);
+static void usbd_audio_ep_request(struct usbd_audio_stream *s, struct usbd_setup_packet_type setup);
+
+/**
+ * @brief Copy data to a ring buffer.
+ * @param fifo Pointer to the ring buffer.
+ * @param buf Pointer to the data.
+ * @param len Size of the data.
+ * @return The amount of data copied, less than len if the ring buffer is full.
+ */
+static uint32_t usbd_audio_fifo_put(struct usbd_audio_fifo *fifo, const uint8_t *buf, uint32_t len)
+{
+	uint32_t head = fifo->head;
+	uint32_t idx = head & (USBD_AUDIO_FIFO_SIZE - 1U);
+	uint32_t first;
+
+	len = MIN(len, USBD_AUDIO_FIFO_SIZE - (head - fifo->tail));
+	first = MIN(len, USBD_AUDIO_FIFO_SIZE - idx);
+	memcpy(&fifo->buf[idx], buf, first);
+	memcpy(fifo->buf, buf + first, len - first);
+	/*Publish the data before moving the head.*/
+	__DMB();
+	fifo->head = head + len;
+	return len;
+}
+
+/**
+ * @brief Copy data from a ring buffer.
+ * @param fifo Pointer to the ring buffer.
+ * @param buf Pointer to the buffer that receives the data.
+ * @param len Size of the buffer.
+ * @return The amount of data copied, less than len if the ring buffer is empty.
+ */
+static uint32_t usbd_audio_fifo_get(struct usbd_audio_fifo *fifo, uint8_t *buf, uint32_t len)
+{
+	uint32_t tail = fifo->tail;
+	uint32_t idx = tail & (USBD_AUDIO_FIFO_SIZE - 1U);
+	uint32_t first;
+
+	len = MIN(len, fifo->head - tail);
+	first = MIN(len, USBD_AUDIO_FIFO_SIZE - idx);
+	memcpy(buf, &fifo->buf[idx], first);
+	memcpy(buf + first, fifo->buf, len - first);
+	__DMB();
+	fifo->tail = tail + len;
+	return len;
+}
+
+/**
+ * @brief Samples that belong to the next frame. Rates that aren't a multiple
+ * of 1 kHz carry the remainder to the next frames.
+ * @param s Pointer to the stream.
+ * @return Samples per channel of the next frame.
+ */
+static uint16_t usbd_audio_next_frame_samples(struct usbd_audio_stream *s)
+{
+	uint16_t n = s->sample_rate / 1000U;
+	s->frame_rem += s->sample_rate % 1000U;
+	if (s->frame_rem >= 1000U)
+	{
+		s->frame_rem -= 1000U;
+		n++;
+	}
+	return n;
+}
+
+/**
+ * @brief Switch the alternate setting of a stream, registering or
+ * unregistering its iso endpoints.
+ * @param s Pointer to the stream.
+ * @param alt New alternate setting, 0 for zero bandwidth.
+ * @param in true for the microphone, false for the speaker.
+ */
+static void usbd_audio_start(struct usbd_audio_stream *s, uint8_t alt, bool in)
+{
+	uint16_t packet;
+
+	if (s->alt)
+	{
+		usbd_unregister_ep(s->cfg->ep);
+		if (!in && cfg->fb_ep)
+		{
+			usbd_unregister_ep(cfg->fb_ep);
+		}
+	}
+	s->alt = alt;
+	s->frame_rem = 0;
+	/*Each index is only written by its owner. The microphone ring buffer is
+	emptied here, as the interrupt is its consumer. The speaker consumer runs
+	in the application, it empties the ring buffer and restarts priming on
+	its next usbd_audio_read().*/
+	if (in)
+	{
+		s->fifo.tail = s->fifo.head;
+		s->primed = true;
+	}
+	else
+	{
+		s->flush_req++;
+	}
+
+	if (!alt)
+	{
+		return;
+	}
+
+	s->frame_bytes = s->cfg->channels * s->cfg->subframe_size[alt - 1];
+	packet = USBD_AUDIO_PACKET_SIZE(cfg->sample_rate, s->cfg->channels, s->cfg->subframe_size[alt - 1]);
+	ASSERT(packet <= USBD_AUDIO_MAX_PACKET_SIZE);
+
+	if (in)
+	{
+		usbd_register_ep_dbl_tx(s->cfg->ep, USB_EP_TYPE_ISOCHRONOUS, s->cfg->buf0_addr, s->cfg->buf1_addr, usbd_audio_microphone_in);
+		/*Nothing to send until the first SOF.*/
+		USBD_PMA_SET_TX0_COUNT(s->cfg->ep, 0);
+		USBD_PMA_SET_TX1_COUNT(s->cfg->ep, 0);
+		USBD_EP_SET_STAT_TX(s->cfg->ep, USB_EP_STAT_TX_VALID);
+		return;
+	}
+
+	/*The PMA allocation of an OUT buffer is done in 2 or 32 byte blocks.*/
+	packet = (packet > 62) ? ((packet + 31U) & ~31U) : ((packet + 1U) & ~1U);
+	usbd_register_ep_dbl_rx(s->cfg->ep, USB_EP_TYPE_ISOCHRONOUS, s->cfg->buf0_addr, s->cfg->buf1_addr, packet, usbd_audio_speaker_out);
+	USBD_EP_SET_STAT_RX(s->cfg->ep, USB_EP_STAT_RX_VALID);
+
+	if (cfg->fb_ep)
+	{
+		usbd_register_ep_dbl_tx(cfg->fb_ep, USB_EP_TYPE_ISOCHRONOUS, cfg->fb0_addr, cfg->fb1_addr, usbd_audio_feedback_in);
+		usbd_audio_feedback();
+		/*Write the nominal value to both buffers before enabling the endpoint.*/
+		USBD_EP_SET_STAT_TX(cfg->fb_ep, USB_EP_STAT_TX_VALID);
+	}
+}
+
+/**
+ * @brief Speaker iso OUT endpoint callback function.
+ * @param
+ */
+static void usbd_audio_speaker_out(void)
+{
+	uint8_t ep = spk.cfg->ep;
+	uint16_t cnt, addr;
+
+	/*The application owns the buffer that isn't used by the peripheral, as indicated by DTOG_RX.*/
+	if (GET(*USBD_EP_REG(ep), USB_EP_DTOG_RX))
+	{
+		cnt = USBD_PMA_GET_RX0_COUNT(ep);
+		addr = spk.cfg->buf0_addr;
+	}
+	else
+	{
+		cnt = USBD_PMA_GET_RX1_COUNT(ep);
+		addr = spk.cfg->buf1_addr;
+	}
+	cnt = MIN(cnt, sizeof(pkt_buf));
+
+	/*The ring buffer still holds the previous stream until the consumer empties it.*/
+	if (spk.flush_req != spk.flush_ack)
+	{
+		return;
+	}
+	/*Drop the whole packet if it doesn't fit, so the channels stay aligned.*/
+	if (USBD_AUDIO_FIFO_SIZE - (spk.fifo.head - spk.fifo.tail) < cnt)
+	{
+		stats.speaker_overrun++;
+		return;
+	}
+	usbd_pma_read(addr, pkt_buf, cnt);
+	usbd_audio_fifo_put(&spk.fifo, pkt_buf, cnt);
+}
+
+/**
+ * @brief Microphone iso IN endpoint callback function.
+ * @param
+ */
+static void usbd_audio_microphone_in(void)
+{
+	mic.primed = true;
+}
+
+/**
+ * @brief Feedback iso IN endpoint callback function.
+ * @param
+ */
+static void usbd_audio_feedback_in(void)
+{
+}
+
+/**
+ * @brief Compute the 10.14 feedback value from the fill level of the speaker
+ * ring buffer and write it to the buffer not used by the peripheral.
+ * @param
+ */
+static void usbd_audio_feedback(void)
+{
+	uint8_t fb[3];
+	uint32_t nominal = (spk.sample_rate << 14) / 1000U;
+	int32_t target = (USBD_AUDIO_FIFO_SIZE >> 0x1U) / spk.frame_bytes;
+	int32_t fill = (spk.flush_req == spk.flush_ack) ? (int32_t)((spk.fifo.head - spk.fifo.tail) / spk.frame_bytes) : 0;
+	int32_t adj = (target - fill) * (1 << USBD_AUDIO_FB_GAIN_SHIFT);
+
+	/*Never ask for more than one sample per frame above or below nominal.*/
+	if (adj > (1 << 14))
+	{
+		adj = (1 << 14);
+	}
+	else if (adj < -(1 << 14))
+	{
+		adj = -(1 << 14);
+	}
+	nominal += adj;
+	fb[0] = (uint8_t)(nominal & 0xFFU);
+	fb[1] = (uint8_t)((nominal >> 0x8U) & 0xFFU);
+	fb[2] = (uint8_t)((nominal >> 0x10U) & 0xFFU);
+
+	if (GET(*USBD_EP_REG(cfg->fb_ep), USB_EP_DTOG_TX))
+	{
+		usbd_pma_write(cfg->fb0_addr, fb, sizeof(fb));
+		USBD_PMA_SET_TX0_COUNT(cfg->fb_ep, sizeof(fb));
+	}
+	else
+	{
+		usbd_pma_write(cfg->fb1_addr, fb, sizeof(fb));
+		USBD_PMA_SET_TX1_COUNT(cfg->fb_ep, sizeof(fb));
+	}
+	/*A stream that has just started has no packet in flight, fill both buffers.*/
+	if (GET(*USBD_EP_REG(cfg->fb_ep), USB_EP_STAT_TX) == USB_EP_STAT_TX_DISABLED)
+	{
+		usbd_pma_write(cfg->fb0_addr, fb, sizeof(fb));
+		USBD_PMA_SET_TX0_COUNT(cfg->fb_ep, sizeof(fb));
+		usbd_pma_write(cfg->fb1_addr, fb, sizeof(fb));
+		USBD_PMA_SET_TX1_COUNT(cfg->fb_ep, sizeof(fb));
+	}
+}
+
+/**
+ * @brief Prepare the microphone packet of the next frame, in the buffer not
+ * used by the peripheral. Missing samples are replaced by silence.
+ * @param
+ */
+static void usbd_audio_microphone_packet(void)
+{
+	uint8_t ep = mic.cfg->ep;
+	uint16_t len = usbd_audio_next_frame_samples(&mic) * mic.frame_bytes;
+	uint16_t cnt = usbd_audio_fifo_get(&mic.fifo, pkt_buf, len);
+
+	if (cnt < len)
+	{
+		stats.microphone_underrun++;
+		memset(&pkt_buf[cnt], 0, len - cnt);
+	}
+
+	if (GET(*USBD_EP_REG(ep), USB_EP_DTOG_TX))
+	{
+		usbd_pma_write(mic.cfg->buf0_addr, pkt_buf, len);
+		USBD_PMA_SET_TX0_COUNT(ep, len);
+	}
+	else
+	{
+		usbd_pma_write(mic.cfg->buf1_addr, pkt_buf, len);
+		USBD_PMA_SET_TX1_COUNT(ep, len);
+	}
+	mic.primed = false;
+}
+
+/**
+ * @brief SET_CUR data stage completion callback function.
+ * @param
+ */
+static void usbd_audio_set_cur_cplt(void)
+{
+	if (ctrl_ep)
+	{
+		uint32_t rate = ctrl_buf[0] | (ctrl_buf[1] << 8) | ((uint32_t)ctrl_buf[2] << 16);
+		/*The PMA buffers are sized for the default rate.*/
+		if (!rate || rate > cfg->sample_rate)
+		{
+			return;
+		}
+		ctrl_stream->sample_rate = rate;
+		ctrl_stream->frame_rem = 0;
+		if (cfg->stream_changed != NULL)
+		{
+			cfg->stream_changed(ctrl_stream->cfg->interface_num, ctrl_stream->alt, rate);
+		}
+		return;
+	}
+
+	if (ctrl_cs == USBD_AUDIO_FU_MUTE_CONTROL)
+	{
+		ctrl_stream->mute = ctrl_buf[0] ? true : false;
+	}
+	else
+	{
+		ctrl_stream->volume = (int16_t)(ctrl_buf[0] | (ctrl_buf[1] << 8));
+	}
+	if (cfg->feature_changed != NULL)
+	{
+		cfg->feature_changed(ctrl_stream->cfg->feature_unit_id, ctrl_stream->mute, ctrl_stream->volume);
+	}
+}
+
+/**
+ * @brief Feature unit (mute and volume) requests.
+ * @param s Pointer to the stream of the feature unit.
+ * @param setup USB setup packet.
+ */
+static void usbd_audio_feature_request(struct usbd_audio_stream *s, struct usbd_setup_packet_type setup)
+{
+	uint8_t cs = ((setup.wValue >> 0x8U) & 0xFFU);
+	int16_t val;
+
+	if (cs == USBD_AUDIO_FU_MUTE_CONTROL && setup.bRequest == USBD_AUDIO_GET_CUR)
+	{
+		ctrl_buf[0] = s->mute ? 1 : 0;
+		usbd_prepare_data_in_stage(ctrl_buf, MIN(setup.wLength, USBD_AUDIO_MUTE_LENGTH));
+		return;
+	}
+	if (cs == USBD_AUDIO_FU_VOLUME_CONTROL && (setup.bRequest & USBD_DIRECTION_IN))
+	{
+		switch (setup.bRequest)
+		{
+			case USBD_AUDIO_GET_CUR:
+			{
+				val = s->volume;
+				break;
+			}
+			case USBD_AUDIO_GET_MIN:
+			{
+				val = USBD_AUDIO_VOLUME_MIN;
+				break;
+			}
+			case USBD_AUDIO_GET_MAX:
+			{
+				val = USBD_AUDIO_VOLUME_MAX;
+				break;
+			}
+			case USBD_AUDIO_GET_RES:
+			{
+				val = USBD_AUDIO_VOLUME_RES;
+				break;
+			}
+			default:
+			{
+				USBD_EP0_SET_STALL();
+				return;
+			}
+		}
+		ctrl_buf[0] = (uint8_t)((uint16_t)val & 0xFFU);
+		ctrl_buf[1] = (uint8_t)(((uint16_t)val >> 0x8U) & 0xFFU);
+		usbd_prepare_data_in_stage(ctrl_buf, MIN(setup.wLength, USBD_AUDIO_VOLUME_LENGTH));
+		return;
+	}
+	if (setup.bRequest == USBD_AUDIO_SET_CUR && setup.wLength
+		&& ((cs == USBD_AUDIO_FU_MUTE_CONTROL && setup.wLength == USBD_AUDIO_MUTE_LENGTH)
+		|| (cs == USBD_AUDIO_FU_VOLUME_CONTROL && setup.wLength == USBD_AUDIO_VOLUME_LENGTH)))
+	{
+		ctrl_stream = s;
+		ctrl_cs = cs;
+		ctrl_ep = false;
+		usbd_prepare_data_out_stage(ctrl_buf, setup.wLength, usbd_audio_set_cur_cplt);
+		return;
+	}
+	USBD_EP0_SET_STALL();
+}
+
+/**
+ * @brief Endpoint (sampling frequency) requests.
+ * @param s Pointer to the stream of the endpoint.
+ * @param setup USB setup packet.
+ */
+static void usbd_audio_ep_request(struct usbd_audio_stream *s, struct usbd_setup_packet_type setup)
+{
+	uint8_t cs = ((setup.wValue >> 0x8U) & 0xFFU);
+
+	if (cs != USBD_AUDIO_EP_SAMPLING_FREQ_CONTROL)
+	{
+		USBD_EP0_SET_STALL();
+		return;
+	}
+	if (setup.bRequest == USBD_AUDIO_GET_CUR)
+	{
+		ctrl_buf[0] = (uint8_t)(s->sample_rate & 0xFFU);
+		ctrl_buf[1] = (uint8_t)((s->sample_rate >> 0x8U) & 0xFFU);
+		ctrl_buf[2] = (uint8_t)((s->sample_rate >> 0x10U) & 0xFFU);
+		usbd_prepare_data_in_stage(ctrl_buf, MIN(setup.wLength, USBD_AUDIO_SAMPLING_FREQ_LENGTH));
+		return;
+	}
+	if (setup.bRequest == USBD_AUDIO_SET_CUR && setup.wLength == USBD_AUDIO_SAMPLING_FREQ_LENGTH)
+	{
+		ctrl_stream = s;
+		ctrl_cs = cs;
+		ctrl_ep = true;
+		usbd_prepare_data_out_stage(ctrl_buf, setup.wLength, usbd_audio_set_cur_cplt);
+		return;
+	}
+	USBD_EP0_SET_STALL();
+}
+
+/**
+ * @brief Initializes the Audio class.
+ * @param config Pointer to usbd_audio_config struct that describes the Audio function.
+ */
+void usbd_audio_init(const struct usbd_audio_config *config)
+{
+	ASSERT(config != NULL);
+	ASSERT(config->sample_rate);
+	ASSERT(!config->speaker.ep || (config->speaker.subframe_size != NULL && config->speaker.alt_count));
+	ASSERT(!config->microphone.ep || (config->microphone.subframe_size != NULL && config->microphone.alt_count));
+	/*Double buffer endpoints are unidirectional, feedback needs its own endpoint number.*/
+	ASSERT(!config->fb_ep || config->fb_ep != config->speaker.ep);
+	cfg = config;
+	memset(&spk, 0, sizeof(spk));
+	memset(&mic, 0, sizeof(mic));
+	memset(&stats, 0, sizeof(stats));
+	spk.cfg = &config->speaker;
+	mic.cfg = &config->microphone;
+	spk.volume = USBD_AUDIO_VOLUME_MAX;
+	mic.volume = USBD_AUDIO_VOLUME_MAX;
+}
+
+/**
+ * @brief Puts both streams to the zero bandwidth alternate setting.
+ * @note Should be called from the set_configuration callback.
+ * @param
+ */
+void usbd_audio_configure(void)
+{
+	ASSERT(cfg != NULL);
+	/*The endpoints have already been cleared by the bus reset or the previous configuration.*/
+	spk.alt = 0;
+	mic.alt = 0;
+	spk.sample_rate = cfg->sample_rate;
+	mic.sample_rate = cfg->sample_rate;
+	usbd_audio_start(&spk, 0, false);
+	usbd_audio_start(&mic, 0, true);
+}
+
+/**
+ * @brief Switch the alternate setting of an AudioStreaming interface.
+ * @note Should be called from the set_interface callback.
+ * @param num Interface number.
+ * @param alt Alternate setting.
+ * @return false if the interface isn't an AudioStreaming interface of the function.
+ */
+bool usbd_audio_set_interface(uint8_t num, uint8_t alt)
+{
+	struct usbd_audio_stream *s;
+
+	ASSERT(cfg != NULL);
+	if (spk.cfg->ep && num == spk.cfg->interface_num)
+	{
+		s = &spk;
+	}
+	else if (mic.cfg->ep && num == mic.cfg->interface_num)
+	{
+		s = &mic;
+	}
+	else
+	{
+		return false;
+	}
+
+	if (alt > s->cfg->alt_count)
+	{
+		return true;
+	}
+	usbd_audio_start(s, alt, s == &mic);
+	if (cfg->stream_changed != NULL)
+	{
+		cfg->stream_changed(num, alt, s->sample_rate);
+	}
+	return true;
+}
+
+/**
+ * @brief Checks an alternate setting of the Audio interfaces.
+ * @note Can be used as the is_alternate_valid callback.
+ * @param num Interface number.
+ * @param alt Alternate setting.
+ * @return true if the interface belongs to the function and supports the alternate setting.
+ */
+bool usbd_audio_is_alternate_valid(uint8_t num, uint8_t alt)
+{
+	ASSERT(cfg != NULL);
+	if (spk.cfg->ep && num == spk.cfg->interface_num)
+	{
+		return alt <= spk.cfg->alt_count;
+	}
+	if (mic.cfg->ep && num == mic.cfg->interface_num)
+	{
+		return alt <= mic.cfg->alt_count;
+	}
+	return num == cfg->ac_interface_num && !alt;
+}
+
+/**
+ * @brief Returns the alternate setting of an AudioStreaming interface.
+ * @note Should be called from the get_interface callback.
+ * @param num Interface number.
+ * @param alt Pointer that receives the alternate setting.
+ * @return false if the interface isn't an AudioStreaming interface of the function.
+ */
+bool usbd_audio_get_interface(uint8_t num, uint8_t *alt)
+{
+	ASSERT(cfg != NULL);
+	ASSERT(alt != NULL);
+	if (spk.cfg->ep && num == spk.cfg->interface_num)
+	{
+		*alt = spk.alt;
+		return true;
+	}
+	if (mic.cfg->ep && num == mic.cfg->interface_num)
+	{
+		*alt = mic.alt;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Audio class specific request handler.
+ * @note Should be called from the class_request callback.
+ * @param setup USB setup packet.
+ * @return false if the request isn't addressed to the Audio function, true otherwise.
+ */
+bool usbd_audio_class_request(struct usbd_setup_packet_type setup)
+{
+	ASSERT(cfg != NULL);
+	switch (setup.bmRequestType & USBD_RECIPIENT)
+	{
+		case USBD_RECIPIENT_INTERFACE:
+		{
+			uint8_t unit = ((setup.wIndex >> 0x8U) & 0xFFU);
+			if ((setup.wIndex & 0xFFU) != cfg->ac_interface_num)
+			{
+				return false;
+			}
+			if (unit && unit == spk.cfg->feature_unit_id)
+			{
+				usbd_audio_feature_request(&spk, setup);
+			}
+			else if (unit && unit == mic.cfg->feature_unit_id)
+			{
+				usbd_audio_feature_request(&mic, setup);
+			}
+			else
+			{
+				USBD_EP0_SET_STALL();
+			}
+			return true;
+		}
+		case USBD_RECIPIENT_ENDPOINT:
+		{
+			uint8_t ep = (setup.wIndex & USBD_EP_ADDRESS_EP_NUMBER);
+			uint8_t dir = (setup.wIndex & USBD_EP_ADDRESS_EP_DIRECTION) ? 1 : 0;
+			if (spk.cfg->ep && ep == spk.cfg->ep && !dir)
+			{
+				usbd_audio_ep_request(&spk, setup);
+				return true;
+			}
+			if (mic.cfg->ep && ep == mic.cfg->ep && dir)
+			{
+				usbd_audio_ep_request(&mic, setup);
+				return true;
+			}
+			return false;
+		}
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+/**
+ * @brief Frame handler of the streams. Updates the feedback value and
+ * prepares the microphone packet of the next frame.
+ * @note Should be called from the sof callback.
+ * @param
+ */
+void usbd_audio_sof(void)
+{
+	if (cfg == NULL)
+	{
+		return;
+	}
+	/*The endpoints get disabled by a bus reset, until the device is configured again.*/
+	if (spk.alt && cfg->fb_ep && GET(*USBD_EP_REG(cfg->fb_ep), USB_EP_STAT_TX) != USB_EP_STAT_TX_DISABLED)
+	{
+		usbd_audio_feedback();
+	}
+	/*Only replace the packet once the host has collected the previous one.*/
+	if (mic.alt && mic.primed && GET(*USBD_EP_REG(mic.cfg->ep), USB_EP_STAT_TX) != USB_EP_STAT_TX_DISABLED)
+	{
+		usbd_audio_microphone_packet();
+	}
+}
+
+/**
+ * @brief Read speaker samples. Until the ring buffer has been filled
+ * to half its size (and after an underrun or a restart of the stream) silence
+ * is returned, so the stream restarts with enough margin instead of glitching
+ * on every packet. The samples left from a previous stream are dropped here.
+ * @note Should be called by the consumer (e.g. the I2S DMA interrupt).
+ * @param buf Pointer to the buffer that receives the samples.
+ * @param len Size of the buffer.
+ * @return The amount of samples read in bytes, the rest of buf is silence.
+ */
+uint32_t usbd_audio_read(uint8_t *buf, uint32_t len)
+{
+	uint32_t cnt = 0;
+	uint8_t flush = spk.flush_req;
+
+	ASSERT(buf != NULL);
+	/*The stream restarted, drop what is left of the previous one.*/
+	if (flush != spk.flush_ack)
+	{
+		spk.primed = false;
+		spk.fifo.tail = spk.fifo.head;
+		__DMB();
+		spk.flush_ack = flush;
+	}
+	if (spk.alt && !spk.primed && (spk.fifo.head - spk.fifo.tail) >= (USBD_AUDIO_FIFO_SIZE >> 0x1U))
+	{
+		spk.primed = true;
+	}
+	if (spk.primed)
+	{
+		cnt = usbd_audio_fifo_get(&spk.fifo, buf, len);
+		if (cnt < len)
+		{
+			stats.speaker_underrun++;
+			spk.primed = false;
+		}
+	}
+	memset(buf + cnt, 0, len - cnt);
+	return cnt;
+}
+
+/**
+ * @brief Write microphone samples.
+ * @note Should be called by the producer (e.g. the I2S DMA interrupt).
+ * @param buf Pointer to the samples.
+ * @param len Size of the samples in bytes.
+ * @return The amount of samples written in bytes.
+ */
+uint32_t usbd_audio_write(const uint8_t *buf, uint32_t len)
+{
+	uint32_t cnt;
+
+	ASSERT(buf != NULL);
+	if (!mic.alt)
+	{
+		return 0;
+	}
+	cnt = usbd_audio_fifo_put(&mic.fifo, buf, len);
+	if (cnt < len)
+	{
+		stats.microphone_overrun++;
+	}
+	return cnt;
+}
+
+/**
+ * @brief Get the stream error counters.
+ * @param stats_out Pointer to usbd_audio_stats struct that receives the counters.
+ */
+void usbd_audio_get_stats(struct usbd_audio_stats *stats_out)
+{
+	uint32_t primask;
+
+	ASSERT(stats_out != NULL);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	*stats_out = stats;
+	__set_PRIMASK(primask);
+}
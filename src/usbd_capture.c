@@ -0,0 +1,276 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_capture.h"
+
+#if USBD_CAPTURE
+
+#define USBD_CAPTURE_MASK (USBD_CAPTURE_SIZE - 1U)
+#define USBD_CAPTURE_SNAPLEN 65535U
+#define USBD_CAPTURE_RECORD_HEADER_SIZE 16U /*!< pcap record header, incl_len counts the bytes after it.*/
+#define USBD_CAPTURE_EPIPE (-32) /*!< usbmon status of a STALL handshake.*/
+#define USBD_CAPTURE_EAGAIN (-11) /*!< usbmon status of a NAK handshake.*/
+#define USBD_CAPTURE_EINPROGRESS (-115) /*!< usbmon status of a SETUP event.*/
+
+_Static_assert(sizeof(struct usbd_capture_record_type) == USBD_CAPTURE_RECORD_HEADER_SIZE + 64U, "usbmon header has to be 64 bytes.");
+
+/************************************************
+ * Static variables used by the capture.
+ ***********************************************/
+static uint8_t ring[USBD_CAPTURE_SIZE]; /*!< Ring buffer of the records.*/
+static volatile uint32_t head; /*!< Write index, only written by the usbd_core interrupt.*/
+static volatile uint32_t tail; /*!< Read index, only written by usbd_capture_read().*/
+static struct usbd_capture_record_type rec; /*!< Record of the transaction in progress, published by usbd_capture_end().*/
+static uint8_t payload[USBD_CAPTURE_PAYLOAD]; /*!< Payload of the transaction in progress.*/
+static bool pending; /*!< usbd_capture_begin() prepared a record.*/
+static uint64_t id; /*!< usbmon URB id, incremented for each record.*/
+static uint32_t last_cycles; /*!< DWT cycle counter at the last timestamp update.*/
+static uint32_t ts_cycles; /*!< Cycles elapsed in the current second.*/
+static uint32_t ts_sec; /*!< Seconds elapsed since the first record.*/
+static struct usbd_capture_stats stats; /*!< Capture counters.*/
+
+/************************************************
+ * usbmon transfer type, indexed by the EP_TYPE
+ * field of the endpoint register.
+ ***********************************************/
+static const uint8_t xfer_type[4] = { 3U, 2U, 0U, 1U };
+
+/************************************************
+ * Function prototypes.
+ ***********************************************/
+static void usbd_capture_pma_read(uint16_t addr, uint16_t cnt);
+static void usbd_capture_ring_write(uint32_t pos, const uint8_t *buf, uint32_t cnt);
+
+/**
+ * @brief Copies the payload of the transaction from the Packet Memory Area,
+ * usbd_pma_read() isn't used so the core counters stay untouched.
+ * @param addr Address offset of the buffer inside the Packet Memory Area.
+ * @param cnt Number of bytes to copy.
+ */
+static void usbd_capture_pma_read(uint16_t addr, uint16_t cnt)
+{
+	__IO uint16_t *src = (__IO uint16_t*)(PMA_BASE + addr);
+	uint16_t tmp_val;
+
+	for (uint16_t i = 0; i < cnt; i += 2U)
+	{
+		tmp_val = *src++;
+		payload[i] = (uint8_t)(tmp_val & 0xFFU);
+		if (i + 1U < cnt)
+		{
+			payload[i + 1U] = (uint8_t)(tmp_val >> 0x8U);
+		}
+	}
+}
+
+/**
+ * @brief Writes to the ring buffer without publishing, the caller checks the
+ * free space.
+ * @param pos Write index.
+ * @param buf Pointer to the data.
+ * @param cnt Number of bytes.
+ */
+static void usbd_capture_ring_write(uint32_t pos, const uint8_t *buf, uint32_t cnt)
+{
+	uint32_t first;
+
+	pos &= USBD_CAPTURE_MASK;
+	first = MIN(cnt, USBD_CAPTURE_SIZE - pos);
+	memcpy(&ring[pos], buf, first);
+	memcpy(ring, buf + first, cnt - first);
+}
+
+/**
+ * @brief Updates the timestamp from the DWT cycle counter. It is called on
+ * every SOF so the cycle counter can't wrap between two updates.
+ * @param
+ */
+void usbd_capture_tick(void)
+{
+	uint32_t now = DWT->CYCCNT;
+
+	ts_cycles += now - last_cycles;
+	last_cycles = now;
+	while (ts_cycles >= SystemCoreClock)
+	{
+		ts_cycles -= SystemCoreClock;
+		ts_sec++;
+	}
+}
+
+/**
+ * @brief Prepares the record of a completed transaction, before its
+ * endpoint callback runs and reuses the buffer. A SETUP packet gives an 'S'
+ * event, other transactions give a 'C' event with the payload.
+ * @param ep Endpoint number.
+ * @param dir 1 for IN, 0 for OUT.
+ */
+void usbd_capture_begin(uint8_t ep, uint8_t dir)
+{
+	uint16_t ep_val = *USBD_EP_REG(ep);
+	uint16_t type = GET(ep_val, USB_EP_TYPE);
+	bool dbl = type == USB_EP_TYPE_ISOCHRONOUS || (type == USB_EP_TYPE_BULK && GET(ep_val, USB_EP_KIND));
+	uint16_t addr, cnt;
+
+	usbd_capture_tick();
+	memset(&rec, 0, sizeof(rec));
+	rec.ts_sec = ts_sec;
+	rec.ts_usec = ts_cycles / (SystemCoreClock / 1000000U);
+	rec.id = id++;
+	rec.xfer_type = xfer_type[type >> 0x9U];
+	rec.epnum = ep | (dir ? 0x80U : 0x0U);
+	rec.devnum = GET(USB->DADDR, USB_DADDR_ADD);
+	rec.busnum = 1U;
+	rec.mon_ts_sec = rec.ts_sec;
+	rec.mon_ts_usec = rec.ts_usec;
+	if (type == USB_EP_TYPE_ISOCHRONOUS)
+	{
+		rec.start_frame = GET(USB->FNR, USB_FNR_FN);
+	}
+
+	if (!dir && GET(ep_val, USB_EP_SETUP))
+	{
+		usbd_capture_pma_read(USBD_PMA_GET_RX1_ADDR(ep), USBD_SETUP_PACKET_SIZE);
+		memcpy(rec.setup, payload, USBD_SETUP_PACKET_SIZE);
+		rec.type = 'S';
+		rec.epnum = ep | (payload[0] & 0x80U);
+		rec.flag_data = '<';
+		rec.length = (uint32_t)payload[6] | ((uint32_t)payload[7] << 0x8U);
+		rec.status = USBD_CAPTURE_EINPROGRESS;
+		pending = true;
+		return;
+	}
+
+	if (dir)
+	{
+		/*The hardware toggled DTOG_TX, TX0 was sent when it is set.*/
+		bool tx0 = dbl && GET(ep_val, USB_EP_DTOG_TX);
+		addr = tx0 || !dbl ? USBD_PMA_GET_TX0_ADDR(ep) : USBD_PMA_GET_TX1_ADDR(ep);
+		cnt = tx0 || !dbl ? USBD_PMA_GET_TX0_COUNT(ep) : USBD_PMA_GET_TX1_COUNT(ep);
+	}
+	else
+	{
+		bool rx0 = dbl && GET(ep_val, USB_EP_DTOG_RX);
+		addr = rx0 ? USBD_PMA_GET_RX0_ADDR(ep) : USBD_PMA_GET_RX1_ADDR(ep);
+		cnt = rx0 ? USBD_PMA_GET_RX0_COUNT(ep) : USBD_PMA_GET_RX1_COUNT(ep);
+	}
+	rec.type = 'C';
+	rec.flag_setup = '-';
+	rec.length = cnt;
+	rec.len_cap = MIN(cnt, USBD_CAPTURE_PAYLOAD);
+	usbd_capture_pma_read(addr, (uint16_t)rec.len_cap);
+	pending = true;
+}
+
+/**
+ * @brief Completes the record with the handshake the endpoint callback left
+ * the endpoint with, and publishes it. The record is dropped if the ring
+ * buffer is full.
+ * @param ep Endpoint number.
+ * @param dir 1 for IN, 0 for OUT.
+ */
+void usbd_capture_end(uint8_t ep, uint8_t dir)
+{
+	uint16_t ep_val = *USBD_EP_REG(ep);
+	uint16_t stat = dir ? GET(ep_val, USB_EP_STAT_TX) >> 0x4U : GET(ep_val, USB_EP_STAT_RX) >> 0xCU;
+	uint32_t size;
+
+	if (!pending)
+	{
+		return;
+	}
+	pending = false;
+	if (rec.type == 'C')
+	{
+		/*STAT values are the same for both directions: 1 STALL, 2 NAK, 3 VALID.*/
+		rec.status = stat == 0x1U ? USBD_CAPTURE_EPIPE : stat == 0x2U ? USBD_CAPTURE_EAGAIN : 0;
+	}
+	rec.incl_len = sizeof(rec) - USBD_CAPTURE_RECORD_HEADER_SIZE + rec.len_cap;
+	rec.orig_len = sizeof(rec) - USBD_CAPTURE_RECORD_HEADER_SIZE + rec.length;
+	size = sizeof(rec) + rec.len_cap;
+	if (USBD_CAPTURE_SIZE - (head - tail) < size)
+	{
+		stats.dropped++;
+		return;
+	}
+	usbd_capture_ring_write(head, (const uint8_t*)&rec, sizeof(rec));
+	usbd_capture_ring_write(head + sizeof(rec), payload, rec.len_cap);
+	/*The record is complete before usbd_capture_read() can see it.*/
+	__DMB();
+	head += size;
+	stats.records++;
+}
+
+/**
+ * @brief Writes the pcap global header, it starts the capture file.
+ * @param buf Pointer to a buffer of USBD_CAPTURE_PCAP_HEADER_SIZE bytes.
+ */
+void usbd_capture_pcap_header(uint8_t *buf)
+{
+	static const uint32_t header[6] =
+	{
+		0xA1B2C3D4U, /*Magic number, microsecond timestamps.*/
+		0x00040002U, /*Version 2.4.*/
+		0x0U, /*Timezone.*/
+		0x0U, /*Timestamp accuracy.*/
+		USBD_CAPTURE_SNAPLEN,
+		USBD_CAPTURE_LINKTYPE_USB_LINUX_MMAPPED
+	};
+
+	ASSERT(buf != NULL);
+	memcpy(buf, header, sizeof(header));
+}
+
+/**
+ * @brief Drains whole records from the ring buffer, for example to send them
+ * over a vendor endpoint or a debug probe.
+ * @note Must not be called from the USB interrupt.
+ * @param buf Pointer to the destination buffer.
+ * @param len Size of the destination buffer.
+ * @return Number of bytes copied, zero if the next record doesn't fit.
+ */
+uint32_t usbd_capture_read(uint8_t *buf, uint32_t len)
+{
+	uint32_t copied = 0;
+	uint32_t size, pos, first;
+	uint8_t incl_len[4];
+
+	ASSERT(buf != NULL);
+	while (head != tail)
+	{
+		/*incl_len is the third word of the record.*/
+		for (uint8_t i = 0; i < sizeof(incl_len); i++)
+		{
+			incl_len[i] = ring[(tail + 8U + i) & USBD_CAPTURE_MASK];
+		}
+		size = USBD_CAPTURE_RECORD_HEADER_SIZE +
+			((uint32_t)incl_len[0] | ((uint32_t)incl_len[1] << 8U) | ((uint32_t)incl_len[2] << 16U) | ((uint32_t)incl_len[3] << 24U));
+		if (len - copied < size)
+		{
+			break;
+		}
+		pos = tail & USBD_CAPTURE_MASK;
+		first = MIN(size, USBD_CAPTURE_SIZE - pos);
+		memcpy(&buf[copied], &ring[pos], first);
+		memcpy(&buf[copied + first], ring, size - first);
+		copied += size;
+		__DMB();
+		tail += size;
+	}
+	return copied;
+}
+
+/**
+ * @brief Get the capture counters.
+ * @param stats_out Pointer to the struct that receives the counters.
+ */
+void usbd_capture_get_stats(struct usbd_capture_stats *stats_out)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	ASSERT(stats_out != NULL);
+	__disable_irq();
+	*stats_out = stats;
+	__set_PRIMASK(primask);
+}
+
+#endif /*USBD_CAPTURE*/
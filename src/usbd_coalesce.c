@@ -0,0 +1,235 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_coalesce.h"
+
+/************************************************
+ * Static variables used by the coalescing.
+ ***********************************************/
+static uint8_t pkt[USBD_FS_MAX_PACKET_SIZE]; /*!< Packet buffer, only used with interrupts disabled.*/
+
+/************************************************
+ * Function prototypes.
+ ***********************************************/
+static bool usbd_coalesce_enabled(const struct usbd_coalesce *co);
+static void usbd_coalesce_tx(struct usbd_coalesce *co);
+
+/**
+ * @brief Checks that the endpoint is registered, it isn't after a bus reset
+ * until the set_configuration callback runs.
+ * @param co Pointer to the usbd_coalesce struct of the endpoint.
+ * @return true if packets can be armed.
+ */
+static bool usbd_coalesce_enabled(const struct usbd_coalesce *co)
+{
+	return GET(*USBD_EP_REG(co->cfg->ep), USB_EP_STAT_TX) != USB_EP_STAT_TX_DISABLED;
+}
+
+/**
+ * @brief Arms the next packet: a full one, or the data left if a flush is
+ * pending. A pending flush ends with a short or zero length packet.
+ * @note Called from the interrupt handler, or with interrupts disabled.
+ * @param co Pointer to the usbd_coalesce struct of the endpoint.
+ */
+static void usbd_coalesce_tx(struct usbd_coalesce *co)
+{
+	const struct usbd_coalesce_config *cfg = co->cfg;
+	uint32_t tail = co->tail;
+	uint32_t pos = tail & (cfg->size - 1U);
+	uint32_t cnt = MIN(co->head - tail, (uint32_t)cfg->max_packet_size);
+	uint32_t first;
+
+	if (co->busy)
+	{
+		return;
+	}
+	if (cnt < cfg->max_packet_size)
+	{
+		if (!co->flush)
+		{
+			return;
+		}
+		co->flush = false;
+		if (!cnt && !co->open)
+		{
+			return;
+		}
+	}
+
+	first = MIN(cnt, cfg->size - pos);
+	memcpy(pkt, &cfg->buf[pos], first);
+	memcpy(&pkt[first], cfg->buf, cnt - first);
+	__DMB();
+	co->tail = tail + cnt;
+
+	co->open = cnt == cfg->max_packet_size;
+	co->age = 0;
+	co->tx_len = (uint16_t)cnt;
+	co->busy = true;
+	usbd_pma_write(cfg->tx_addr, pkt, (uint16_t)cnt);
+	USBD_PMA_SET_TX_COUNT(cfg->ep, cnt);
+	USBD_EP_SET_STAT_TX(cfg->ep, USB_EP_STAT_TX_VALID);
+}
+
+/**
+ * @brief Initializes a coalesced endpoint.
+ * @param co Pointer to the usbd_coalesce struct of the endpoint.
+ * @param config Pointer to usbd_coalesce_config struct that describes the endpoint.
+ */
+void usbd_coalesce_init(struct usbd_coalesce *co, const struct usbd_coalesce_config *config)
+{
+	ASSERT(co != NULL);
+	ASSERT(config != NULL);
+	ASSERT(config->buf != NULL);
+	ASSERT(config->type == USB_EP_TYPE_BULK || config->type == USB_EP_TYPE_INTERRUPT);
+	ASSERT(config->max_packet_size && config->max_packet_size <= USBD_FS_MAX_PACKET_SIZE);
+	ASSERT(!(config->size & (config->size - 1U)) && config->size >= config->max_packet_size);
+	memset(co, 0, sizeof(*co));
+	co->cfg = config;
+}
+
+/**
+ * @brief Registers the IN endpoint and empties the ring buffer.
+ * @note Should be called from the set_configuration callback.
+ * @param co Pointer to the usbd_coalesce struct of the endpoint.
+ * @param ep_in IN callback of the endpoint, it has to call usbd_coalesce_ep_in().
+ */
+void usbd_coalesce_configure(struct usbd_coalesce *co, void (*ep_in)(void))
+{
+	ASSERT(co != NULL && co->cfg != NULL);
+	ASSERT(ep_in != NULL);
+	co->head = 0;
+	co->tail = 0;
+	co->busy = false;
+	co->flush = false;
+	co->open = false;
+	co->age = 0;
+	usbd_register_ep_tx(co->cfg->ep, co->cfg->type, co->cfg->tx_addr, ep_in);
+}
+
+/**
+ * @brief Completes the packet sent and arms the next one.
+ * @note Should be called from the IN callback of the endpoint.
+ * @param co Pointer to the usbd_coalesce struct of the endpoint.
+ */
+void usbd_coalesce_ep_in(struct usbd_coalesce *co)
+{
+	co->busy = false;
+	co->stats.bytes += co->tx_len;
+	co->stats.packets++;
+	if (co->tx_len == co->cfg->max_packet_size)
+	{
+		co->stats.full++;
+	}
+	else if (!co->tx_len)
+	{
+		co->stats.zlp++;
+	}
+	usbd_coalesce_tx(co);
+}
+
+/**
+ * @brief Ages the data left and flushes it once flush_sof start of frames
+ * have passed. An open transfer is aged too, so it gets its zero length
+ * packet.
+ * @note Should be called from the sof callback.
+ * @param co Pointer to the usbd_coalesce struct of the endpoint.
+ */
+void usbd_coalesce_sof(struct usbd_coalesce *co)
+{
+	if (co->cfg == NULL || !co->cfg->flush_sof || !usbd_coalesce_enabled(co))
+	{
+		return;
+	}
+	if (co->head == co->tail && !co->open)
+	{
+		co->age = 0;
+		return;
+	}
+	if (co->age < co->cfg->flush_sof)
+	{
+		co->age++;
+	}
+	if (co->age >= co->cfg->flush_sof && !co->flush)
+	{
+		co->flush = true;
+		co->stats.deadlines++;
+		usbd_coalesce_tx(co);
+	}
+}
+
+/**
+ * @brief Queues data for the host. Once a full packet is queued it is sent
+ * without waiting for the deadline.
+ * @note Single producer, it must not be called from several contexts.
+ * @param co Pointer to the usbd_coalesce struct of the endpoint.
+ * @param data Pointer to the data.
+ * @param len Number of bytes.
+ * @return Number of bytes queued, less than len if the ring buffer is full.
+ */
+uint32_t usbd_coalesce_write(struct usbd_coalesce *co, const uint8_t *data, uint32_t len)
+{
+	const struct usbd_coalesce_config *cfg;
+	uint32_t head, pos, cnt, first;
+	uint32_t primask;
+
+	ASSERT(co != NULL && co->cfg != NULL);
+	ASSERT(data != NULL);
+	cfg = co->cfg;
+	head = co->head;
+	pos = head & (cfg->size - 1U);
+	cnt = MIN(len, cfg->size - (head - co->tail));
+	first = MIN(cnt, cfg->size - pos);
+	memcpy(&cfg->buf[pos], data, first);
+	memcpy(cfg->buf, data + first, cnt - first);
+	__DMB();
+	co->head = head + cnt;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	co->stats.dropped += len - cnt;
+	if ((co->head - co->tail) >= cfg->max_packet_size && !co->busy && usbd_coalesce_enabled(co))
+	{
+		usbd_coalesce_tx(co);
+	}
+	__set_PRIMASK(primask);
+	return cnt;
+}
+
+/**
+ * @brief Sends the data queued so far without waiting for the deadline,
+ * for latency critical data. The transfer ends with a short or zero length
+ * packet.
+ * @param co Pointer to the usbd_coalesce struct of the endpoint.
+ */
+void usbd_coalesce_flush(struct usbd_coalesce *co)
+{
+	uint32_t primask;
+
+	ASSERT(co != NULL && co->cfg != NULL);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if ((co->head != co->tail || co->open) && usbd_coalesce_enabled(co))
+	{
+		co->flush = true;
+		co->stats.flushes++;
+		usbd_coalesce_tx(co);
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Returns a copy of the counters.
+ * @param co Pointer to the usbd_coalesce struct of the endpoint.
+ * @param stats_out Pointer to usbd_coalesce_stats struct that receives the counters.
+ */
+void usbd_coalesce_get_stats(struct usbd_coalesce *co, struct usbd_coalesce_stats *stats_out)
+{
+	uint32_t primask;
+
+	ASSERT(co != NULL);
+	ASSERT(stats_out != NULL);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	*stats_out = co->stats;
+	__set_PRIMASK(primask);
+}
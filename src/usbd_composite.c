@@ -0,0 +1,434 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_composite.h"
+
+#define USBD_COMPOSITE_NONE 0xFFU /*!< Lookup table entry of an unclaimed interface or endpoint.*/
+
+/************************************************
+ * Static variables used by the composite device.
+ ***********************************************/
+static const struct usbd_composite_config *cfg; /*!< Pointer to the configuration provided by the user during initialization.*/
+static uint8_t interface_map[USBD_COMPOSITE_MAX_INTERFACES]; /*!< Function index of every interface.*/
+static uint8_t ep_map[8][2]; /*!< Function index of every endpoint, indexed by number and direction.*/
+static uint8_t alt_setting[USBD_COMPOSITE_MAX_INTERFACES]; /*!< Current alternate setting of every interface.*/
+static uint8_t interface_count; /*!< bNumInterfaces.*/
+static uint8_t configuration; /*!< Current configuration value.*/
+static struct usbd_function *sof_list[USBD_COMPOSITE_MAX_FUNCTIONS]; /*!< Functions with a sof callback.*/
+static uint8_t sof_count; /*!< Number of functions in sof_list.*/
+static uint8_t desc[USBD_COMPOSITE_DESC_SIZE]; /*!< Generated configuration descriptor.*/
+
+/************************************************
+ * Core driver callbacks, external when
+ * USBD_STATIC_DRIVER is set so the usbd_driver_
+ * functions can forward to them.
+ ***********************************************/
+#if USBD_STATIC_DRIVER
+	#define USBD_COMPOSITE_CALLBACK
+#else
+	#define USBD_COMPOSITE_CALLBACK static
+#endif
+
+/************************************************
+ * Function prototypes.
+ ***********************************************/
+static struct usbd_function *usbd_composite_interface(uint8_t num);
+static struct usbd_function *usbd_composite_route(struct usbd_setup_packet_type setup);
+static void usbd_composite_build_descriptor(void);
+USBD_COMPOSITE_CALLBACK bool usbd_composite_is_interface_valid(uint8_t num);
+USBD_COMPOSITE_CALLBACK bool usbd_composite_is_endpoint_valid(uint8_t num, uint8_t dir);
+USBD_COMPOSITE_CALLBACK void usbd_composite_clear_stall(uint8_t num, uint8_t dir);
+USBD_COMPOSITE_CALLBACK uint8_t usbd_composite_get_configuration(void);
+USBD_COMPOSITE_CALLBACK bool usbd_composite_is_configuration_valid(uint8_t num);
+USBD_COMPOSITE_CALLBACK void usbd_composite_set_configuration(uint8_t num);
+USBD_COMPOSITE_CALLBACK uint8_t usbd_composite_get_interface(uint8_t num);
+USBD_COMPOSITE_CALLBACK bool usbd_composite_is_alternate_valid(uint8_t num, uint8_t alt);
+USBD_COMPOSITE_CALLBACK void usbd_composite_set_interface(uint8_t num, uint8_t alt);
+USBD_COMPOSITE_CALLBACK void usbd_composite_class_request(struct usbd_setup_packet_type setup);
+#if USBD_ENABLE_VENDOR_REQUEST
+USBD_COMPOSITE_CALLBACK void usbd_composite_vendor_request(struct usbd_setup_packet_type setup);
+#endif
+USBD_COMPOSITE_CALLBACK uint8_t *usbd_composite_class_descriptor(struct usbd_setup_packet_type setup, uint16_t *len);
+USBD_COMPOSITE_CALLBACK void usbd_composite_sof(void);
+
+/**
+ * @brief Returns the function that claimed an interface.
+ * @param num Interface number.
+ * @return Pointer to the function, NULL if the interface isn't claimed.
+ */
+static struct usbd_function *usbd_composite_interface(uint8_t num)
+{
+	if (num >= USBD_COMPOSITE_MAX_INTERFACES || interface_map[num] == USBD_COMPOSITE_NONE)
+	{
+		return NULL;
+	}
+	return cfg->functions[interface_map[num]];
+}
+
+/**
+ * @brief Returns the function a class or vendor request is addressed to.
+ * @param setup USB setup packet.
+ * @return Pointer to the function, NULL if no function claimed the recipient.
+ */
+static struct usbd_function *usbd_composite_route(struct usbd_setup_packet_type setup)
+{
+	switch (setup.bmRequestType & USBD_RECIPIENT)
+	{
+		case USBD_RECIPIENT_INTERFACE:
+		{
+			return usbd_composite_interface(setup.wIndex & 0xFFU);
+		}
+		case USBD_RECIPIENT_ENDPOINT:
+		{
+			uint8_t ep = setup.wIndex & USBD_EP_ADDRESS_EP_NUMBER;
+			uint8_t idx;
+
+			/*wIndex comes from the host, the number field reaches 15.*/
+			if (ep > EP7)
+			{
+				return NULL;
+			}
+			idx = ep_map[ep][(setup.wIndex & USBD_EP_ADDRESS_EP_DIRECTION) ? 1 : 0];
+			return idx == USBD_COMPOSITE_NONE ? NULL : cfg->functions[idx];
+		}
+		default:
+		{
+			return NULL;
+		}
+	}
+}
+
+/**
+ * @brief Generates the configuration descriptor, an IAD is placed in front
+ * of every function with more than one interface.
+ * @param
+ */
+static void usbd_composite_build_descriptor(void)
+{
+	struct usbd_std_configuration_descriptor_type *conf = (struct usbd_std_configuration_descriptor_type*)desc;
+	uint16_t len = USBD_LENGTH_CONFIGURATION_DESC;
+
+	for (uint8_t i = 0; i < cfg->function_count; i++)
+	{
+		const struct usbd_function *func = cfg->functions[i];
+		if (func->interface_count > 1)
+		{
+			ASSERT((uint32_t)len + USBD_LENGTH_IAD_DESC <= USBD_COMPOSITE_DESC_SIZE);
+			struct usbd_std_iad_descriptor_type *iad = (struct usbd_std_iad_descriptor_type*)&desc[len];
+			iad->bLength = USBD_LENGTH_IAD_DESC;
+			iad->bDescriptorType = USBD_DESC_TYPE_INTERFACE_ASSOCIATION;
+			iad->bFirstInterface = func->first_interface;
+			iad->bInterfaceCount = func->interface_count;
+			iad->bFunctionClass = func->function_class;
+			iad->bFunctionSubClass = func->function_subclass;
+			iad->bFunctionProtocol = func->function_protocol;
+			iad->iFunction = func->function_string;
+			len += USBD_LENGTH_IAD_DESC;
+		}
+		ASSERT((uint32_t)len + func->descriptor_length <= USBD_COMPOSITE_DESC_SIZE);
+		memcpy(&desc[len], func->descriptor, func->descriptor_length);
+		len += func->descriptor_length;
+	}
+
+	conf->bLength = USBD_LENGTH_CONFIGURATION_DESC;
+	conf->bDescriptorType = USBD_DESC_TYPE_CONFIGURATION;
+	conf->wTotalLength = len;
+	conf->bNumInterfaces = interface_count;
+	conf->bConfigurationValue = 1;
+	conf->iConfiguration = cfg->configuration_string;
+	conf->bmAttributes = cfg->attributes;
+	conf->bMaxPower = cfg->max_power;
+}
+
+/**
+ * @brief Interface lookup, replaces the is_interface_valid callback.
+ * @param num Interface number.
+ * @return true if a function claimed the interface.
+ */
+USBD_COMPOSITE_CALLBACK bool usbd_composite_is_interface_valid(uint8_t num)
+{
+	return usbd_composite_interface(num) != NULL;
+}
+
+/**
+ * @brief Endpoint lookup, replaces the is_endpoint_valid callback.
+ * @param num Endpoint number.
+ * @param dir Endpoint direction.
+ * @return true for endpoint 0 or if a function claimed the endpoint.
+ */
+USBD_COMPOSITE_CALLBACK bool usbd_composite_is_endpoint_valid(uint8_t num, uint8_t dir)
+{
+	return !num || ep_map[num][dir] != USBD_COMPOSITE_NONE;
+}
+
+/**
+ * @brief Routes CLEAR_FEATURE(ENDPOINT_HALT) to the function that claimed the
+ * endpoint, replaces the clear_stall callback.
+ * @param num Endpoint number.
+ * @param dir Endpoint direction.
+ */
+USBD_COMPOSITE_CALLBACK void usbd_composite_clear_stall(uint8_t num, uint8_t dir)
+{
+	if (num && cfg->functions[ep_map[num][dir]]->clear_stall != NULL)
+	{
+		cfg->functions[ep_map[num][dir]]->clear_stall(num, dir);
+		return;
+	}
+	if (dir)
+	{
+		USBD_EP_CLEAR_TX_STALL(num);
+	}
+	else
+	{
+		USBD_EP_CLEAR_RX_STALL(num);
+	}
+}
+
+/**
+ * @brief Replaces the get_configuration callback.
+ * @param
+ * @return Current configuration value.
+ */
+USBD_COMPOSITE_CALLBACK uint8_t usbd_composite_get_configuration(void)
+{
+	return configuration;
+}
+
+/**
+ * @brief Replaces the is_configuration_valid callback, the composite
+ * device has a single configuration.
+ * @param num Configuration value.
+ * @return true for 0 and 1.
+ */
+USBD_COMPOSITE_CALLBACK bool usbd_composite_is_configuration_valid(uint8_t num)
+{
+	return num <= 1;
+}
+
+/**
+ * @brief Selects the configuration and configures every function, replaces
+ * the set_configuration callback.
+ * @param num Configuration value.
+ */
+USBD_COMPOSITE_CALLBACK void usbd_composite_set_configuration(uint8_t num)
+{
+	/*Release the endpoints of the previous configuration.*/
+	for (uint8_t ep = 1; ep < 8; ep++)
+	{
+		if (ep_map[ep][0] != USBD_COMPOSITE_NONE || ep_map[ep][1] != USBD_COMPOSITE_NONE)
+		{
+			usbd_unregister_ep(ep);
+		}
+	}
+	memset(alt_setting, 0, sizeof(alt_setting));
+	configuration = num;
+	if (!num)
+	{
+		return;
+	}
+	for (uint8_t i = 0; i < cfg->function_count; i++)
+	{
+		if (cfg->functions[i]->configure != NULL)
+		{
+			cfg->functions[i]->configure();
+		}
+	}
+}
+
+/**
+ * @brief Replaces the get_interface callback.
+ * @param num Interface number.
+ * @return Current alternate setting.
+ */
+USBD_COMPOSITE_CALLBACK uint8_t usbd_composite_get_interface(uint8_t num)
+{
+	return alt_setting[num];
+}
+
+/**
+ * @brief Replaces the is_alternate_valid callback.
+ * @param num Interface number.
+ * @param alt Alternate setting.
+ * @return true if the function that claimed the interface supports the alternate setting.
+ */
+USBD_COMPOSITE_CALLBACK bool usbd_composite_is_alternate_valid(uint8_t num, uint8_t alt)
+{
+	struct usbd_function *func = usbd_composite_interface(num);
+
+	if (func->is_alternate_valid == NULL)
+	{
+		return !alt;
+	}
+	return func->is_alternate_valid(num, alt);
+}
+
+/**
+ * @brief Routes SET_INTERFACE to the function that claimed the interface,
+ * replaces the set_interface callback.
+ * @param num Interface number.
+ * @param alt Alternate setting.
+ */
+USBD_COMPOSITE_CALLBACK void usbd_composite_set_interface(uint8_t num, uint8_t alt)
+{
+	struct usbd_function *func = usbd_composite_interface(num);
+
+	alt_setting[num] = alt;
+	if (func->set_interface != NULL)
+	{
+		func->set_interface(num, alt);
+	}
+}
+
+/**
+ * @brief Routes a class request, replaces the class_request callback.
+ * @param setup USB setup packet.
+ */
+USBD_COMPOSITE_CALLBACK void usbd_composite_class_request(struct usbd_setup_packet_type setup)
+{
+	struct usbd_function *func = usbd_composite_route(setup);
+
+	if (func == NULL || func->class_request == NULL || !func->class_request(setup))
+	{
+		USBD_EP0_SET_STALL();
+	}
+}
+
+#if USBD_ENABLE_VENDOR_REQUEST
+/**
+ * @brief Routes a vendor request, replaces the vendor_request callback.
+ * @param setup USB setup packet.
+ */
+USBD_COMPOSITE_CALLBACK void usbd_composite_vendor_request(struct usbd_setup_packet_type setup)
+{
+	struct usbd_function *func = usbd_composite_route(setup);
+
+	if ((setup.bmRequestType & USBD_RECIPIENT) == USBD_RECIPIENT_DEVICE)
+	{
+		if (cfg->vendor_request == NULL || !cfg->vendor_request(setup))
+		{
+			USBD_EP0_SET_STALL();
+		}
+		return;
+	}
+	if (func == NULL || func->vendor_request == NULL || !func->vendor_request(setup))
+	{
+		USBD_EP0_SET_STALL();
+	}
+}
+#endif
+
+/**
+ * @brief Routes a class specific descriptor request, replaces the
+ * class_descriptor callback.
+ * @param setup USB setup packet.
+ * @param len Pointer that receives the size of the descriptor.
+ * @return Pointer to the descriptor, NULL to stall.
+ */
+USBD_COMPOSITE_CALLBACK uint8_t *usbd_composite_class_descriptor(struct usbd_setup_packet_type setup, uint16_t *len)
+{
+	struct usbd_function *func = usbd_composite_route(setup);
+
+	if (func == NULL || func->class_descriptor == NULL)
+	{
+		return NULL;
+	}
+	return func->class_descriptor(setup, len);
+}
+
+/**
+ * @brief Calls the sof callback of the functions, replaces the sof callback.
+ * @param
+ */
+USBD_COMPOSITE_CALLBACK void usbd_composite_sof(void)
+{
+	for (uint8_t i = 0; i < sof_count; i++)
+	{
+		sof_list[i]->sof();
+	}
+}
+
+/**
+ * @brief Builds the lookup tables and the configuration descriptor, then
+ * points the routing callbacks of the core driver to the composite device.
+ * @note The user still provides the device, string and bos descriptors and
+ * the power and remote wakeup callbacks. Should be called before usbd_core_init.
+ * @param config Pointer to usbd_composite_config struct that lists the functions.
+ * @param core_driver Pointer to the core driver that is going to be passed to usbd_core_init.
+ * Unused when USBD_STATIC_DRIVER is set, the usbd_driver_ functions forward to the
+ * usbd_composite_ callbacks instead.
+ */
+void usbd_composite_init(const struct usbd_composite_config *config, struct usbd_core_driver *core_driver)
+{
+	ASSERT(config != NULL);
+#if USBD_STATIC_DRIVER
+	UNUSED(core_driver);
+#else
+	ASSERT(core_driver != NULL);
+#endif
+	ASSERT(config->functions != NULL);
+	ASSERT(config->function_count && config->function_count <= USBD_COMPOSITE_MAX_FUNCTIONS);
+	cfg = config;
+	memset(interface_map, USBD_COMPOSITE_NONE, sizeof(interface_map));
+	memset(ep_map, USBD_COMPOSITE_NONE, sizeof(ep_map));
+	memset(alt_setting, 0, sizeof(alt_setting));
+	interface_count = 0;
+	configuration = 0;
+	sof_count = 0;
+
+	for (uint8_t i = 0; i < config->function_count; i++)
+	{
+		struct usbd_function *func = config->functions[i];
+		ASSERT(func != NULL);
+		ASSERT(func->interface_count);
+		ASSERT(func->first_interface + func->interface_count <= USBD_COMPOSITE_MAX_INTERFACES);
+		for (uint8_t num = func->first_interface; num < func->first_interface + func->interface_count; num++)
+		{
+			/*Every interface belongs to a single function.*/
+			ASSERT(interface_map[num] == USBD_COMPOSITE_NONE);
+			interface_map[num] = i;
+			interface_count++;
+		}
+		for (uint8_t j = 0; j < USBD_FUNCTION_MAX_EP && func->ep_address[j]; j++)
+		{
+			uint8_t num = func->ep_address[j] & USBD_EP_ADDRESS_EP_NUMBER;
+			uint8_t dir = (func->ep_address[j] & USBD_EP_ADDRESS_EP_DIRECTION) ? 1 : 0;
+			ASSERT(num && num < 8);
+			ASSERT(ep_map[num][dir] == USBD_COMPOSITE_NONE);
+			ep_map[num][dir] = i;
+		}
+		if (func->sof != NULL)
+		{
+			sof_list[sof_count++] = func;
+		}
+	}
+	usbd_composite_build_descriptor();
+
+#if !USBD_STATIC_DRIVER
+	core_driver->is_interface_valid = usbd_composite_is_interface_valid;
+	core_driver->is_endpoint_valid = usbd_composite_is_endpoint_valid;
+	core_driver->clear_stall = usbd_composite_clear_stall;
+	core_driver->configuration_descriptor = usbd_composite_configuration_descriptor;
+	core_driver->get_configuration = usbd_composite_get_configuration;
+	core_driver->is_configuration_valid = usbd_composite_is_configuration_valid;
+	core_driver->set_configuration = usbd_composite_set_configuration;
+	core_driver->get_interface = usbd_composite_get_interface;
+	core_driver->is_alternate_valid = usbd_composite_is_alternate_valid;
+	core_driver->set_interface = usbd_composite_set_interface;
+	core_driver->class_request = usbd_composite_class_request;
+#if USBD_ENABLE_VENDOR_REQUEST
+	core_driver->vendor_request = usbd_composite_vendor_request;
+#endif
+	core_driver->class_descriptor = usbd_composite_class_descriptor;
+	core_driver->sof = usbd_composite_sof;
+#endif
+}
+
+/**
+ * @brief Returns the generated configuration descriptor.
+ * @param index Configuration index.
+ * @return Pointer to the configuration descriptor, NULL if the index isn't 0.
+ */
+uint8_t *usbd_composite_configuration_descriptor(uint8_t index)
+{
+	ASSERT(cfg != NULL);
+	return index ? NULL : desc;
+}
@@ -1,6 +1,12 @@
 #include "assert_stm32l4xx.h"
 #include "spinlock_stm32l4xx.h"
 #include "usbd_core.h"
+#if USBD_CAPTURE
+#include "usbd_capture.h"
+#endif
+#if USBD_RECORD
+#include "usbd_record.h"
+#endif
 
 /************************************************
  * USB request callbacks.
@@ -13,34 +19,79 @@ struct usbd_core_state
 	void (*set_feature)(struct usbd_setup_packet_type setup);
 	void (*set_address)(struct usbd_setup_packet_type setup);
 	void (*get_descriptor)(struct usbd_setup_packet_type setup);
+#if USBD_ENABLE_SET_DESCRIPTOR
 	void (*set_descriptor)(struct usbd_setup_packet_type setup);
+#endif
 	void (*get_configuration)(struct usbd_setup_packet_type setup);
 	void (*set_configuration)(struct usbd_setup_packet_type setup);
 	void (*get_interface)(struct usbd_setup_packet_type setup);
 	void (*set_interface)(struct usbd_setup_packet_type setup);
+#if USBD_ENABLE_SYNCH_FRAME
 	void (*synch_frame)(struct usbd_setup_packet_type setup);
+#endif
 	void (*class_request)(struct usbd_setup_packet_type setup);
+#if USBD_ENABLE_VENDOR_REQUEST
 	void (*vendor_request)(struct usbd_setup_packet_type setup);
+#endif
 };
 
+/************************************************
+ * Driver callback, from usbd_core_driver or bound
+ * at link time.
+ ***********************************************/
+#if USBD_STATIC_DRIVER
+	#define USBD_DRV(cb) usbd_driver_##cb
+#else
+	#define USBD_DRV(cb) drv->cb
+#endif
+
 /************************************************
  * Static variables and callbacks 
  * used by the usbd core.
  ***********************************************/
 static uint8_t *ep0_buf; /*!< Pointer to endpoint 0 buffer.*/
 static __IO uint32_t ep0_cnt; /*!< endpoint 0 buffer data count.*/
+static uint16_t ep0_wlength; /*!< wLength of the current setup packet.*/
+static bool ep0_zlp; /*!< The Data In stage ends with a zero length packet.*/
 static void (*__IO stage)(void); /*!< Pointer to current stage callback.*/
 static void (*__IO reception_completed)(void); /*!< Stores a callback function, used to let the user know that a data reception in endpoint 0 has been completed. (Useful for class and/or vendor requests)*/
 static struct usbd_core_state const __IO *cur_state; /*!< Pointer to current state of the device.*/
 static struct usbd_core_state const __IO *prev_state; /*!< Pointer to previous state of the device.(Used to store the state when the device gets suspended)*/
 static uint16_t device_address; /*!< Stores the device address.*/
-static struct usbd_core_driver* __IO drv; /*!< Pointer to the configuration provided by the user during initialization.*/
+#if !USBD_STATIC_DRIVER
+static struct usbd_core_driver *drv; /*!< Pointer to the configuration provided by the user during initialization.*/
+#endif
 static void (*__IO ep_handler[8][2])(void); /*!< Pointer to stored endpoint callback functions.*/
+static struct usbd_core_stats core_stats; /*!< Core counters, only updated when USBD_CORE_STATS is set.*/
+static __IO uint8_t resume_cnt; /*!< ESOF periods left until the RESUME signaling ends.*/
+static uint16_t ep_saved[8]; /*!< Endpoint registers saved when the bus got suspended.*/
+static uint8_t esof_cnt; /*!< SOFs missed since the previous SOF.*/
+static __IO uint8_t iso_pending; /*!< Bitmask of the endpoints with a scheduled isochronous packet.*/
+static struct
+{
+	const uint8_t *buf;
+	uint16_t cnt;
+	uint16_t frame;
+} iso_tx[8]; /*!< Scheduled isochronous packets.*/
+#if USBD_CORE_STATS
+static __IO bool resume_measure; /*!< The next serviced packet ends the resume measurement.*/
+static uint32_t resume_start; /*!< Cycle counter when the bus resumed.*/
+static bool enum_measure; /*!< An enumeration is being measured.*/
+static struct usbd_core_stats enum_start; /*!< Counters at the bus reset that started the enumeration.*/
+static uint32_t enum_start_cycles; /*!< Cycle counter at the bus reset that started the enumeration.*/
+#endif
+#if USBD_LPM
+static __IO bool l1_active; /*!< The device is in the L1 state.*/
+static bool l1_remote_wake; /*!< bRemoteWake of the LPM request.*/
+static __IO bool l1_measure; /*!< The next SOF ends the L1 residency measurement.*/
+static uint16_t l1_frame; /*!< Frame number when L1 was entered.*/
+#endif
 
 /************************************************
  * Function prototypes.
  ***********************************************/
 static void usbd_ep0_handler(void);
+static void usbd_ep0_abort(void);
 static void usbd_setup_stage(void);
 static void usbd_data_out_stage(void);
 static void usbd_data_in_stage(void);
@@ -54,16 +105,33 @@ static void usbd_clear_feature(struct usbd_setup_packet_type setup);
 static void usbd_set_feature(struct usbd_setup_packet_type setup);
 static void usbd_set_address(struct usbd_setup_packet_type setup);
 static void usbd_get_descriptor(struct usbd_setup_packet_type setup);
+#if USBD_ENABLE_SET_DESCRIPTOR
 static void usbd_set_descriptor(struct usbd_setup_packet_type setup);
+#endif
 static void usbd_get_configuration(struct usbd_setup_packet_type setup);
 static void usbd_set_configuration(struct usbd_setup_packet_type setup);
 static void usbd_get_interface(struct usbd_setup_packet_type setup);
 static void usbd_set_interface(struct usbd_setup_packet_type setup);
+#if USBD_ENABLE_SYNCH_FRAME
 static void usbd_synch_frame(struct usbd_setup_packet_type setup);
+#endif
 static void usbd_class_request(struct usbd_setup_packet_type setup);
+#if USBD_ENABLE_VENDOR_REQUEST
 static void usbd_vendor_request(struct usbd_setup_packet_type setup);
+#endif
 
 static void usbd_reset(void);
+static void usbd_enter_suspend(void);
+static void usbd_leave_suspend(void);
+static void usbd_iso_tx(uint16_t fn);
+#if USBD_LPM
+static void usbd_l1_enter(void);
+static void usbd_l1_exit(void);
+#endif
+#if USBD_BCD
+static void usbd_bcd_delay_ms(uint32_t ms);
+static void usbd_bcd_detect(void);
+#endif
 static void usbd_irq_handler(void);
 
 /************************************************
@@ -76,14 +144,20 @@ static const struct usbd_core_state default_state =
 	NULL,
 	usbd_set_address,
 	usbd_get_descriptor,
+#if USBD_ENABLE_SET_DESCRIPTOR
 	NULL,
+#endif
 	NULL,
 	NULL,
 	NULL,
 	NULL,
+#if USBD_ENABLE_SYNCH_FRAME
 	NULL,
+#endif
 	NULL,
+#if USBD_ENABLE_VENDOR_REQUEST
 	NULL
+#endif
 };
 
 /************************************************
@@ -96,14 +170,20 @@ static const struct usbd_core_state addressed_state =
 	usbd_set_feature,
 	usbd_set_address,
 	usbd_get_descriptor,
+#if USBD_ENABLE_SET_DESCRIPTOR
 	NULL,
+#endif
 	usbd_get_configuration,
 	usbd_set_configuration,
 	NULL,
 	NULL,
+#if USBD_ENABLE_SYNCH_FRAME
 	NULL,
+#endif
 	NULL,
+#if USBD_ENABLE_VENDOR_REQUEST
 	usbd_vendor_request
+#endif
 };
 
 /************************************************
@@ -116,14 +196,20 @@ static const struct usbd_core_state configured_state =
 	usbd_set_feature,
 	NULL,
 	usbd_get_descriptor,
+#if USBD_ENABLE_SET_DESCRIPTOR
 	usbd_set_descriptor,
+#endif
 	usbd_get_configuration,
 	usbd_set_configuration,
 	usbd_get_interface,
 	usbd_set_interface,
+#if USBD_ENABLE_SYNCH_FRAME
 	usbd_synch_frame,
+#endif
 	usbd_class_request,
+#if USBD_ENABLE_VENDOR_REQUEST
 	usbd_vendor_request
+#endif
 };
 
 /************************************************
@@ -141,6 +227,26 @@ static void usbd_ep0_handler(void)
 	stage();
 }
 
+/**
+ * @brief Drops the control transfer in progress, a new SETUP preempted it.
+ * The completion callback is cancelled, STATUS_OUT is cleared and the IN
+ * direction is set to NAK with a single register write.
+ * @param  
+ */
+static void usbd_ep0_abort(void)
+{
+	uint16_t ep_val = *USBD_EP_REG(EP0);
+
+#if USBD_CORE_STATS
+	core_stats.ep0_aborts++;
+#endif
+	ep0_buf = NULL;
+	ep0_cnt = 0;
+	ep0_zlp = false;
+	reception_completed = NULL;
+	*USBD_EP_REG(EP0) = USBD_EP_SET_TOGGLE(ep_val, USB_EP_STAT_TX_NAK, USB_EP_STAT_TX) & ~USB_EP_KIND;
+}
+
 /**
  * @brief Setup stage callback function.
  * @param  
@@ -149,14 +255,35 @@ static void usbd_setup_stage(void)
 {
 	struct usbd_setup_packet_type setup;
 	uint16_t count = USBD_PMA_GET_RX_COUNT(EP0);
+#if USBD_CORE_STATS
+	uint32_t start;
+#endif
 	
+	/*A malformed setup packet is not parsed, nor copied past the struct.*/
 	if(count != USBD_SETUP_PACKET_SIZE)
 	{
 		USBD_EP0_SET_STALL();
+		return;
 	}
 
-	usbd_pma_read(ADDR0_RX, (uint8_t*)&setup, count);
+	usbd_pma_read(ADDR0_RX, (uint8_t*)&setup, USBD_SETUP_PACKET_SIZE);
+	ep0_wlength = setup.wLength;
+#if USBD_CORE_STATS
+	core_stats.setup_count++;
+	start = DWT->CYCCNT;
 	usbd_parse_setup_packet(setup);
+	/*Only the standard requests have a slot.*/
+	if ((setup.bmRequestType & USBD_TYPE) == USBD_TYPE_STANDARD && setup.bRequest <= USBD_SYNCH_FRAME)
+	{
+		uint32_t cycles = DWT->CYCCNT - start;
+		if (cycles > core_stats.request_cycles_max[setup.bRequest])
+		{
+			core_stats.request_cycles_max[setup.bRequest] = cycles;
+		}
+	}
+#else
+	usbd_parse_setup_packet(setup);
+#endif
 }
 
 /**
@@ -169,6 +296,15 @@ static void usbd_data_in_stage(void)
 	/*Decrement the leftover bytes.*/
 	ep0_cnt -= cnt;
 
+	/*A transfer shorter than wLength that ends with a full packet needs a zero length packet.*/
+	if (!ep0_cnt && cnt && ep0_zlp)
+	{
+		ep0_zlp = false;
+		USBD_EP_SET_STAT_RX(EP0, USB_EP_STAT_RX_NAK);
+		USBD_PMA_SET_TX_COUNT(EP0, 0);
+		USBD_EP_SET_STAT_TX(EP0, USB_EP_STAT_TX_VALID);
+		return;
+	}
 	/*If there is no leftover data, Data In stage is completed.*/
 	if (!ep0_cnt)
 	{
@@ -243,7 +379,21 @@ static void usbd_status_in_stage(void)
 	if(reception_completed != NULL)
 	{
 		reception_completed();
+		reception_completed = NULL;
+	}
+#if USBD_CORE_STATS
+	/*The host acknowledged SET_CONFIGURATION, the device is ready.*/
+	if (enum_measure && cur_state == &configured_state)
+	{
+		enum_measure = false;
+		core_stats.enum_count++;
+		core_stats.enum_cycles = DWT->CYCCNT - enum_start_cycles;
+		core_stats.enum_irq_cycles = core_stats.irq_cycles - enum_start.irq_cycles;
+		core_stats.enum_setups = core_stats.setup_count - enum_start.setup_count;
+		core_stats.enum_pma_bytes = (core_stats.pma_read_bytes + core_stats.pma_write_bytes) -
+			(enum_start.pma_read_bytes + enum_start.pma_write_bytes);
 	}
+#endif
 	/*Clear the ep0 transfer.*/
 	ep0_buf = NULL;
 	ep0_cnt = 0;
@@ -330,6 +480,7 @@ static void usbd_parse_setup_packet(struct usbd_setup_packet_type setup)
 					cur_state->get_descriptor(setup);
                     break;            
                 }
+#if USBD_ENABLE_SET_DESCRIPTOR
                 case USBD_SET_DESCRIPTOR:
                 {
 					if(cur_state->set_descriptor == NULL)
@@ -340,6 +491,7 @@ static void usbd_parse_setup_packet(struct usbd_setup_packet_type setup)
                     cur_state->set_descriptor(setup);
                     break;            
                 }
+#endif
                 case USBD_GET_CONFIGURATION:
                 {
 					if(cur_state->get_configuration == NULL)
@@ -380,6 +532,7 @@ static void usbd_parse_setup_packet(struct usbd_setup_packet_type setup)
                     cur_state->set_interface(setup);
                     break;
                 }
+#if USBD_ENABLE_SYNCH_FRAME
                 case USBD_SYNCH_FRAME:
                 {
 					if(cur_state->synch_frame == NULL)
@@ -390,6 +543,7 @@ static void usbd_parse_setup_packet(struct usbd_setup_packet_type setup)
                     cur_state->synch_frame(setup);
                     break;
                 }
+#endif
                 default:
                 {
 					USBD_EP0_SET_STALL();
@@ -408,6 +562,7 @@ static void usbd_parse_setup_packet(struct usbd_setup_packet_type setup)
             cur_state->class_request(setup);
             break;
         }
+#if USBD_ENABLE_VENDOR_REQUEST
         case USBD_TYPE_VENDOR:
         {
 			if(cur_state->vendor_request == NULL)
@@ -418,6 +573,7 @@ static void usbd_parse_setup_packet(struct usbd_setup_packet_type setup)
 			cur_state->vendor_request(setup);
             break;
         }
+#endif
         default:
         {
 			USBD_EP0_SET_STALL();
@@ -437,18 +593,16 @@ static void usbd_get_status(struct usbd_setup_packet_type setup)
 	{
 		case USBD_RECIPIENT_DEVICE:
 		{
-			ASSERT(drv != NULL);
-			ASSERT(drv->get_remote_wakeup != NULL);
-			ASSERT(drv->is_selfpowered != NULL);
-			buf[0] = drv->get_remote_wakeup() ? 1 << 1 : 0 << 1;
-			buf[0] |= drv->is_selfpowered() ? 1 : 0;
+			ASSERT(USBD_DRV(get_remote_wakeup) != NULL);
+			ASSERT(USBD_DRV(is_selfpowered) != NULL);
+			buf[0] = USBD_DRV(get_remote_wakeup)() ? 1 << 1 : 0 << 1;
+			buf[0] |= USBD_DRV(is_selfpowered)() ? 1 : 0;
 			break;
 		}
 		case USBD_RECIPIENT_INTERFACE:
 		{
-			ASSERT(drv != NULL);
-			ASSERT(drv->is_interface_valid != NULL);
-			if(!drv->is_interface_valid(setup.wIndex & 0x7FU))
+			ASSERT(USBD_DRV(is_interface_valid) != NULL);
+			if(!USBD_DRV(is_interface_valid)(setup.wIndex & 0x7FU))
 			{
 				USBD_EP0_SET_STALL();
 				return;
@@ -459,9 +613,8 @@ static void usbd_get_status(struct usbd_setup_packet_type setup)
 		{
 			uint8_t ep = (setup.wIndex & USBD_EP_ADDRESS_EP_NUMBER);
 			uint8_t dir =  (setup.wIndex & USBD_EP_ADDRESS_EP_DIRECTION) ? 1 : 0;
-			ASSERT(drv != NULL);
-			ASSERT(drv->is_endpoint_valid != NULL);
-			if(!drv->is_endpoint_valid(ep, dir))
+			ASSERT(USBD_DRV(is_endpoint_valid) != NULL);
+			if(ep > EP7 || !USBD_DRV(is_endpoint_valid)(ep, dir))
 			{
 				USBD_EP0_SET_STALL();
 				return;
@@ -490,24 +643,27 @@ static void usbd_clear_feature(struct usbd_setup_packet_type setup)
 	{
 		case USBD_RECIPIENT_DEVICE:
 		{
-			ASSERT(drv != NULL);
-			ASSERT(drv->set_remote_wakeup != NULL);
-			drv->set_remote_wakeup(false);
+			ASSERT(USBD_DRV(set_remote_wakeup) != NULL);
+			if (setup.wValue != USBD_DEVICE_REMOTE_WAKEUP)
+			{
+				USBD_EP0_SET_STALL();
+				return;
+			}
+			USBD_DRV(set_remote_wakeup)(false);
 			break;	
 		}
 		case USBD_RECIPIENT_ENDPOINT:
 		{
 			uint8_t ep = (setup.wIndex & USBD_EP_ADDRESS_EP_NUMBER);
 			uint8_t dir =  (setup.wIndex & USBD_EP_ADDRESS_EP_DIRECTION) ? 1 : 0;
-			ASSERT(drv != NULL);
-			ASSERT(drv->is_endpoint_valid != NULL);
-			if(!drv->is_endpoint_valid(ep, dir))
+			ASSERT(USBD_DRV(is_endpoint_valid) != NULL);
+			if(ep > EP7 || setup.wValue != USBD_ENDPOINT_HALT || !USBD_DRV(is_endpoint_valid)(ep, dir))
 			{
 				USBD_EP0_SET_STALL();
 				return;
 			}
-			ASSERT(drv->clear_stall != NULL);
-			drv->clear_stall(ep, dir);
+			ASSERT(USBD_DRV(clear_stall) != NULL);
+			USBD_DRV(clear_stall)(ep, dir);
 			break;
 		}
 		default:
@@ -530,18 +686,22 @@ static void usbd_set_feature(struct usbd_setup_packet_type setup)
 	{
 		case USBD_RECIPIENT_DEVICE:
 		{
-			ASSERT(drv != NULL);
-			ASSERT(drv->set_remote_wakeup != NULL);
-			drv->set_remote_wakeup(true);
+			ASSERT(USBD_DRV(set_remote_wakeup) != NULL);
+			/*Test modes are for high speed devices only.*/
+			if (setup.wValue != USBD_DEVICE_REMOTE_WAKEUP)
+			{
+				USBD_EP0_SET_STALL();
+				return;
+			}
+			USBD_DRV(set_remote_wakeup)(true);
 			break;	
 		}
 		case USBD_RECIPIENT_ENDPOINT:
 		{
 			uint8_t ep = (setup.wIndex & USBD_EP_ADDRESS_EP_NUMBER);
 			uint8_t dir =  (setup.wIndex & USBD_EP_ADDRESS_EP_DIRECTION) ? 1 : 0;
-			ASSERT(drv != NULL);
-			ASSERT(drv->is_endpoint_valid != NULL);
-			if(!drv->is_endpoint_valid(ep, dir))
+			ASSERT(USBD_DRV(is_endpoint_valid) != NULL);
+			if(ep > EP7 || setup.wValue != USBD_ENDPOINT_HALT || !USBD_DRV(is_endpoint_valid)(ep, dir))
 			{
 				USBD_EP0_SET_STALL();
 				return;
@@ -572,6 +732,11 @@ static void usbd_set_feature(struct usbd_setup_packet_type setup)
  */
 static void usbd_set_address(struct usbd_setup_packet_type setup)
 {
+	if (setup.wValue > USB_DADDR_ADD)
+	{
+		USBD_EP0_SET_STALL();
+		return;
+	}
 	device_address = setup.wValue;
 	usbd_prepare_status_in_stage();
 }
@@ -589,56 +754,86 @@ static void usbd_get_descriptor(struct usbd_setup_packet_type setup)
 	{
 		case USBD_DESC_TYPE_DEVICE:
 		{
-			ASSERT(drv != NULL);
-			ASSERT(drv->device_descriptor != NULL);
-			buf = drv->device_descriptor();
+			ASSERT(USBD_DRV(device_descriptor) != NULL);
+			buf = USBD_DRV(device_descriptor)();
 			cnt = MIN(setup.wLength, buf[0]);
 			break;
 		}
 		case USBD_DESC_TYPE_CONFIGURATION:
 		{
-			ASSERT(drv != NULL);
-			ASSERT(drv->configuration_descriptor != NULL);
-			buf = drv->configuration_descriptor(setup.wValue & 0xFFU);
+			ASSERT(USBD_DRV(configuration_descriptor) != NULL);
+			buf = USBD_DRV(configuration_descriptor)(setup.wValue & 0xFFU);
+			if (buf == NULL)
+			{
+				USBD_EP0_SET_STALL();
+				return;
+			}
+			ASSERT(buf[0] == USBD_LENGTH_CONFIGURATION_DESC && buf[1] == USBD_DESC_TYPE_CONFIGURATION);
 			cnt = MIN(setup.wLength, (buf[2] | buf[3] << 8));
 			break;
 		}
 		case USBD_DESC_TYPE_STRING:
 		{
-			ASSERT(drv != NULL);
-			ASSERT(drv->string_descriptor != NULL);
-			buf = drv->string_descriptor((setup.wValue & 0xFFU), setup.wIndex);
+			ASSERT(USBD_DRV(string_descriptor) != NULL);
+			buf = USBD_DRV(string_descriptor)((setup.wValue & 0xFFU), setup.wIndex);
+			if (buf == NULL)
+			{
+				USBD_EP0_SET_STALL();
+				return;
+			}
 			cnt = MIN(setup.wLength, buf[0]);
 			break;
 		}		
+#if USBD_ENABLE_BOS
 		case USBD_DESC_TYPE_BOS:
 		{
-			ASSERT(drv != NULL);
-			ASSERT(drv->bos_descriptor != NULL);
-			buf = drv->bos_descriptor();
-			cnt = setup.wLength;
+			ASSERT(USBD_DRV(bos_descriptor) != NULL);
+			buf = USBD_DRV(bos_descriptor)();
+			if (buf == NULL)
+			{
+				USBD_EP0_SET_STALL();
+				return;
+			}
+			ASSERT(buf[0] == USBD_LENGTH_BOS_DESC && buf[1] == USBD_DESC_TYPE_BOS);
+			cnt = MIN(setup.wLength, (buf[2] | buf[3] << 8));
 			break;
 		}
+#endif
 		default:
 		{
-			USBD_EP0_SET_STALL();
-			return;
+			uint16_t len = 0;
+			/*Let the class handle descriptors unknown to the core.*/
+			if (USBD_DRV(class_descriptor) != NULL)
+			{
+				buf = USBD_DRV(class_descriptor)(setup, &len);
+			}
+			if (buf == NULL)
+			{
+				USBD_EP0_SET_STALL();
+				return;
+			}
+			cnt = MIN(setup.wLength, len);
 			break;
 		}
 	}
 	usbd_prepare_data_in_stage(buf, cnt);
 }
 
+#if USBD_ENABLE_SET_DESCRIPTOR
 /**
  * @brief USB set descriptor callback function.
  * @param setup USB setup packet.
  */
 static void usbd_set_descriptor(struct usbd_setup_packet_type setup)
 {
-	ASSERT(drv != NULL);
-	ASSERT(drv->set_descriptor != NULL);
-	drv->set_descriptor(setup);
+	if (USBD_DRV(set_descriptor) == NULL)
+	{
+		USBD_EP0_SET_STALL();
+		return;
+	}
+	USBD_DRV(set_descriptor)(setup);
 }
+#endif
 
 /**
  * @brief USB get descriptor callback function.
@@ -648,9 +843,8 @@ static void usbd_get_configuration(struct usbd_setup_packet_type setup)
 {
 	UNUSED(setup);
 	uint8_t buf = 0;
-	ASSERT(drv != NULL);
-	ASSERT(drv->get_configuration != NULL);
-	buf = drv->get_configuration();
+	ASSERT(USBD_DRV(get_configuration) != NULL);
+	buf = USBD_DRV(get_configuration)();
 	usbd_prepare_data_in_stage(&buf, USBD_GET_CONFIGURATION_LENGTH);
 }
 
@@ -661,15 +855,14 @@ static void usbd_get_configuration(struct usbd_setup_packet_type setup)
 static void usbd_set_configuration(struct usbd_setup_packet_type setup)
 {
 	uint8_t num = (setup.wValue & 0xFFU);
-	ASSERT(drv != NULL);
-	ASSERT(drv->is_configuration_valid != NULL);
-	if(!drv->is_configuration_valid(num))
+	ASSERT(USBD_DRV(is_configuration_valid) != NULL);
+	if(!USBD_DRV(is_configuration_valid)(num))
 	{
 		USBD_EP0_SET_STALL();
 		return;
 	}
-	ASSERT(drv->set_configuration != NULL);
-	drv->set_configuration(num);
+	ASSERT(USBD_DRV(set_configuration) != NULL);
+	USBD_DRV(set_configuration)(num);
 	cur_state = num ? &configured_state : &addressed_state;
 	usbd_prepare_status_in_stage();
 }
@@ -682,15 +875,14 @@ static void usbd_get_interface(struct usbd_setup_packet_type setup)
 {
 	uint8_t num = (setup.wIndex & 0x7FU);
 	uint8_t buf = 0;
-	ASSERT(drv != NULL);
-	ASSERT(drv->is_interface_valid != NULL);
-	if(!drv->is_interface_valid(num))
+	ASSERT(USBD_DRV(is_interface_valid) != NULL);
+	if(!USBD_DRV(is_interface_valid)(num))
 	{
 		USBD_EP0_SET_STALL();
 		return;
 	}
-	ASSERT(drv->get_interface != NULL);
-	buf = drv->get_interface(num);
+	ASSERT(USBD_DRV(get_interface) != NULL);
+	buf = USBD_DRV(get_interface)(num);
 	usbd_prepare_data_in_stage(&buf, USBD_GET_INTERFACE_LENGTH);
 }
 
@@ -702,26 +894,47 @@ static void usbd_set_interface(struct usbd_setup_packet_type setup)
 {
 	uint8_t num = (setup.wIndex & 0x7FU);
 	uint8_t alt = (setup.wValue & 0xFFU);
-	ASSERT(drv != NULL);
-	ASSERT(drv->is_interface_valid != NULL);
-	if (!drv->is_interface_valid(num))
+	ASSERT(USBD_DRV(is_interface_valid) != NULL);
+	if (!USBD_DRV(is_interface_valid)(num))
+	{
+		USBD_EP0_SET_STALL();
+		return;
+	}
+	if (USBD_DRV(is_alternate_valid) != NULL && !USBD_DRV(is_alternate_valid)(num, alt))
 	{
-		USBD_EP0_SET_STALL();		
+		USBD_EP0_SET_STALL();
+		return;
 	}
-	ASSERT(drv->set_interface != NULL);
-	drv->set_interface(num, alt);
+	ASSERT(USBD_DRV(set_interface) != NULL);
+	USBD_DRV(set_interface)(num, alt);
 	usbd_prepare_status_in_stage();	
 }
 
+#if USBD_ENABLE_SYNCH_FRAME
 /**
  * @brief USB synch frame callback function.
- * @todo Unsure how to implement.
  * @param setup USB setup packet.
  */
 static void usbd_synch_frame(struct usbd_setup_packet_type setup)
 {
-	UNUSED(setup);
+	uint8_t ep = (setup.wIndex & USBD_EP_ADDRESS_EP_NUMBER);
+	uint8_t dir = (setup.wIndex & USBD_EP_ADDRESS_EP_DIRECTION) ? 1 : 0;
+	uint16_t fn;
+	uint8_t buf[2];
+
+	ASSERT(USBD_DRV(is_endpoint_valid) != NULL);
+	if ((setup.bmRequestType & USBD_RECIPIENT) != USBD_RECIPIENT_ENDPOINT || setup.wValue || setup.wLength != USBD_SYNCH_FRAME_LENGTH ||
+		ep > EP7 || !USBD_DRV(is_endpoint_valid)(ep, dir) || GET(*USBD_EP_REG(ep), USB_EP_TYPE) != USB_EP_TYPE_ISOCHRONOUS)
+	{
+		USBD_EP0_SET_STALL();
+		return;
+	}
+	fn = (USBD_DRV(synch_frame) != NULL) ? USBD_DRV(synch_frame)(ep, dir) : GET(USB->FNR, USB_FNR_FN);
+	buf[0] = (uint8_t)(fn & 0xFFU);
+	buf[1] = (uint8_t)((fn >> 0x8U) & 0x7U);
+	usbd_prepare_data_in_stage(buf, USBD_SYNCH_FRAME_LENGTH);
 }
+#endif
 
 /**
  * @brief USB class specific request callback function.
@@ -729,21 +942,21 @@ static void usbd_synch_frame(struct usbd_setup_packet_type setup)
  */
 static void usbd_class_request(struct usbd_setup_packet_type setup)
 {
-	ASSERT(drv != NULL);
-	ASSERT(drv->class_request != NULL);
-	drv->class_request(setup);
+	ASSERT(USBD_DRV(class_request) != NULL);
+	USBD_DRV(class_request)(setup);
 }
 
+#if USBD_ENABLE_VENDOR_REQUEST
 /**
  * @brief USB vendor specific request callback function.
  * @param setup USB setup packet.
  */
 static void usbd_vendor_request(struct usbd_setup_packet_type setup)
 {
-	ASSERT(drv != NULL);
-	ASSERT(drv->vendor_request != NULL);
-	drv->vendor_request(setup);
+	ASSERT(USBD_DRV(vendor_request) != NULL);
+	USBD_DRV(vendor_request)(setup);
 }
+#endif
 
 /**
  * @brief Resets the usb device.
@@ -758,10 +971,261 @@ static void usbd_reset(void)
 	usbd_register_ep(EP0, USB_EP_TYPE_CONTROL, ADDR0_TX, ADDR0_RX, EP0_COUNT, usbd_ep0_handler, usbd_ep0_handler);
 	ep0_buf = NULL;
 	ep0_cnt = 0;
+	ep0_zlp = false;
+	stage = NULL;
+	reception_completed = NULL;
 	cur_state = &default_state;
 	USB->DADDR = USB_DADDR_EF;
+	/*A reset can end the suspend as well.*/
+	prev_state = NULL;
+	resume_cnt = 0;
+	esof_cnt = 0;
+	iso_pending = 0;
+	CLEAR(USB->CNTR, (USB_CNTR_RESUME | USB_CNTR_LPMODE | USB_CNTR_FSUSP));
+	SET(USB->CNTR, USB_CNTR_ESOFM);
+#if USBD_CORE_STATS
+	resume_measure = false;
+	enum_measure = true;
+	enum_start = core_stats;
+	enum_start_cycles = DWT->CYCCNT;
+#endif
+#if USBD_LPM
+	l1_active = false;
+	l1_measure = false;
+#endif
 }
 
+/**
+ * @brief The bus got suspended. Saves the endpoints and, if
+ * USBD_SUSPEND_LOW_POWER is set, puts the transceiver in low power mode.
+ * @param  
+ */
+static void usbd_enter_suspend(void)
+{
+	/*A second suspend interrupt keeps the state saved by the first.*/
+	if (cur_state != &suspended_state)
+	{
+		prev_state = cur_state;
+		cur_state = &suspended_state;
+	}
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		ep_saved[i] = *USBD_EP_REG(i);
+	}
+	/*The SOFs missed before the suspend was detected don't count, and ESOF
+	would wake the MCU every ms.*/
+	esof_cnt = 0;
+	CLEAR(USB->CNTR, USB_CNTR_ESOFM);
+	if (USBD_DRV(suspend) != NULL)
+	{
+		USBD_DRV(suspend)();
+	}
+#if USBD_SUSPEND_LOW_POWER
+	/*FSUSP has to be set before LPMODE.*/
+	SET(USB->CNTR, USB_CNTR_FSUSP);
+	SET(USB->CNTR, USB_CNTR_LPMODE);
+#endif
+}
+
+/**
+ * @brief The bus resumed (or the device woke it up). Leaves the low power
+ * mode, restores the state and re-arms the endpoints that lost their
+ * configuration, without a bus reset.
+ * @param  
+ */
+static void usbd_leave_suspend(void)
+{
+	__IO uint16_t *reg;
+
+	CLEAR(USB->CNTR, (USB_CNTR_LPMODE | USB_CNTR_FSUSP));
+	SET(USB->CNTR, USB_CNTR_ESOFM);
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		reg = USBD_EP_REG(i);
+		if ((ep_handler[i][0] != NULL || ep_handler[i][1] != NULL) && (*reg & (USB_EP_TYPE | USB_EP_KIND | USB_EP_EA)) != (ep_saved[i] & (USB_EP_TYPE | USB_EP_KIND | USB_EP_EA)))
+		{
+			*reg = USBD_EP_CONFIGURATION(*reg, (ep_saved[i] & USB_EP_TYPE), (ep_saved[i] & USB_EP_KIND), (ep_saved[i] & USB_EP_EA), (ep_saved[i] & USBD_EP_T), USBD_EP_T);
+		}
+	}
+	/*usbd_remote_wakeup() may have already restored the state.*/
+	if (prev_state != NULL)
+	{
+		cur_state = prev_state;
+		prev_state = NULL;
+	}
+#if USBD_CORE_STATS
+	resume_start = DWT->CYCCNT;
+	resume_measure = true;
+#endif
+}
+
+/**
+ * @brief Copies the isochronous packets scheduled for the next frame into the
+ * buffers not used by the peripheral.
+ * @param fn Frame number of the current start of frame.
+ */
+static void usbd_iso_tx(uint16_t fn)
+{
+	uint16_t d;
+
+	for (uint8_t ep = 0; ep < 8; ep++)
+	{
+		if (!GET(iso_pending, (1U << ep)))
+		{
+			continue;
+		}
+		d = (iso_tx[ep].frame - fn - 1U) & USB_FNR_FN;
+		if (!d)
+		{
+			if (GET(*USBD_EP_REG(ep), USB_EP_DTOG_TX))
+			{
+				usbd_pma_write(USBD_PMA_GET_TX0_ADDR(ep), (uint8_t*)iso_tx[ep].buf, iso_tx[ep].cnt);
+				USBD_PMA_SET_TX0_COUNT(ep, iso_tx[ep].cnt);
+			}
+			else
+			{
+				usbd_pma_write(USBD_PMA_GET_TX1_ADDR(ep), (uint8_t*)iso_tx[ep].buf, iso_tx[ep].cnt);
+				USBD_PMA_SET_TX1_COUNT(ep, iso_tx[ep].cnt);
+			}
+		}
+		/*More than half the frame range ahead means the frame has passed.*/
+		else if (d > (USB_FNR_FN >> 0x1U))
+		{
+#if USBD_CORE_STATS
+			core_stats.iso_late++;
+#endif
+		}
+		else
+		{
+			continue;
+		}
+		CLEAR(iso_pending, (1U << ep));
+	}
+}
+
+#if USBD_LPM
+/**
+ * @brief The host sent an LPM token that has been acknowledged, enter L1.
+ * @param  
+ */
+static void usbd_l1_enter(void)
+{
+	uint16_t lpmcsr = USB->LPMCSR;
+
+	l1_active = true;
+	l1_measure = false;
+	l1_frame = GET(USB->FNR, USB_FNR_FN);
+	l1_remote_wake = GET(lpmcsr, USB_LPMCSR_REMWAKE) ? true : false;
+#if USBD_CORE_STATS
+	core_stats.l1_count++;
+#endif
+	/*Same as suspend, but the host resumes within BESL microseconds.*/
+	esof_cnt = 0;
+	CLEAR(USB->CNTR, USB_CNTR_ESOFM);
+	SET(USB->CNTR, USB_CNTR_FSUSP);
+	SET(USB->CNTR, USB_CNTR_LPMODE);
+	if (USBD_DRV(l1_enter) != NULL)
+	{
+		USBD_DRV(l1_enter)((GET(lpmcsr, USB_LPMCSR_BESL) >> USB_LPMCSR_BESL_Pos), l1_remote_wake);
+	}
+}
+
+/**
+ * @brief Resume signaling ended L1, return to L0.
+ * @param  
+ */
+static void usbd_l1_exit(void)
+{
+	CLEAR(USB->CNTR, (USB_CNTR_LPMODE | USB_CNTR_FSUSP));
+	SET(USB->CNTR, USB_CNTR_ESOFM);
+	l1_active = false;
+	l1_measure = true;
+	if (USBD_DRV(l1_exit) != NULL)
+	{
+		USBD_DRV(l1_exit)();
+	}
+}
+#endif
+
+#if USBD_BCD
+/**
+ * @brief Busy waits on the DWT cycle counter, one millisecond being
+ * SystemCoreClock / 1000 cycles.
+ * @param ms Delay in milliseconds.
+ */
+static void usbd_bcd_delay_ms(uint32_t ms)
+{
+	uint32_t start;
+
+	while (ms--)
+	{
+		start = DWT->CYCCNT;
+		while (DWT->CYCCNT - start < SystemCoreClock / 1000U)
+		{
+		}
+	}
+}
+
+/**
+ * @brief Battery Charging 1.2 detection, data contact detection followed by
+ * the primary and the secondary detection.
+ * @note Has to run before the pull-up is enabled.
+ * @param  
+ */
+static void usbd_bcd_detect(void)
+{
+	uint8_t port;
+	uint16_t current_ma;
+	bool contact = false;
+
+	SET(USB->BCDR, USB_BCDR_BCDEN);
+	/*Data contact detection.*/
+	SET(USB->BCDR, USB_BCDR_DCDEN);
+	for (uint32_t i = 0; i < USBD_BCD_DCD_TIMEOUT_MS; i++)
+	{
+		if (GET(USB->BCDR, USB_BCDR_DCDET))
+		{
+			contact = true;
+			break;
+		}
+		usbd_bcd_delay_ms(1);
+	}
+	CLEAR(USB->BCDR, USB_BCDR_DCDEN);
+	usbd_bcd_delay_ms(USBD_BCD_DCD_DEBOUNCE_MS);
+
+	/*Primary detection, tells a standard port from a charging one.*/
+	SET(USB->BCDR, USB_BCDR_PDEN);
+	usbd_bcd_delay_ms(USBD_BCD_DETECTION_MS);
+	if (GET(USB->BCDR, USB_BCDR_PS2DET))
+	{
+		port = USBD_BCD_PORT_PS2;
+		current_ma = 500;
+	}
+	else if (!GET(USB->BCDR, USB_BCDR_PDET))
+	{
+		port = USBD_BCD_PORT_SDP;
+		current_ma = 100;
+	}
+	else
+	{
+		/*Secondary detection, tells a charging port from a dedicated one.*/
+		CLEAR(USB->BCDR, USB_BCDR_PDEN);
+		usbd_bcd_delay_ms(USBD_BCD_DETECTION_MS);
+		SET(USB->BCDR, USB_BCDR_SDEN);
+		usbd_bcd_delay_ms(USBD_BCD_DETECTION_MS);
+		port = GET(USB->BCDR, USB_BCDR_SDET) ? USBD_BCD_PORT_DCP : USBD_BCD_PORT_CDP;
+		current_ma = 1500;
+	}
+	CLEAR(USB->BCDR, (USB_BCDR_PDEN | USB_BCDR_SDEN));
+	CLEAR(USB->BCDR, USB_BCDR_BCDEN);
+
+	if (USBD_DRV(charger_detected) != NULL)
+	{
+		USBD_DRV(charger_detected)(port, current_ma, contact);
+	}
+}
+#endif
+
 /**
  * @brief Handle the usb interrupts.
  * @note This function should be called by USB_IRQHandler interrupt callback.
@@ -771,10 +1235,29 @@ static void usbd_irq_handler(void)
 {
 	uint32_t istr = USB->ISTR;
 
+#if USBD_RECORD
+	usbd_record_irq((uint16_t)istr);
+#endif
 	if (GET(istr, USB_ISTR_CTR))
 	{
 		uint8_t ep = GET(istr, USB_EP_EA);
 		uint8_t dir = GET(*USBD_EP_REG(ep), USB_EP_CTR_TX) ? 1 : 0;
+#if USBD_CORE_STATS
+		if (resume_measure)
+		{
+			uint32_t cycles = DWT->CYCCNT - resume_start;
+			resume_measure = false;
+			core_stats.resume_count++;
+			core_stats.resume_cycles += cycles;
+			if (cycles > core_stats.resume_cycles_max)
+			{
+				core_stats.resume_cycles_max = cycles;
+			}
+		}
+#endif
+#if USBD_CAPTURE
+		usbd_capture_begin(ep, dir);
+#endif
 		if (dir)
 		{
 			USBD_EP_CLEAR_CTR_TX(ep);
@@ -786,10 +1269,18 @@ static void usbd_irq_handler(void)
 
 		if (USBD_EP_GET_SETUP(ep))
 		{
+			/*A stalled request is left in the setup stage, it has nothing to abort.*/
+			if (stage != NULL && stage != usbd_setup_stage)
+			{
+				usbd_ep0_abort();
+			}
 			stage = usbd_setup_stage;
 		}
 		ASSERT(ep_handler[ep][dir] != NULL);
 		ep_handler[ep][dir]();
+#if USBD_CAPTURE
+		usbd_capture_end(ep, dir);
+#endif
 	}
 
 	if (GET(istr, USB_ISTR_RESET))
@@ -798,36 +1289,90 @@ static void usbd_irq_handler(void)
 		usbd_reset();
 	}
 
+#if USBD_LPM
+	if (GET(istr, USB_ISTR_L1REQ))
+	{
+		CLEAR(istr, USB_ISTR_L1REQ);
+		usbd_l1_enter();
+	}
+#endif
+
 	if (GET(istr, USB_ISTR_WKUP))
 	{
 		CLEAR(istr, USB_ISTR_WKUP);
-		cur_state = prev_state;
-		prev_state = NULL;
-		if (drv->wakeup != NULL)
+#if USBD_LPM
+		if (l1_active)
+		{
+			usbd_l1_exit();
+		}
+		else
+#endif
 		{
-			drv->wakeup();
+			usbd_leave_suspend();
+			if (USBD_DRV(wakeup) != NULL)
+			{
+				USBD_DRV(wakeup)();
+			}
 		}
 	}
 
 	if (GET(istr, USB_ISTR_SUSP))
 	{
 		CLEAR(istr, USB_ISTR_SUSP);
-		prev_state = cur_state;
-		cur_state = &suspended_state;
-		if (drv->suspend != NULL)
-		{
-			drv->suspend();
-		}	
+		usbd_enter_suspend();
+	}
 
-	}	
+	if (GET(istr, USB_ISTR_ESOF))
+	{
+		CLEAR(istr, USB_ISTR_ESOF);
+		/*usbd_remote_wakeup() times RESUME with the ESOF interrupt.*/
+		if (resume_cnt)
+		{
+			if (!--resume_cnt)
+			{
+				CLEAR(USB->CNTR, USB_CNTR_RESUME);
+			}
+		}
+		/*Without the lock the frame timer isn't synchronized to the host yet.*/
+		else if (GET(USB->FNR, USB_FNR_LCK) && esof_cnt < UINT8_MAX)
+		{
+			esof_cnt++;
+		}
+	}
 
 	if (GET(istr, USB_ISTR_SOF))
 	{
 		CLEAR(istr, USB_ISTR_SOF);
-		if (drv->sof != NULL)
+#if USBD_CORE_STATS
+		core_stats.sof_count++;
+#endif
+#if USBD_CAPTURE
+		usbd_capture_tick();
+#endif
+#if USBD_LPM && USBD_CORE_STATS
+		if (l1_measure)
+		{
+			l1_measure = false;
+			core_stats.l1_frames += (GET(USB->FNR, USB_FNR_FN) - l1_frame) & USB_FNR_FN;
+		}
+#endif
+		uint16_t fn = GET(USB->FNR, USB_FNR_FN);
+		if (iso_pending)
 		{
-			drv->sof();
+			usbd_iso_tx(fn);
 		}
+		if (USBD_DRV(sof) != NULL)
+		{
+			USBD_DRV(sof)();
+		}
+#if USBD_CORE_STATS
+		core_stats.missed_sof += esof_cnt;
+#endif
+		if (USBD_DRV(sof_frame) != NULL)
+		{
+			USBD_DRV(sof_frame)(fn, esof_cnt);
+		}
+		esof_cnt = 0;
 	}
 
 	USB->ISTR = istr;
@@ -951,6 +1496,9 @@ void usbd_pma_write(uint16_t tx_addr, uint8_t* buf, uint16_t cnt)
 	uint16_t half_cnt = (cnt >> 0x1U), tmp_val;
 	__IO uint16_t* dst = (__IO uint16_t*) (PMA_BASE + tx_addr);
 
+#if USBD_CORE_STATS
+	core_stats.pma_write_bytes += cnt;
+#endif
 	/*Copy to packet buffer area.*/
 	while (half_cnt--)
 	{
@@ -979,6 +1527,9 @@ void usbd_pma_read(uint16_t rx_addr, uint8_t* buf, uint16_t cnt)
 	uint16_t half_cnt = (cnt >> 0x1U), tmp_val;
 	__IO uint16_t* src = (__IO uint16_t*) (PMA_BASE + rx_addr);
 
+#if USBD_CORE_STATS
+	core_stats.pma_read_bytes += cnt;
+#endif
 	/*Copy from packet buffer area.*/
 	while (half_cnt--)
 	{
@@ -1003,6 +1554,9 @@ void usbd_pma_read(uint16_t rx_addr, uint8_t* buf, uint16_t cnt)
 void usbd_prepare_data_in_stage(uint8_t* buf, uint32_t cnt)
 {
 	ASSERT(buf != NULL);
+	/*Never send more than the host asked for.*/
+	cnt = MIN(cnt, ep0_wlength);
+	ep0_zlp = cnt && cnt < ep0_wlength && !(cnt % EP0_COUNT);
 	ep0_buf = buf;
 	ep0_cnt = cnt;
 	stage = usbd_data_in_stage;
@@ -1031,14 +1585,21 @@ void usbd_prepare_data_out_stage(uint8_t* buf, uint32_t cnt, void (*rx_cplt)(voi
 {
 	ASSERT(buf != NULL);
 	ASSERT(cnt);
-	ep0_buf = buf;
-	ep0_cnt = cnt;
-	stage = usbd_data_out_stage;
+	/*The host sends at most wLength bytes, don't wait for more.*/
+	cnt = MIN(cnt, ep0_wlength);
 	/*Store the pointer to the callback*/
 	if (rx_cplt != NULL)
 	{
 		reception_completed = rx_cplt;
 	}
+	if (!cnt)
+	{
+		usbd_prepare_status_in_stage();
+		return;
+	}
+	ep0_buf = buf;
+	ep0_cnt = cnt;
+	stage = usbd_data_out_stage;
 	/*Prepare the other direction*/
 	if (ep0_cnt > EP0_COUNT)
 	{
@@ -1066,11 +1627,16 @@ void usbd_prepare_status_in_stage(void)
 /**
  * @brief Initializes the usbd_core.
  * @param core_driver Pointer to usbd_core_driver struct that provides callback implementations.
+ * Unused when USBD_STATIC_DRIVER is set, the usbd_driver_ functions are called instead.
  */
 void usbd_core_init(struct usbd_core_driver* core_driver)
 {
+#if USBD_STATIC_DRIVER
+	UNUSED(core_driver);
+#else
 	ASSERT(core_driver != NULL);
 	drv = core_driver;
+#endif
 	cur_state = &default_state;
 
 	/*Prepare the hardware.*/
@@ -1088,19 +1654,188 @@ void usbd_core_init(struct usbd_core_driver* core_driver)
 	/*Remove force reset.*/
 	CLEAR(USB->CNTR, USB_CNTR_FRES);
 	/*Enable interrupts.*/
-	SET(USB->CNTR, (USB_CNTR_CTRM | USB_CNTR_RESETM | USB_CNTR_SUSPM | USB_CNTR_WAKEUPM | USB_CNTR_SOFM));
+	SET(USB->CNTR, (USB_CNTR_CTRM | USB_CNTR_RESETM | USB_CNTR_SUSPM | USB_CNTR_WAKEUPM | USB_CNTR_SOFM | USB_CNTR_ESOFM));
+#if USBD_LPM
+	/*Acknowledge LPM tokens and get an interrupt for each of them.*/
+	SET(USB->LPMCSR, (USB_LPMCSR_LMPEN | USB_LPMCSR_LPMACK));
+	SET(USB->CNTR, USB_CNTR_L1REQM);
+#endif
 	/*Clear pending interrupts*/
 	USB->ISTR = 0x0U;
 
+#if USBD_CORE_STATS || USBD_CAPTURE || USBD_RECORD || USBD_BCD
+	/*Enable the DWT cycle counter.*/
+	SET(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+	SET(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+#endif
+#if USBD_RECORD
+	usbd_record_start();
+#endif
+
+#if USBD_BCD
+	usbd_bcd_detect();
+#endif
+
 	/*Enable the usb DP pullup to connect to host.*/
 	SET(USB->BCDR, USB_BCDR_DPPU);
 }
 
+/**
+ * @brief Wake up the host. From suspend the low power mode is left and
+ * RESUME is driven for USBD_REMOTE_WAKEUP_MS, timed by the ESOF interrupt.
+ * From L1 the hardware times the L1 resume signaling.
+ * @note The clocks have to be running again before calling it.
+ * @param  
+ * @return false if the device isn't suspended or the host hasn't enabled remote wakeup.
+ */
+bool usbd_remote_wakeup(void)
+{
+	uint32_t primask;
+	bool ret = false;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+#if USBD_LPM
+	if (l1_active)
+	{
+		if (l1_remote_wake)
+		{
+			CLEAR(USB->CNTR, USB_CNTR_LPMODE);
+			SET(USB->CNTR, USB_CNTR_L1RESUME);
+			ret = true;
+		}
+		__set_PRIMASK(primask);
+		return ret;
+	}
+#endif
+	if (cur_state == &suspended_state && !resume_cnt && USBD_DRV(get_remote_wakeup) != NULL && USBD_DRV(get_remote_wakeup)())
+	{
+		usbd_leave_suspend();
+		SET(USB->CNTR, USB_CNTR_RESUME);
+		resume_cnt = USBD_REMOTE_WAKEUP_MS;
+		/*Drop an old ESOF, so the first period counts from now.*/
+		USB->ISTR = (uint16_t)~USB_ISTR_ESOF;
+		ret = true;
+	}
+	__set_PRIMASK(primask);
+	return ret;
+}
+
+/**
+ * @brief Hands the MCU off to the stop_mode callback while the bus is
+ * suspended. Interrupts stay disabled until the callback returns, so a
+ * wakeup that arrives before the stop mode is entered is not lost, the
+ * pending interrupt ends the stop mode right away.
+ * @note Should be called from the main loop.
+ * @param  
+ * @return true if the stop_mode callback has been called.
+ */
+bool usbd_low_power_poll(void)
+{
+	uint32_t primask;
+	bool ret = false;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (cur_state == &suspended_state && !resume_cnt && USBD_DRV(stop_mode) != NULL)
+	{
+		USBD_DRV(stop_mode)();
+		ret = true;
+	}
+	__set_PRIMASK(primask);
+	return ret;
+}
+
+/**
+ * @brief Get the frame number of the last start of frame.
+ * @param  
+ * @return The 11-bit frame number.
+ */
+uint16_t usbd_get_frame_number(void)
+{
+	return GET(USB->FNR, USB_FNR_FN);
+}
+
+/**
+ * @brief Schedules a packet of an isochronous IN endpoint for a frame. The
+ * packet is copied at the start of the previous frame into the buffer not
+ * used by the peripheral, so it is sent in the requested frame.
+ * @note The endpoint has to be registered with usbd_register_ep_dbl_tx() and
+ * buf has to stay untouched until the packet has been copied. A packet whose
+ * frame has passed is dropped and counted in iso_late (USBD_CORE_STATS).
+ * @param ep Endpoint number.
+ * @param buf Pointer to the packet.
+ * @param cnt Size of the packet.
+ * @param frame 11-bit frame number the packet is sent in.
+ * @return false if a packet is already scheduled on the endpoint.
+ */
+bool usbd_iso_schedule_tx(uint8_t ep, const uint8_t *buf, uint16_t cnt, uint16_t frame)
+{
+	uint32_t primask;
+
+	ASSERT(ep < 8);
+	ASSERT(buf != NULL || !cnt);
+	ASSERT(GET(*USBD_EP_REG(ep), USB_EP_TYPE) == USB_EP_TYPE_ISOCHRONOUS);
+	if (GET(iso_pending, (1U << ep)))
+	{
+		return false;
+	}
+	iso_tx[ep].buf = buf;
+	iso_tx[ep].cnt = cnt;
+	iso_tx[ep].frame = frame & USB_FNR_FN;
+	primask = __get_PRIMASK();
+	__disable_irq();
+	SET(iso_pending, (1U << ep));
+	__set_PRIMASK(primask);
+	return true;
+}
+
+/**
+ * @brief Get the core counters. They stay zero unless USBD_CORE_STATS is set.
+ * @param stats Pointer to usbd_core_stats struct that receives the counters.
+ */
+void usbd_core_get_stats(struct usbd_core_stats *stats)
+{
+	uint32_t primask;
+
+	ASSERT(stats != NULL);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	*stats = core_stats;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Clear the core counters.
+ * @param  
+ */
+void usbd_core_reset_stats(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	core_stats = (struct usbd_core_stats){ 0 };
+	__set_PRIMASK(primask);
+}
+
 /**
  * @brief Implementation of the weak function USB_IRQHandler.
  * @param  
  */
 void USB_IRQHandler(void)
 {
+#if USBD_CORE_STATS
+	uint32_t start = DWT->CYCCNT;
+	uint32_t cycles;
+	usbd_irq_handler();
+	cycles = DWT->CYCCNT - start;
+	core_stats.irq_cycles += cycles;
+	core_stats.irq_count++;
+	if (cycles > core_stats.irq_cycles_max)
+	{
+		core_stats.irq_cycles_max = cycles;
+	}
+#else
 	usbd_irq_handler();
+#endif
 }
\ No newline at end of file
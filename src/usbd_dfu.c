@@ -0,0 +1,458 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_dfu.h"
+
+/************************************************
+ * Block buffer states.
+ ***********************************************/
+#define USBD_DFU_BLOCK_FREE 0x0U /*!< Can receive the next block.*/
+#define USBD_DFU_BLOCK_FULL 0x1U /*!< Received, waiting for usbd_dfu_poll().*/
+#define USBD_DFU_BLOCK_PROGRAMMING 0x2U /*!< Inside the write callback.*/
+
+/************************************************
+ * @brief A downloaded block.
+ ***********************************************/
+struct usbd_dfu_block
+{
+	uint8_t buf[USBD_DFU_TRANSFER_SIZE]; /*!< Block data.*/
+	uint16_t num; /*!< wValue of the DNLOAD request.*/
+	uint16_t len; /*!< wLength of the DNLOAD request.*/
+	__IO uint8_t state; /*!< One of USBD_DFU_BLOCK.*/
+};
+
+/************************************************
+ * Static variables used by the DFU class.
+ ***********************************************/
+static const struct usbd_dfu_config *cfg; /*!< Pointer to the configuration provided by the user during initialization.*/
+static struct usbd_dfu_block blocks[2]; /*!< One block is received while the other is programmed.*/
+static uint8_t rx_idx; /*!< Block buffer that receives the next DNLOAD.*/
+static uint8_t prog_idx; /*!< Block buffer that is programmed next.*/
+static __IO uint8_t state; /*!< bState.*/
+static __IO uint8_t status; /*!< bStatus.*/
+static __IO bool manifest_done; /*!< Manifestation has been completed (manifestation tolerant devices).*/
+static __IO uint32_t frame; /*!< Frame counter, used as a ms time base.*/
+static uint32_t prog_start; /*!< Frame the current write callback started.*/
+static uint32_t prog_ms; /*!< Estimated time needed to program a block.*/
+static uint32_t download_start; /*!< Frame of the first DNLOAD.*/
+static struct usbd_dfu_status_type status_buf; /*!< GETSTATUS data stage.*/
+static uint8_t state_buf; /*!< GETSTATE data stage.*/
+static struct usbd_dfu_stats stats; /*!< Counters.*/
+
+/************************************************
+ * Function prototypes.
+ ***********************************************/
+static void usbd_dfu_flush(void);
+static void usbd_dfu_error(uint8_t err);
+static uint32_t usbd_dfu_remaining(void);
+static void usbd_dfu_dnload_cplt(void);
+static void usbd_dfu_dnload(struct usbd_setup_packet_type setup);
+static void usbd_dfu_upload(struct usbd_setup_packet_type setup);
+static void usbd_dfu_getstatus(struct usbd_setup_packet_type setup);
+
+/**
+ * @brief Drops the blocks that haven't been programmed yet. A block inside
+ * the write callback is left to usbd_dfu_poll().
+ * @note Interrupts must be disabled when called from the main loop.
+ * @param
+ */
+static void usbd_dfu_flush(void)
+{
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		if (blocks[i].state == USBD_DFU_BLOCK_FULL)
+		{
+			blocks[i].state = USBD_DFU_BLOCK_FREE;
+		}
+	}
+	if (blocks[rx_idx].state != USBD_DFU_BLOCK_FREE)
+	{
+		rx_idx ^= 1U;
+	}
+	/*A block that is being programmed is followed by the next received one.*/
+	prog_idx = (blocks[rx_idx ^ 1U].state == USBD_DFU_BLOCK_PROGRAMMING) ? (rx_idx ^ 1U) : rx_idx;
+}
+
+/**
+ * @brief Enter the dfuERROR state.
+ * @note Interrupts must be disabled when called from the main loop.
+ * @param err One of USBD_DFU_STATUS.
+ */
+static void usbd_dfu_error(uint8_t err)
+{
+	usbd_dfu_flush();
+	status = err;
+	state = USBD_DFU_STATE_ERROR;
+}
+
+/**
+ * @brief Estimates the time until the block buffer that receives the next
+ * DNLOAD is free.
+ * @param
+ * @return Time in ms.
+ */
+static uint32_t usbd_dfu_remaining(void)
+{
+	uint32_t elapsed;
+
+	if (blocks[rx_idx].state == USBD_DFU_BLOCK_FREE)
+	{
+		return 0;
+	}
+	if (blocks[rx_idx].state == USBD_DFU_BLOCK_FULL)
+	{
+		return prog_ms;
+	}
+	elapsed = frame - prog_start;
+	return (elapsed < prog_ms) ? (prog_ms - elapsed) : 1U;
+}
+
+/**
+ * @brief DNLOAD data stage completion callback function.
+ * @param
+ */
+static void usbd_dfu_dnload_cplt(void)
+{
+	blocks[rx_idx].state = USBD_DFU_BLOCK_FULL;
+	rx_idx ^= 1U;
+	state = USBD_DFU_STATE_DNLOAD_SYNC;
+}
+
+/**
+ * @brief DNLOAD request handler.
+ * @param setup USB setup packet.
+ */
+static void usbd_dfu_dnload(struct usbd_setup_packet_type setup)
+{
+	if (state != USBD_DFU_STATE_IDLE && state != USBD_DFU_STATE_DNLOAD_IDLE)
+	{
+		usbd_dfu_error(USBD_DFU_STATUS_ERR_STALLEDPKT);
+		USBD_EP0_SET_STALL();
+		return;
+	}
+	if (!setup.wLength)
+	{
+		/*A zero length DNLOAD ends the download.*/
+		if (state == USBD_DFU_STATE_IDLE)
+		{
+			usbd_dfu_error(USBD_DFU_STATUS_ERR_STALLEDPKT);
+			USBD_EP0_SET_STALL();
+			return;
+		}
+		manifest_done = false;
+		state = USBD_DFU_STATE_MANIFEST_SYNC;
+		usbd_prepare_status_in_stage();
+		return;
+	}
+	/*dfuDNLOAD-IDLE is only reported while a block buffer is free.*/
+	if (setup.wLength > cfg->transfer_size || blocks[rx_idx].state != USBD_DFU_BLOCK_FREE)
+	{
+		usbd_dfu_error(USBD_DFU_STATUS_ERR_STALLEDPKT);
+		USBD_EP0_SET_STALL();
+		return;
+	}
+	if (state == USBD_DFU_STATE_IDLE)
+	{
+		download_start = frame;
+	}
+	blocks[rx_idx].num = setup.wValue;
+	blocks[rx_idx].len = setup.wLength;
+	usbd_prepare_data_out_stage(blocks[rx_idx].buf, setup.wLength, usbd_dfu_dnload_cplt);
+}
+
+/**
+ * @brief UPLOAD request handler, a short block ends the upload.
+ * @param setup USB setup packet.
+ */
+static void usbd_dfu_upload(struct usbd_setup_packet_type setup)
+{
+	uint16_t len;
+	uint8_t idx = rx_idx;
+
+	if (cfg->read == NULL || (state != USBD_DFU_STATE_IDLE && state != USBD_DFU_STATE_UPLOAD_IDLE) ||
+		setup.wLength > cfg->transfer_size || blocks[idx].state != USBD_DFU_BLOCK_FREE)
+	{
+		usbd_dfu_error(USBD_DFU_STATUS_ERR_STALLEDPKT);
+		USBD_EP0_SET_STALL();
+		return;
+	}
+	len = cfg->read(setup.wValue, blocks[idx].buf, setup.wLength);
+	state = (len < setup.wLength) ? USBD_DFU_STATE_IDLE : USBD_DFU_STATE_UPLOAD_IDLE;
+	usbd_prepare_data_in_stage(blocks[idx].buf, len);
+}
+
+/**
+ * @brief GETSTATUS request handler. While a block buffer is free the host
+ * is told to send the next block right away, otherwise bwPollTimeout is the
+ * measured time left until the block being programmed is done.
+ * @param setup USB setup packet.
+ */
+static void usbd_dfu_getstatus(struct usbd_setup_packet_type setup)
+{
+	uint32_t timeout = 0;
+
+	switch (state)
+	{
+		case USBD_DFU_STATE_DNLOAD_SYNC:
+		case USBD_DFU_STATE_DNBUSY:
+		{
+			timeout = usbd_dfu_remaining();
+			if (timeout)
+			{
+				state = USBD_DFU_STATE_DNBUSY;
+				stats.busy++;
+			}
+			else
+			{
+				state = USBD_DFU_STATE_DNLOAD_IDLE;
+			}
+			break;
+		}
+		case USBD_DFU_STATE_MANIFEST_SYNC:
+		{
+			if (manifest_done)
+			{
+				manifest_done = false;
+				state = USBD_DFU_STATE_IDLE;
+				break;
+			}
+			state = USBD_DFU_STATE_MANIFEST;
+		}
+		/*Fall through.*/
+		case USBD_DFU_STATE_MANIFEST:
+		{
+			timeout = usbd_dfu_remaining() + prog_ms;
+			break;
+		}
+		default:
+		{
+			break;
+		}
+	}
+
+	status_buf.bStatus = status;
+	status_buf.bwPollTimeout[0] = (timeout & 0xFFU);
+	status_buf.bwPollTimeout[1] = ((timeout >> 0x8U) & 0xFFU);
+	status_buf.bwPollTimeout[2] = ((timeout >> 0x10U) & 0xFFU);
+	status_buf.bState = state;
+	status_buf.iString = 0;
+	usbd_prepare_data_in_stage((uint8_t*)&status_buf, MIN(setup.wLength, USBD_DFU_GETSTATUS_LENGTH));
+}
+
+/**
+ * @brief Initializes the DFU class.
+ * @param config Pointer to usbd_dfu_config struct that describes the DFU function.
+ */
+void usbd_dfu_init(const struct usbd_dfu_config *config)
+{
+	ASSERT(config != NULL);
+	ASSERT(config->write != NULL);
+	ASSERT(config->transfer_size && config->transfer_size <= USBD_DFU_TRANSFER_SIZE);
+	cfg = config;
+	memset(&stats, 0, sizeof(stats));
+	prog_ms = config->poll_timeout ? config->poll_timeout : 1U;
+	usbd_dfu_configure();
+}
+
+/**
+ * @brief Returns to dfuIDLE, a block inside the write callback is allowed to
+ * finish.
+ * @note Should be called from the set_configuration callback.
+ * @param
+ */
+void usbd_dfu_configure(void)
+{
+	uint32_t primask;
+
+	ASSERT(cfg != NULL);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	usbd_dfu_flush();
+	manifest_done = false;
+	status = USBD_DFU_STATUS_OK;
+	state = USBD_DFU_STATE_IDLE;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief DFU class specific request handler.
+ * @note Should be called from the class_request callback.
+ * @param setup USB setup packet.
+ * @return false if the request isn't addressed to the DFU interface, true otherwise.
+ */
+bool usbd_dfu_class_request(struct usbd_setup_packet_type setup)
+{
+	ASSERT(cfg != NULL);
+	if ((setup.bmRequestType & USBD_RECIPIENT) != USBD_RECIPIENT_INTERFACE || (setup.wIndex & 0xFFU) != cfg->interface_num)
+	{
+		return false;
+	}
+
+	switch (setup.bRequest)
+	{
+		case USBD_DFU_DNLOAD:
+		{
+			usbd_dfu_dnload(setup);
+			break;
+		}
+		case USBD_DFU_UPLOAD:
+		{
+			usbd_dfu_upload(setup);
+			break;
+		}
+		case USBD_DFU_GETSTATUS:
+		{
+			usbd_dfu_getstatus(setup);
+			break;
+		}
+		case USBD_DFU_CLRSTATUS:
+		{
+			if (state != USBD_DFU_STATE_ERROR)
+			{
+				usbd_dfu_error(USBD_DFU_STATUS_ERR_STALLEDPKT);
+				USBD_EP0_SET_STALL();
+				break;
+			}
+			status = USBD_DFU_STATUS_OK;
+			state = USBD_DFU_STATE_IDLE;
+			usbd_prepare_status_in_stage();
+			break;
+		}
+		case USBD_DFU_GETSTATE:
+		{
+			state_buf = state;
+			usbd_prepare_data_in_stage(&state_buf, MIN(setup.wLength, USBD_DFU_GETSTATE_LENGTH));
+			break;
+		}
+		case USBD_DFU_ABORT:
+		{
+			if (state != USBD_DFU_STATE_IDLE && state != USBD_DFU_STATE_DNLOAD_SYNC &&
+				state != USBD_DFU_STATE_DNLOAD_IDLE && state != USBD_DFU_STATE_MANIFEST_SYNC &&
+				state != USBD_DFU_STATE_UPLOAD_IDLE)
+			{
+				usbd_dfu_error(USBD_DFU_STATUS_ERR_STALLEDPKT);
+				USBD_EP0_SET_STALL();
+				break;
+			}
+			usbd_dfu_flush();
+			state = USBD_DFU_STATE_IDLE;
+			usbd_prepare_status_in_stage();
+			break;
+		}
+		default:
+		{
+			/*DETACH is only valid in run-time mode.*/
+			usbd_dfu_error(USBD_DFU_STATUS_ERR_STALLEDPKT);
+			USBD_EP0_SET_STALL();
+			break;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Advances the ms time base used for bwPollTimeout.
+ * @note Should be called from the sof callback.
+ * @param
+ */
+void usbd_dfu_sof(void)
+{
+	frame++;
+}
+
+/**
+ * @brief Programs the next received block or runs the manifestation. USB
+ * interrupts stay enabled, so the host can send the next block meanwhile.
+ * @note Should be called from the main loop.
+ * @param
+ */
+void usbd_dfu_poll(void)
+{
+	struct usbd_dfu_block *blk;
+	uint32_t primask;
+	uint32_t elapsed;
+	uint8_t res;
+
+	ASSERT(cfg != NULL);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	blk = &blocks[prog_idx];
+	if (blk->state == USBD_DFU_BLOCK_FULL)
+	{
+		blk->state = USBD_DFU_BLOCK_PROGRAMMING;
+		prog_start = frame;
+		__set_PRIMASK(primask);
+
+		res = cfg->write(blk->num, blk->buf, blk->len);
+
+		__disable_irq();
+		elapsed = frame - prog_start;
+		/*Follow the measured programming time, one frame is the resolution.*/
+		prog_ms = (3U * prog_ms + elapsed + 3U) / 4U;
+		if (!prog_ms)
+		{
+			prog_ms = 1U;
+		}
+		stats.blocks++;
+		stats.bytes += blk->len;
+		stats.program_ms += elapsed;
+		blk->state = USBD_DFU_BLOCK_FREE;
+		prog_idx ^= 1U;
+		if (res != USBD_DFU_STATUS_OK)
+		{
+			usbd_dfu_error(res);
+		}
+		__set_PRIMASK(primask);
+		return;
+	}
+	if (state != USBD_DFU_STATE_MANIFEST || blocks[0].state != USBD_DFU_BLOCK_FREE || blocks[1].state != USBD_DFU_BLOCK_FREE)
+	{
+		__set_PRIMASK(primask);
+		return;
+	}
+	__set_PRIMASK(primask);
+
+	res = (cfg->manifest != NULL) ? cfg->manifest() : USBD_DFU_STATUS_OK;
+
+	__disable_irq();
+	stats.download_ms = frame - download_start;
+	if (res != USBD_DFU_STATUS_OK)
+	{
+		usbd_dfu_error(res);
+	}
+	else if (cfg->manifestation_tolerant)
+	{
+		manifest_done = true;
+		state = USBD_DFU_STATE_MANIFEST_SYNC;
+	}
+	else
+	{
+		state = USBD_DFU_STATE_MANIFEST_WAIT_RESET;
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Returns bState, the application can reset itself once the state is
+ * dfuMANIFEST-WAIT-RESET.
+ * @param
+ * @return One of USBD_DFU_STATE.
+ */
+uint8_t usbd_dfu_get_state(void)
+{
+	return state;
+}
+
+/**
+ * @brief Returns a copy of the counters.
+ * @param stats_out Pointer to usbd_dfu_stats struct that receives the counters.
+ */
+void usbd_dfu_get_stats(struct usbd_dfu_stats *stats_out)
+{
+	uint32_t primask;
+
+	ASSERT(stats_out != NULL);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	*stats_out = stats;
+	__set_PRIMASK(primask);
+}
@@ -0,0 +1,407 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_hid.h"
+
+/************************************************
+ * An input report waiting to be transmitted.
+ * A slot holds the latest state of a single
+ * report ID, so consecutive writes between two
+ * polls coalesce into one report.
+ ***********************************************/
+struct usbd_hid_report_slot
+{
+	bool used; /*!< The slot is assigned to a report ID.*/
+	bool pending; /*!< The report has changed since its last transmission.*/
+	uint8_t id; /*!< Report ID, 0 if the device doesn't use report IDs.*/
+	uint8_t idle; /*!< Idle rate in 4 ms units, 0 for infinite.*/
+	uint16_t idle_cnt; /*!< Frames since the last transmission of the report.*/
+	uint16_t len; /*!< Size of the report.*/
+	uint8_t buf[USBD_HID_MAX_REPORT_SIZE]; /*!< Report data, including the report ID.*/
+};
+
+/************************************************
+ * Static variables used by the HID class.
+ ***********************************************/
+static const struct usbd_hid_config *cfg; /*!< Pointer to the configuration provided by the user during initialization.*/
+static struct usbd_hid_report_slot slots[USBD_HID_REPORT_SLOTS]; /*!< Input report queue.*/
+static uint8_t next_slot; /*!< Next slot to be checked by the scheduler, used for round robin.*/
+static uint8_t frame_cnt; /*!< Frames since the last report has been armed.*/
+static uint8_t idle_default; /*!< Idle rate of report IDs that haven't been queued yet.*/
+static uint8_t protocol; /*!< Current protocol (boot or report).*/
+static __IO bool ep_busy; /*!< A report is armed and waits for the host to collect it.*/
+static uint8_t ctrl_buf[USBD_HID_MAX_REPORT_SIZE]; /*!< Buffer used for endpoint 0 data stages.*/
+static uint8_t ctrl_type; /*!< Report type of the pending SET_REPORT request.*/
+static uint8_t ctrl_id; /*!< Report ID of the pending SET_REPORT request.*/
+static uint16_t ctrl_len; /*!< Size of the pending SET_REPORT request.*/
+
+/************************************************
+ * Function prototypes.
+ ***********************************************/
+static struct usbd_hid_report_slot *usbd_hid_find_slot(uint8_t id);
+static void usbd_hid_transmit(struct usbd_hid_report_slot *slot);
+static void usbd_hid_ep_in(void);
+static void usbd_hid_set_report_cplt(void);
+static void usbd_hid_get_report(struct usbd_setup_packet_type setup);
+static void usbd_hid_set_report(struct usbd_setup_packet_type setup);
+static void usbd_hid_set_idle(struct usbd_setup_packet_type setup);
+
+/**
+ * @brief Find the queue slot of a report ID.
+ * @param id Report ID.
+ * @return Pointer to the slot, or NULL if the report ID hasn't been queued.
+ */
+static struct usbd_hid_report_slot *usbd_hid_find_slot(uint8_t id)
+{
+	for (uint8_t i = 0; i < USBD_HID_REPORT_SLOTS; i++)
+	{
+		if (slots[i].used && slots[i].id == id)
+		{
+			return &slots[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Copy a report to the PMA and arm the interrupt IN endpoint.
+ * @param slot Pointer to the slot that will be transmitted.
+ */
+static void usbd_hid_transmit(struct usbd_hid_report_slot *slot)
+{
+	usbd_pma_write(cfg->tx_addr, slot->buf, slot->len);
+	USBD_PMA_SET_TX_COUNT(cfg->ep, slot->len);
+	slot->pending = false;
+	slot->idle_cnt = 0;
+	frame_cnt = 0;
+	ep_busy = true;
+	USBD_EP_SET_STAT_TX(cfg->ep, USB_EP_STAT_TX_VALID);
+}
+
+/**
+ * @brief Interrupt IN endpoint callback function.
+ * @param
+ */
+static void usbd_hid_ep_in(void)
+{
+	ep_busy = false;
+}
+
+/**
+ * @brief SET_REPORT data stage completion callback function.
+ * @param
+ */
+static void usbd_hid_set_report_cplt(void)
+{
+	cfg->set_report(ctrl_type, ctrl_id, ctrl_buf, ctrl_len);
+}
+
+/**
+ * @brief HID GET_REPORT request. Input reports are served
+ * from the queue, everything else from the user.
+ * @param setup USB setup packet.
+ */
+static void usbd_hid_get_report(struct usbd_setup_packet_type setup)
+{
+	uint8_t type = ((setup.wValue >> 0x8U) & 0xFFU);
+	uint8_t id = (setup.wValue & 0xFFU);
+	uint16_t len = 0;
+	struct usbd_hid_report_slot *slot = usbd_hid_find_slot(id);
+
+	if (type == USBD_HID_REPORT_TYPE_INPUT && slot != NULL)
+	{
+		len = slot->len;
+		memcpy(ctrl_buf, slot->buf, len);
+	}
+	else if (cfg->get_report != NULL)
+	{
+		len = cfg->get_report(type, id, ctrl_buf, MIN(setup.wLength, sizeof(ctrl_buf)));
+	}
+
+	if (!len)
+	{
+		USBD_EP0_SET_STALL();
+		return;
+	}
+	usbd_prepare_data_in_stage(ctrl_buf, MIN(setup.wLength, len));
+}
+
+/**
+ * @brief HID SET_REPORT request.
+ * @param setup USB setup packet.
+ */
+static void usbd_hid_set_report(struct usbd_setup_packet_type setup)
+{
+	if (cfg->set_report == NULL || setup.wLength > sizeof(ctrl_buf))
+	{
+		USBD_EP0_SET_STALL();
+		return;
+	}
+	ctrl_type = ((setup.wValue >> 0x8U) & 0xFFU);
+	ctrl_id = (setup.wValue & 0xFFU);
+	ctrl_len = setup.wLength;
+
+	if (!ctrl_len)
+	{
+		usbd_hid_set_report_cplt();
+		usbd_prepare_status_in_stage();
+		return;
+	}
+	usbd_prepare_data_out_stage(ctrl_buf, ctrl_len, usbd_hid_set_report_cplt);
+}
+
+/**
+ * @brief HID SET_IDLE request. A report ID of 0 applies to every report.
+ * @param setup USB setup packet.
+ */
+static void usbd_hid_set_idle(struct usbd_setup_packet_type setup)
+{
+	uint8_t duration = ((setup.wValue >> 0x8U) & 0xFFU);
+	uint8_t id = (setup.wValue & 0xFFU);
+
+	for (uint8_t i = 0; i < USBD_HID_REPORT_SLOTS; i++)
+	{
+		if (!id || (slots[i].used && slots[i].id == id))
+		{
+			slots[i].idle = duration;
+			slots[i].idle_cnt = 0;
+		}
+	}
+	if (!id)
+	{
+		idle_default = duration;
+	}
+	usbd_prepare_status_in_stage();
+}
+
+/**
+ * @brief Initializes the HID class.
+ * @param config Pointer to usbd_hid_config struct that describes the HID function.
+ */
+void usbd_hid_init(const struct usbd_hid_config *config)
+{
+	ASSERT(config != NULL);
+	ASSERT(config->hid_descriptor != NULL);
+	ASSERT(config->report_descriptor != NULL);
+	ASSERT(config->interval);
+	cfg = config;
+	memset(slots, 0, sizeof(slots));
+	idle_default = 0;
+	protocol = USBD_HID_REPORT_PROTOCOL;
+	ep_busy = false;
+}
+
+/**
+ * @brief Registers the interrupt IN endpoint and resets the report queue.
+ * @note Should be called from the set_configuration callback.
+ * @param
+ */
+void usbd_hid_configure(void)
+{
+	ASSERT(cfg != NULL);
+	for (uint8_t i = 0; i < USBD_HID_REPORT_SLOTS; i++)
+	{
+		slots[i].pending = false;
+		slots[i].idle_cnt = 0;
+	}
+	next_slot = 0;
+	/*Allow the first report to be armed on the next frame.*/
+	frame_cnt = cfg->interval;
+	protocol = USBD_HID_REPORT_PROTOCOL;
+	ep_busy = false;
+	usbd_register_ep_tx(cfg->ep, USB_EP_TYPE_INTERRUPT, cfg->tx_addr, usbd_hid_ep_in);
+}
+
+/**
+ * @brief HID class specific request handler.
+ * @note Should be called from the class_request callback.
+ * @param setup USB setup packet.
+ * @return false if the request isn't addressed to the HID interface, true otherwise.
+ */
+bool usbd_hid_class_request(struct usbd_setup_packet_type setup)
+{
+	ASSERT(cfg != NULL);
+	if ((setup.bmRequestType & USBD_RECIPIENT) != USBD_RECIPIENT_INTERFACE || (setup.wIndex & 0xFFU) != cfg->interface_num)
+	{
+		return false;
+	}
+
+	switch (setup.bRequest)
+	{
+		case USBD_HID_GET_REPORT:
+		{
+			usbd_hid_get_report(setup);
+			break;
+		}
+		case USBD_HID_SET_REPORT:
+		{
+			usbd_hid_set_report(setup);
+			break;
+		}
+		case USBD_HID_GET_IDLE:
+		{
+			struct usbd_hid_report_slot *slot = usbd_hid_find_slot(setup.wValue & 0xFFU);
+			ctrl_buf[0] = (slot != NULL) ? slot->idle : idle_default;
+			usbd_prepare_data_in_stage(ctrl_buf, USBD_HID_GET_IDLE_LENGTH);
+			break;
+		}
+		case USBD_HID_SET_IDLE:
+		{
+			usbd_hid_set_idle(setup);
+			break;
+		}
+		case USBD_HID_GET_PROTOCOL:
+		{
+			ctrl_buf[0] = protocol;
+			usbd_prepare_data_in_stage(ctrl_buf, USBD_HID_GET_PROTOCOL_LENGTH);
+			break;
+		}
+		case USBD_HID_SET_PROTOCOL:
+		{
+			protocol = (setup.wValue & 0xFFU) ? USBD_HID_REPORT_PROTOCOL : USBD_HID_BOOT_PROTOCOL;
+			if (cfg->set_protocol != NULL)
+			{
+				cfg->set_protocol(protocol);
+			}
+			usbd_prepare_status_in_stage();
+			break;
+		}
+		default:
+		{
+			USBD_EP0_SET_STALL();
+			break;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Returns the HID and report descriptors.
+ * @note Should be called from the class_descriptor callback.
+ * @param setup USB setup packet.
+ * @param len Pointer that receives the size of the descriptor.
+ * @return Pointer to the descriptor, or NULL if the request isn't addressed to the HID interface.
+ */
+uint8_t *usbd_hid_get_descriptor(struct usbd_setup_packet_type setup, uint16_t *len)
+{
+	ASSERT(cfg != NULL);
+	ASSERT(len != NULL);
+	if ((setup.bmRequestType & USBD_RECIPIENT) != USBD_RECIPIENT_INTERFACE || (setup.wIndex & 0xFFU) != cfg->interface_num)
+	{
+		return NULL;
+	}
+
+	switch (((setup.wValue) >> 0x8U) & 0xFFU)
+	{
+		case USBD_DESC_TYPE_HID:
+		{
+			*len = USBD_LENGTH_HID_DESC;
+			return cfg->hid_descriptor;
+		}
+		case USBD_DESC_TYPE_HID_REPORT:
+		{
+			*len = cfg->report_descriptor_length;
+			return cfg->report_descriptor;
+		}
+		default:
+		{
+			return NULL;
+		}
+	}
+}
+
+/**
+ * @brief Queue an input report. If a report with the same ID is still waiting
+ * for the next poll it gets replaced, so only the latest state is transmitted.
+ * @param id Report ID, 0 if the device doesn't use report IDs.
+ * @param buf Pointer to the report, including the report ID byte if used.
+ * @param len Size of the report.
+ * @return false if the queue has no free slot for a new report ID.
+ */
+bool usbd_hid_send_report(uint8_t id, const uint8_t *buf, uint16_t len)
+{
+	struct usbd_hid_report_slot *slot;
+	uint32_t primask;
+
+	ASSERT(cfg != NULL);
+	ASSERT(buf != NULL);
+	ASSERT(len <= USBD_HID_MAX_REPORT_SIZE);
+
+	/*The SOF interrupt reads the queue, protect the slot while it's updated.*/
+	primask = __get_PRIMASK();
+	__disable_irq();
+	slot = usbd_hid_find_slot(id);
+	if (slot == NULL)
+	{
+		for (uint8_t i = 0; i < USBD_HID_REPORT_SLOTS; i++)
+		{
+			if (!slots[i].used)
+			{
+				slot = &slots[i];
+				slot->used = true;
+				slot->id = id;
+				slot->idle = idle_default;
+				slot->idle_cnt = 0;
+				break;
+			}
+		}
+	}
+	if (slot != NULL)
+	{
+		memcpy(slot->buf, buf, len);
+		slot->len = len;
+		slot->pending = true;
+	}
+	__set_PRIMASK(primask);
+	return slot != NULL;
+}
+
+/**
+ * @brief Report scheduler. Arms at most one report every bInterval frames,
+ * and repeats unchanged reports according to their idle rate.
+ * @note Should be called from the sof callback.
+ * @param
+ */
+void usbd_hid_sof(void)
+{
+	if (cfg == NULL)
+	{
+		return;
+	}
+	/*The endpoint gets disabled by a bus reset, until the device is configured again.*/
+	if (GET(*USBD_EP_REG(cfg->ep), USB_EP_STAT_TX) == USB_EP_STAT_TX_DISABLED)
+	{
+		return;
+	}
+
+	for (uint8_t i = 0; i < USBD_HID_REPORT_SLOTS; i++)
+	{
+		if (slots[i].used && slots[i].idle)
+		{
+			/*Idle rate is in 4 ms units, a full speed frame is 1 ms.*/
+			if (++slots[i].idle_cnt >= ((uint16_t)slots[i].idle << 0x2U))
+			{
+				slots[i].pending = true;
+			}
+		}
+	}
+
+	if (frame_cnt < cfg->interval)
+	{
+		frame_cnt++;
+	}
+	if (ep_busy || frame_cnt < cfg->interval)
+	{
+		return;
+	}
+
+	for (uint8_t i = 0; i < USBD_HID_REPORT_SLOTS; i++)
+	{
+		uint8_t num = (next_slot + i) % USBD_HID_REPORT_SLOTS;
+		if (slots[num].pending)
+		{
+			next_slot = (num + 1) % USBD_HID_REPORT_SLOTS;
+			usbd_hid_transmit(&slots[num]);
+			return;
+		}
+	}
+}
@@ -0,0 +1,282 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_midi.h"
+
+/************************************************
+ * Single producer, single consumer ring buffer
+ * of event packets. head is only written by the
+ * producer and tail only by the consumer.
+ ***********************************************/
+struct usbd_midi_fifo
+{
+	uint32_t buf[USBD_MIDI_FIFO_SIZE];
+	__IO uint32_t head;
+	__IO uint32_t tail;
+};
+
+/************************************************
+ * Static variables used by the MIDI class.
+ ***********************************************/
+static const struct usbd_midi_config *cfg; /*!< Pointer to the configuration provided by the user during initialization.*/
+static struct usbd_midi_fifo tx_fifo; /*!< Events to the host, the application is the producer.*/
+static struct usbd_midi_fifo rx_fifo; /*!< Events from the host, the interrupt handler is the producer.*/
+static uint16_t tx_frame[USBD_MIDI_FIFO_SIZE]; /*!< Frame each IN event has been queued, used for the latency.*/
+static uint32_t pkt[USBD_FS_MAX_PACKET_SIZE / USBD_MIDI_EVENT_SIZE]; /*!< Packet buffer.*/
+static __IO bool tx_busy; /*!< A packet is armed on the IN endpoint.*/
+static __IO bool rx_pending; /*!< An OUT packet waits inside the PMA for room in the ring buffer.*/
+static __IO uint16_t frame; /*!< Frame counter.*/
+static uint16_t tx_len; /*!< Events of the packet armed on the IN endpoint.*/
+static struct usbd_midi_stats stats; /*!< Counters.*/
+
+/************************************************
+ * Function prototypes.
+ ***********************************************/
+static void usbd_midi_tx(void);
+static void usbd_midi_rx(void);
+static void usbd_midi_ep_in(void);
+static void usbd_midi_ep_out(void);
+
+/**
+ * @brief Packs up to max_packet_size / 4 queued events into one bulk packet.
+ * @note Called from the interrupt handler, or with interrupts disabled.
+ * @param
+ */
+static void usbd_midi_tx(void)
+{
+	uint32_t tail = tx_fifo.tail;
+	uint32_t cnt = tx_fifo.head - tail;
+	uint16_t latency;
+
+	if (tx_busy || !cnt)
+	{
+		return;
+	}
+	cnt = MIN(cnt, (uint32_t)(cfg->max_packet_size / USBD_MIDI_EVENT_SIZE));
+	for (uint32_t i = 0; i < cnt; i++)
+	{
+		pkt[i] = tx_fifo.buf[(tail + i) & (USBD_MIDI_FIFO_SIZE - 1U)];
+	}
+	latency = frame - tx_frame[tail & (USBD_MIDI_FIFO_SIZE - 1U)];
+	__DMB();
+	tx_fifo.tail = tail + cnt;
+
+	stats.latency_sum += latency;
+	if (latency > stats.latency_max)
+	{
+		stats.latency_max = latency;
+	}
+	tx_len = cnt;
+	tx_busy = true;
+	usbd_pma_write(cfg->tx_addr, (uint8_t*)pkt, cnt * USBD_MIDI_EVENT_SIZE);
+	USBD_PMA_SET_TX_COUNT(cfg->in_ep, cnt * USBD_MIDI_EVENT_SIZE);
+	USBD_EP_SET_STAT_TX(cfg->in_ep, USB_EP_STAT_TX_VALID);
+}
+
+/**
+ * @brief Unpacks the received packet into the ring buffer and accepts the
+ * next one. Empty event packets (padding) are skipped.
+ * @note Called from the interrupt handler, or with interrupts disabled.
+ * @param
+ */
+static void usbd_midi_rx(void)
+{
+	uint16_t cnt = MIN(USBD_PMA_GET_RX_COUNT(cfg->out_ep), cfg->max_packet_size) / USBD_MIDI_EVENT_SIZE;
+	uint32_t head = rx_fifo.head;
+
+	usbd_pma_read(cfg->rx_addr, (uint8_t*)pkt, cnt * USBD_MIDI_EVENT_SIZE);
+	for (uint16_t i = 0; i < cnt; i++)
+	{
+		if (pkt[i])
+		{
+			rx_fifo.buf[head & (USBD_MIDI_FIFO_SIZE - 1U)] = pkt[i];
+			head++;
+		}
+	}
+	stats.events_out += head - rx_fifo.head;
+	stats.packets_out++;
+	__DMB();
+	rx_fifo.head = head;
+	rx_pending = false;
+	USBD_EP_SET_STAT_RX(cfg->out_ep, USB_EP_STAT_RX_VALID);
+}
+
+/**
+ * @brief Bulk IN endpoint callback function. A full packet is sent right
+ * away, a partial one waits for the next SOF.
+ * @param
+ */
+static void usbd_midi_ep_in(void)
+{
+	tx_busy = false;
+	stats.events_in += tx_len;
+	stats.packets_in++;
+	if ((tx_fifo.head - tx_fifo.tail) >= (uint32_t)(cfg->max_packet_size / USBD_MIDI_EVENT_SIZE))
+	{
+		usbd_midi_tx();
+	}
+}
+
+/**
+ * @brief Bulk OUT endpoint callback function. The endpoint stays NAK until
+ * the ring buffer has room for the whole packet.
+ * @param
+ */
+static void usbd_midi_ep_out(void)
+{
+	uint32_t cnt = USBD_PMA_GET_RX_COUNT(cfg->out_ep) / USBD_MIDI_EVENT_SIZE;
+
+	if (USBD_MIDI_FIFO_SIZE - (rx_fifo.head - rx_fifo.tail) < cnt)
+	{
+		rx_pending = true;
+		return;
+	}
+	usbd_midi_rx();
+	if (cfg->rx_ready != NULL)
+	{
+		cfg->rx_ready();
+	}
+}
+
+/**
+ * @brief Initializes the MIDI class.
+ * @param config Pointer to usbd_midi_config struct that describes the MIDI function.
+ */
+void usbd_midi_init(const struct usbd_midi_config *config)
+{
+	ASSERT(config != NULL);
+	ASSERT(config->max_packet_size && config->max_packet_size <= USBD_FS_MAX_PACKET_SIZE);
+	ASSERT(!(config->max_packet_size % USBD_MIDI_EVENT_SIZE));
+	cfg = config;
+	memset(&stats, 0, sizeof(stats));
+}
+
+/**
+ * @brief Registers the bulk endpoints and empties the ring buffers.
+ * @note Should be called from the set_configuration callback.
+ * @param
+ */
+void usbd_midi_configure(void)
+{
+	ASSERT(cfg != NULL);
+	tx_fifo.head = 0;
+	tx_fifo.tail = 0;
+	rx_fifo.head = 0;
+	rx_fifo.tail = 0;
+	tx_busy = false;
+	rx_pending = false;
+	if (cfg->in_ep == cfg->out_ep)
+	{
+		usbd_register_ep(cfg->in_ep, USB_EP_TYPE_BULK, cfg->tx_addr, cfg->rx_addr, cfg->max_packet_size, usbd_midi_ep_in, usbd_midi_ep_out);
+	}
+	else
+	{
+		usbd_register_ep_tx(cfg->in_ep, USB_EP_TYPE_BULK, cfg->tx_addr, usbd_midi_ep_in);
+		usbd_register_ep_rx(cfg->out_ep, USB_EP_TYPE_BULK, cfg->rx_addr, cfg->max_packet_size, usbd_midi_ep_out);
+	}
+}
+
+/**
+ * @brief Flushes a partial IN packet once per frame.
+ * @note Should be called from the sof callback.
+ * @param
+ */
+void usbd_midi_sof(void)
+{
+	frame++;
+	stats.frames++;
+	/*Skip until the endpoints have been registered again after a bus reset.*/
+	if (cfg == NULL || GET(*USBD_EP_REG(cfg->in_ep), USB_EP_STAT_TX) == USB_EP_STAT_TX_DISABLED)
+	{
+		return;
+	}
+	usbd_midi_tx();
+}
+
+/**
+ * @brief Queues event packets for the host. Once a full packet is queued it
+ * is sent without waiting for the next SOF.
+ * @param events Pointer to the event packets, see USBD_MIDI_EVENT.
+ * @param n Number of event packets.
+ * @return Number of event packets queued, less than n if the ring buffer is full.
+ */
+uint32_t usbd_midi_send(const uint32_t *events, uint32_t n)
+{
+	uint32_t head = tx_fifo.head;
+	uint32_t cnt;
+	uint32_t primask;
+
+	ASSERT(cfg != NULL);
+	ASSERT(events != NULL);
+	cnt = MIN(n, USBD_MIDI_FIFO_SIZE - (head - tx_fifo.tail));
+	for (uint32_t i = 0; i < cnt; i++)
+	{
+		tx_fifo.buf[(head + i) & (USBD_MIDI_FIFO_SIZE - 1U)] = events[i];
+		tx_frame[(head + i) & (USBD_MIDI_FIFO_SIZE - 1U)] = frame;
+	}
+	__DMB();
+	tx_fifo.head = head + cnt;
+	stats.dropped += n - cnt;
+
+	if ((tx_fifo.head - tx_fifo.tail) >= (uint32_t)(cfg->max_packet_size / USBD_MIDI_EVENT_SIZE) && !tx_busy)
+	{
+		primask = __get_PRIMASK();
+		__disable_irq();
+		if (GET(*USBD_EP_REG(cfg->in_ep), USB_EP_STAT_TX) != USB_EP_STAT_TX_DISABLED)
+		{
+			usbd_midi_tx();
+		}
+		__set_PRIMASK(primask);
+	}
+	return cnt;
+}
+
+/**
+ * @brief Reads event packets received from the host.
+ * @param events Pointer to the buffer that receives the event packets.
+ * @param n Size of the buffer in event packets.
+ * @return Number of event packets read.
+ */
+uint32_t usbd_midi_receive(uint32_t *events, uint32_t n)
+{
+	uint32_t tail = rx_fifo.tail;
+	uint32_t cnt;
+	uint32_t primask;
+
+	ASSERT(cfg != NULL);
+	ASSERT(events != NULL);
+	cnt = MIN(n, rx_fifo.head - tail);
+	for (uint32_t i = 0; i < cnt; i++)
+	{
+		events[i] = rx_fifo.buf[(tail + i) & (USBD_MIDI_FIFO_SIZE - 1U)];
+	}
+	__DMB();
+	rx_fifo.tail = tail + cnt;
+
+	/*Accept the packet that waited for room.*/
+	if (rx_pending)
+	{
+		primask = __get_PRIMASK();
+		__disable_irq();
+		if (rx_pending && USBD_MIDI_FIFO_SIZE - (rx_fifo.head - rx_fifo.tail) >= USBD_PMA_GET_RX_COUNT(cfg->out_ep) / USBD_MIDI_EVENT_SIZE)
+		{
+			usbd_midi_rx();
+		}
+		__set_PRIMASK(primask);
+	}
+	return cnt;
+}
+
+/**
+ * @brief Returns a copy of the counters.
+ * @param stats_out Pointer to usbd_midi_stats struct that receives the counters.
+ */
+void usbd_midi_get_stats(struct usbd_midi_stats *stats_out)
+{
+	uint32_t primask;
+
+	ASSERT(stats_out != NULL);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	*stats_out = stats;
+	__set_PRIMASK(primask);
+}
@@ -0,0 +1,221 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_msos20.h"
+
+#define USBD_MSOS20_GUID_LENGTH 38U /*!< Characters of a GUID, braces included.*/
+
+/************************************************
+ * Static variables used by the Microsoft OS 2.0
+ * descriptors.
+ ***********************************************/
+static const struct usbd_msos20_config *cfg; /*!< Pointer to the configuration provided by the user during initialization.*/
+static uint8_t set[USBD_MSOS20_DESC_SIZE]; /*!< Generated descriptor set.*/
+static uint16_t set_len; /*!< Size of the descriptor set.*/
+static struct __PACKED
+{
+	struct usbd_std_bos_descriptor_type bos;
+	struct usbd_msos20_platform_capability_descriptor_type platform;
+#if USBD_LPM
+	struct usbd_std_usb20_extension_descriptor_type usb20_ext;
+#endif
+} bos; /*!< BOS descriptor with the platform capability.*/
+
+/************************************************
+ * Function prototypes.
+ ***********************************************/
+static uint16_t usbd_msos20_compatible_id(uint16_t len, const struct usbd_msos20_function *func);
+static uint16_t usbd_msos20_interface_guid(uint16_t len, const char *guid);
+static void usbd_msos20_build_set(void);
+
+/**
+ * @brief Appends a compatible ID descriptor to the descriptor set.
+ * @param len Current size of the descriptor set.
+ * @param func Pointer to the function.
+ * @return New size of the descriptor set.
+ */
+static uint16_t usbd_msos20_compatible_id(uint16_t len, const struct usbd_msos20_function *func)
+{
+	struct usbd_msos20_compatible_id_type *id = (struct usbd_msos20_compatible_id_type*)&set[len];
+
+	ASSERT(func->compatible_id != NULL && strlen(func->compatible_id) <= sizeof(id->CompatibleID));
+	ASSERT(func->sub_compatible_id == NULL || strlen(func->sub_compatible_id) <= sizeof(id->SubCompatibleID));
+	ASSERT((uint32_t)len + sizeof(*id) <= USBD_MSOS20_DESC_SIZE);
+	memset(id, 0, sizeof(*id));
+	id->wLength = sizeof(*id);
+	id->wDescriptorType = USBD_MSOS20_FEATURE_COMPATIBLE_ID;
+	memcpy(id->CompatibleID, func->compatible_id, strlen(func->compatible_id));
+	if (func->sub_compatible_id != NULL)
+	{
+		memcpy(id->SubCompatibleID, func->sub_compatible_id, strlen(func->sub_compatible_id));
+	}
+	return len + sizeof(*id);
+}
+
+/**
+ * @brief Appends the DeviceInterfaceGUIDs registry property to the
+ * descriptor set, the name and the GUID are stored as UTF-16LE.
+ * @param len Current size of the descriptor set.
+ * @param guid Pointer to the GUID string.
+ * @return New size of the descriptor set.
+ */
+static uint16_t usbd_msos20_interface_guid(uint16_t len, const char *guid)
+{
+	static const char name[] = "DeviceInterfaceGUIDs";
+	struct usbd_msos20_registry_property_type *prop = (struct usbd_msos20_registry_property_type*)&set[len];
+	uint16_t name_len = sizeof(name) << 0x1U;
+	/*REG_MULTI_SZ, the GUID and two NULL characters.*/
+	uint16_t data_len = (USBD_MSOS20_GUID_LENGTH + 2U) << 0x1U;
+	uint16_t size = sizeof(*prop) + name_len + sizeof(uint16_t) + data_len;
+	uint8_t *p;
+
+	ASSERT(strlen(guid) == USBD_MSOS20_GUID_LENGTH);
+	ASSERT((uint32_t)len + size <= USBD_MSOS20_DESC_SIZE);
+	prop->wLength = size;
+	prop->wDescriptorType = USBD_MSOS20_FEATURE_REG_PROPERTY;
+	prop->wPropertyDataType = USBD_MSOS20_REG_MULTI_SZ;
+	prop->wPropertyNameLength = name_len;
+	p = &set[len + sizeof(*prop)];
+	for (uint16_t i = 0; i < sizeof(name); i++)
+	{
+		*p++ = (uint8_t)name[i];
+		*p++ = 0;
+	}
+	*p++ = (uint8_t)(data_len & 0xFFU);
+	*p++ = (uint8_t)(data_len >> 0x8U);
+	memset(p, 0, data_len);
+	for (uint16_t i = 0; i < USBD_MSOS20_GUID_LENGTH; i++)
+	{
+		p[i << 0x1U] = (uint8_t)guid[i];
+	}
+	return len + size;
+}
+
+/**
+ * @brief Generates the descriptor set. Composite devices get a configuration
+ * subset with a function subset for each function.
+ * @param
+ */
+static void usbd_msos20_build_set(void)
+{
+	struct usbd_msos20_set_header_type *header = (struct usbd_msos20_set_header_type*)set;
+	struct usbd_msos20_configuration_subset_header_type *conf = NULL;
+	uint16_t len = sizeof(*header);
+
+	header->wLength = sizeof(*header);
+	header->wDescriptorType = USBD_MSOS20_SET_HEADER_DESCRIPTOR;
+	header->dwWindowsVersion = USBD_MSOS20_WINDOWS_VERSION_8_1;
+
+	if (cfg->composite)
+	{
+		conf = (struct usbd_msos20_configuration_subset_header_type*)&set[len];
+		conf->wLength = sizeof(*conf);
+		conf->wDescriptorType = USBD_MSOS20_SUBSET_HEADER_CONFIGURATION;
+		/*Index of the configuration, not its bConfigurationValue.*/
+		conf->bConfigurationValue = 0;
+		conf->bReserved = 0;
+		len += sizeof(*conf);
+	}
+
+	for (uint8_t i = 0; i < cfg->function_count; i++)
+	{
+		const struct usbd_msos20_function *func = &cfg->functions[i];
+		struct usbd_msos20_function_subset_header_type *sub = NULL;
+		uint16_t start = len;
+
+		if (cfg->composite)
+		{
+			ASSERT((uint32_t)len + sizeof(*sub) <= USBD_MSOS20_DESC_SIZE);
+			sub = (struct usbd_msos20_function_subset_header_type*)&set[len];
+			sub->wLength = sizeof(*sub);
+			sub->wDescriptorType = USBD_MSOS20_SUBSET_HEADER_FUNCTION;
+			sub->bFirstInterface = func->first_interface;
+			sub->bReserved = 0;
+			len += sizeof(*sub);
+		}
+		len = usbd_msos20_compatible_id(len, func);
+		if (func->interface_guid != NULL)
+		{
+			len = usbd_msos20_interface_guid(len, func->interface_guid);
+		}
+		if (sub != NULL)
+		{
+			sub->wSubsetLength = len - start;
+		}
+	}
+
+	if (conf != NULL)
+	{
+		conf->wTotalLength = len - sizeof(*header);
+	}
+	header->wTotalLength = len;
+	set_len = len;
+}
+
+/**
+ * @brief Initializes the Microsoft OS 2.0 descriptors, generates the
+ * descriptor set and the BOS descriptor.
+ * @param config Pointer to usbd_msos20_config struct that describes the functions.
+ */
+void usbd_msos20_init(const struct usbd_msos20_config *config)
+{
+	static const uint8_t uuid[16] = { USBD_MSOS20_PLATFORM_CAPABILITY_UUID };
+
+	ASSERT(config != NULL);
+	ASSERT(config->functions != NULL && config->function_count);
+	ASSERT(config->composite || config->function_count == 1);
+	cfg = config;
+	usbd_msos20_build_set();
+
+	bos.bos.bLength = USBD_LENGTH_BOS_DESC;
+	bos.bos.bDescriptorType = USBD_DESC_TYPE_BOS;
+	bos.bos.wLength = sizeof(bos);
+	bos.bos.bNumDeviceCaps = 1;
+	bos.platform.bLength = USBD_LENGTH_MSOS20_PLATFORM_DESC;
+	bos.platform.bDescriptorType = USBD_DESC_TYPE_DEVICE_CAPABILITY;
+	bos.platform.bDevCapabilityType = USBD_DEV_CAPABILITY_TYPE_PLATFORM_CAPABILITY;
+	bos.platform.bReserved = 0;
+	memcpy(bos.platform.PlatformCapabilityUUID, uuid, sizeof(uuid));
+	bos.platform.dwWindowsVersion = USBD_MSOS20_WINDOWS_VERSION_8_1;
+	bos.platform.wMSOSDescriptorSetTotalLength = set_len;
+	bos.platform.bMS_VendorCode = cfg->vendor_code;
+	bos.platform.bAltEnumCode = 0;
+#if USBD_LPM
+	bos.bos.bNumDeviceCaps++;
+	bos.usb20_ext.bLength = USBD_LENGTH_USB20_EXTENSION_DESC;
+	bos.usb20_ext.bDescriptorType = USBD_DESC_TYPE_DEVICE_CAPABILITY;
+	bos.usb20_ext.bDevCapabilityType = USBD_DEV_CAPABILITY_TYPE_USB20_EXTENSION;
+	bos.usb20_ext.bmAttributes = USBD_USB20_EXTENSION_ATTRIBUTES;
+#endif
+}
+
+/**
+ * @brief Returns the BOS descriptor with the Microsoft OS 2.0 platform
+ * capability, and the USB 2.0 Extension capability if USBD_LPM is set.
+ * @note Can be used as the bos_descriptor callback.
+ * @param
+ * @return Pointer to the BOS descriptor.
+ */
+uint8_t *usbd_msos20_bos_descriptor(void)
+{
+	ASSERT(cfg != NULL);
+	return (uint8_t*)&bos;
+}
+
+/**
+ * @brief Handles the descriptor set request, the set is sent in packets of
+ * the endpoint 0 size.
+ * @note Should be called from the vendor_request callback.
+ * @param setup USB setup packet.
+ * @return false if the request isn't the descriptor set request.
+ */
+bool usbd_msos20_vendor_request(struct usbd_setup_packet_type setup)
+{
+	ASSERT(cfg != NULL);
+	if (setup.bmRequestType != (USBD_DIRECTION_IN | USBD_TYPE_VENDOR | USBD_RECIPIENT_DEVICE) ||
+		setup.bRequest != cfg->vendor_code || setup.wIndex != USBD_MSOS20_DESCRIPTOR_INDEX)
+	{
+		return false;
+	}
+	usbd_prepare_data_in_stage(set, MIN(setup.wLength, set_len));
+	return true;
+}
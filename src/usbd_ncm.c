@@ -0,0 +1,842 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_ncm.h"
+
+/************************************************
+ * An OUT NTB, received from the host.
+ ***********************************************/
+struct usbd_ncm_rx_ntb
+{
+	uint8_t buf[USBD_NCM_NTB_OUT_SIZE];
+	__IO uint16_t len; /*!< Block length of a complete NTB, 0 if the buffer is free.*/
+};
+
+/************************************************
+ * An IN NTB, aggregating datagrams until it's
+ * closed and sent.
+ ***********************************************/
+struct usbd_ncm_tx_ntb
+{
+	uint8_t buf[USBD_NCM_NTB_IN_SIZE];
+	uint16_t len; /*!< Used size of the buffer.*/
+	uint16_t count; /*!< Datagrams in the NTB.*/
+	uint16_t dgram[USBD_NCM_MAX_DATAGRAMS][2]; /*!< Index and length of each datagram, copied to the NDP when the NTB is closed.*/
+	uint8_t age; /*!< Frames since the first datagram has been added.*/
+	__IO bool closed; /*!< Headers have been written, the NTB waits to be sent.*/
+};
+
+/************************************************
+ * Notification state.
+ ***********************************************/
+enum usbd_ncm_notify_state
+{
+	USBD_NCM_NOTIFY_IDLE,
+	USBD_NCM_NOTIFY_SPEED,
+	USBD_NCM_NOTIFY_CONNECTION
+};
+
+/************************************************
+ * Static variables used by the NCM class.
+ ***********************************************/
+static const struct usbd_ncm_config *cfg; /*!< Pointer to the configuration provided by the user during initialization.*/
+static struct usbd_ncm_stats stats; /*!< Counters.*/
+static uint8_t alt; /*!< Alternate setting of the data interface.*/
+static bool link_up; /*!< Link state reported to the host.*/
+static uint32_t ntb_in_max; /*!< dwNtbInMaxSize selected by the host.*/
+static uint16_t tx_seq; /*!< wSequence of the next IN NTB.*/
+
+static struct usbd_ncm_rx_ntb rx[2]; /*!< OUT NTBs.*/
+static uint8_t rx_wr; /*!< OUT NTB being received.*/
+static uint8_t rx_rd; /*!< OUT NTB being read by the application.*/
+static uint16_t rx_cnt; /*!< Bytes received in the current OUT NTB.*/
+static bool rx_drop; /*!< The current OUT NTB is discarded until its last packet.*/
+static __IO bool rx_blocked; /*!< Both OUT NTBs are full, the OUT endpoint has been left NAK.*/
+static uint16_t rx_ndp; /*!< Offset of the NDP being read, 0 if the NTB hasn't been parsed yet.*/
+static uint16_t rx_idx; /*!< Next datagram of the NDP being read.*/
+
+static struct usbd_ncm_tx_ntb tx[2]; /*!< IN NTBs.*/
+static uint8_t tx_wr; /*!< IN NTB being filled.*/
+static uint8_t tx_rd; /*!< Next IN NTB to be sent.*/
+static __IO bool tx_busy; /*!< tx_rd is being sent.*/
+static uint16_t tx_pos; /*!< Bytes of tx_rd already written to the PMA.*/
+static uint16_t tx_last; /*!< Size of the last IN packet.*/
+static __IO bool tx_reserved; /*!< A datagram has been allocated but not committed yet, cleared by usbd_ncm_reset_ntbs() to cancel it.*/
+static uint16_t tx_offset; /*!< Offset of the allocated datagram.*/
+
+static enum usbd_ncm_notify_state notify_state; /*!< Notification being sent.*/
+static uint8_t notify_buf[16]; /*!< Notification buffer.*/
+static uint8_t ctrl_buf[sizeof(struct usbd_ncm_ntb_parameters_type)]; /*!< Buffer used for endpoint 0 data stages.*/
+
+/************************************************
+ * Function prototypes.
+ ***********************************************/
+static uint16_t usbd_ncm_get16(const uint8_t *p);
+static uint32_t usbd_ncm_get32(const uint8_t *p);
+static void usbd_ncm_put16(uint8_t *p, uint16_t val);
+static void usbd_ncm_put32(uint8_t *p, uint32_t val);
+static void usbd_ncm_reset_ntbs(void);
+static bool usbd_ncm_rx_valid(const uint8_t *buf, uint16_t len);
+static void usbd_ncm_rx_release(void);
+static bool usbd_ncm_tx_fits(struct usbd_ncm_tx_ntb *ntb, uint16_t offset, uint16_t len);
+static void usbd_ncm_tx_close(void);
+static void usbd_ncm_tx_start(void);
+static void usbd_ncm_tx_packet(void);
+static void usbd_ncm_ep_in(void);
+static void usbd_ncm_ep_out(void);
+static void usbd_ncm_notify(void);
+static void usbd_ncm_notify_in(void);
+static void usbd_ncm_set_ntb_input_size_cplt(void);
+
+/**
+ * @brief Little endian helpers, NTB fields aren't aligned.
+ */
+static uint16_t usbd_ncm_get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t usbd_ncm_get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void usbd_ncm_put16(uint8_t *p, uint16_t val)
+{
+	p[0] = (uint8_t)(val & 0xFFU);
+	p[1] = (uint8_t)((val >> 0x8U) & 0xFFU);
+}
+
+static void usbd_ncm_put32(uint8_t *p, uint32_t val)
+{
+	usbd_ncm_put16(p, (uint16_t)(val & 0xFFFFU));
+	usbd_ncm_put16(p + 2, (uint16_t)((val >> 0x10U) & 0xFFFFU));
+}
+
+/**
+ * @brief Drop every NTB in both directions.
+ * @param
+ */
+static void usbd_ncm_reset_ntbs(void)
+{
+	rx[0].len = 0;
+	rx[1].len = 0;
+	rx_wr = 0;
+	rx_rd = 0;
+	rx_cnt = 0;
+	rx_drop = false;
+	rx_blocked = false;
+	rx_ndp = 0;
+	rx_idx = 0;
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		tx[i].len = 0;
+		tx[i].count = 0;
+		tx[i].age = 0;
+		tx[i].closed = false;
+	}
+	tx_wr = 0;
+	tx_rd = 0;
+	tx_busy = false;
+	tx_reserved = false;
+	tx_pos = 0;
+	tx_last = 0;
+}
+
+/**
+ * @brief Validate the NTH16 of an OUT NTB.
+ * @param buf Pointer to the NTB.
+ * @param len Received size of the NTB.
+ * @return true if the header is valid.
+ */
+static bool usbd_ncm_rx_valid(const uint8_t *buf, uint16_t len)
+{
+	uint16_t ndp;
+
+	if (len < USBD_NCM_NTH16_LENGTH
+		|| usbd_ncm_get32(buf) != USBD_NCM_NTH16_SIGNATURE
+		|| usbd_ncm_get16(&buf[4]) != USBD_NCM_NTH16_LENGTH
+		|| usbd_ncm_get16(&buf[8]) > len)
+	{
+		return false;
+	}
+	ndp = usbd_ncm_get16(&buf[10]);
+	return (ndp >= USBD_NCM_NTH16_LENGTH) && !(ndp & 0x3U);
+}
+
+/**
+ * @brief Give the OUT NTB that has been read back to the endpoint.
+ * @param
+ */
+static void usbd_ncm_rx_release(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	rx[rx_rd].len = 0;
+	rx_rd ^= 1U;
+	rx_ndp = 0;
+	if (rx_blocked)
+	{
+		rx_blocked = false;
+		USBD_EP_SET_STAT_RX(cfg->out_ep, USB_EP_STAT_RX_VALID);
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Check if a datagram fits in an IN NTB, together with its NDP.
+ * @param ntb Pointer to the NTB.
+ * @param offset Offset of the datagram.
+ * @param len Size of the datagram.
+ * @return true if it fits.
+ */
+static bool usbd_ncm_tx_fits(struct usbd_ncm_tx_ntb *ntb, uint16_t offset, uint16_t len)
+{
+	/*NDP with the new entry and the terminating null entry.*/
+	uint32_t ndp = USBD_NCM_NDP16_LENGTH + ((ntb->count + 2U) << 0x2U);
+	uint32_t end = ((uint32_t)offset + len + (USBD_NCM_NDP_DIVISOR - 1U)) & ~(USBD_NCM_NDP_DIVISOR - 1U);
+	return (ntb->count < USBD_NCM_MAX_DATAGRAMS) && (end + ndp <= ntb_in_max);
+}
+
+/**
+ * @brief Write the NTH16 and NDP16 of the IN NTB being filled, and switch
+ * to the other buffer.
+ * @note Called with the interrupts disabled or from the interrupt.
+ * @param
+ */
+static void usbd_ncm_tx_close(void)
+{
+	struct usbd_ncm_tx_ntb *ntb = &tx[tx_wr];
+	uint16_t ndp = (ntb->len + (USBD_NCM_NDP_DIVISOR - 1U)) & ~(USBD_NCM_NDP_DIVISOR - 1U);
+	uint16_t ndp_len = USBD_NCM_NDP16_LENGTH + ((ntb->count + 1U) << 0x2U);
+	uint8_t *p = &ntb->buf[ndp];
+
+	usbd_ncm_put32(p, USBD_NCM_NDP16_SIGNATURE);
+	usbd_ncm_put16(p + 4, ndp_len);
+	usbd_ncm_put16(p + 6, 0);
+	p += USBD_NCM_NDP16_LENGTH;
+	for (uint16_t i = 0; i < ntb->count; i++)
+	{
+		usbd_ncm_put16(p, ntb->dgram[i][0]);
+		usbd_ncm_put16(p + 2, ntb->dgram[i][1]);
+		p += 4;
+	}
+	usbd_ncm_put32(p, 0);
+
+	ntb->len = ndp + ndp_len;
+	p = ntb->buf;
+	usbd_ncm_put32(p, USBD_NCM_NTH16_SIGNATURE);
+	usbd_ncm_put16(p + 4, USBD_NCM_NTH16_LENGTH);
+	usbd_ncm_put16(p + 6, tx_seq++);
+	usbd_ncm_put16(p + 8, ntb->len);
+	usbd_ncm_put16(p + 10, ndp);
+
+	ntb->closed = true;
+	tx_wr ^= 1U;
+}
+
+/**
+ * @brief Start sending the next closed IN NTB, if the endpoint is idle.
+ * @note Called with the interrupts disabled or from the interrupt.
+ * @param
+ */
+static void usbd_ncm_tx_start(void)
+{
+	if (!alt || tx_busy || !tx[tx_rd].closed)
+	{
+		return;
+	}
+	tx_busy = true;
+	tx_pos = 0;
+	usbd_ncm_tx_packet();
+}
+
+/**
+ * @brief Copy the next packet of the IN NTB to the PMA.
+ * @param
+ */
+static void usbd_ncm_tx_packet(void)
+{
+	struct usbd_ncm_tx_ntb *ntb = &tx[tx_rd];
+	tx_last = MIN(cfg->max_packet_size, ntb->len - tx_pos);
+	usbd_pma_write(cfg->tx_addr, &ntb->buf[tx_pos], tx_last);
+	tx_pos += tx_last;
+	USBD_PMA_SET_TX_COUNT(cfg->in_ep, tx_last);
+	USBD_EP_SET_STAT_TX(cfg->in_ep, USB_EP_STAT_TX_VALID);
+}
+
+/**
+ * @brief Bulk IN endpoint callback function.
+ * @param
+ */
+static void usbd_ncm_ep_in(void)
+{
+	struct usbd_ncm_tx_ntb *ntb = &tx[tx_rd];
+
+	if (tx_pos < ntb->len)
+	{
+		usbd_ncm_tx_packet();
+		return;
+	}
+	/*An NTB shorter than dwNtbInMaxSize ends with a short packet.*/
+	if (tx_last == cfg->max_packet_size && ntb->len < ntb_in_max)
+	{
+		tx_last = 0;
+		USBD_PMA_SET_TX_COUNT(cfg->in_ep, 0);
+		USBD_EP_SET_STAT_TX(cfg->in_ep, USB_EP_STAT_TX_VALID);
+		return;
+	}
+
+	stats.tx_ntbs++;
+	stats.tx_frames += ntb->count;
+	ntb->len = 0;
+	ntb->count = 0;
+	ntb->age = 0;
+	ntb->closed = false;
+	tx_rd ^= 1U;
+	tx_busy = false;
+	usbd_ncm_tx_start();
+}
+
+/**
+ * @brief Bulk OUT endpoint callback function. Collects packets until the
+ * NTB is complete.
+ * @param
+ */
+static void usbd_ncm_ep_out(void)
+{
+	struct usbd_ncm_rx_ntb *ntb = &rx[rx_wr];
+	uint16_t cnt = USBD_PMA_GET_RX_COUNT(cfg->out_ep);
+	bool last = cnt < cfg->max_packet_size;
+
+	if (!rx_drop && (rx_cnt + cnt) <= USBD_NCM_NTB_OUT_SIZE)
+	{
+		usbd_pma_read(cfg->rx_addr, &ntb->buf[rx_cnt], cnt);
+		rx_cnt += cnt;
+	}
+	else if (!rx_drop)
+	{
+		rx_drop = true;
+		stats.rx_errors++;
+	}
+
+	/*The NTB ends with a short packet, or once wBlockLength has been received.
+	A wBlockLength of 0 means only a short packet ends it.*/
+	if (!last && (rx_drop || rx_cnt < USBD_NCM_NTH16_LENGTH || !usbd_ncm_get16(&ntb->buf[8])
+		|| rx_cnt < usbd_ncm_get16(&ntb->buf[8])))
+	{
+		USBD_EP_SET_STAT_RX(cfg->out_ep, USB_EP_STAT_RX_VALID);
+		return;
+	}
+	/*A zero length packet after an NTB of wBlockLength is ignored.*/
+	if (rx_drop || !rx_cnt)
+	{
+		rx_drop = false;
+		rx_cnt = 0;
+		USBD_EP_SET_STAT_RX(cfg->out_ep, USB_EP_STAT_RX_VALID);
+		return;
+	}
+	if (!usbd_ncm_rx_valid(ntb->buf, rx_cnt))
+	{
+		stats.rx_errors++;
+		rx_cnt = 0;
+		USBD_EP_SET_STAT_RX(cfg->out_ep, USB_EP_STAT_RX_VALID);
+		return;
+	}
+
+	stats.rx_ntbs++;
+	ntb->len = usbd_ncm_get16(&ntb->buf[8]) ? usbd_ncm_get16(&ntb->buf[8]) : rx_cnt;
+	rx_cnt = 0;
+	rx_wr ^= 1U;
+	/*Leave the endpoint NAK until the application has read the other NTB.*/
+	if (rx[rx_wr].len)
+	{
+		rx_blocked = true;
+	}
+	else
+	{
+		USBD_EP_SET_STAT_RX(cfg->out_ep, USB_EP_STAT_RX_VALID);
+	}
+	if (cfg->rx_ready != NULL)
+	{
+		cfg->rx_ready();
+	}
+}
+
+/**
+ * @brief Send the notifications of the current link state, speed first.
+ * @param
+ */
+static void usbd_ncm_notify(void)
+{
+	notify_buf[0] = (USBD_DIRECTION_IN | USBD_TYPE_CLASS | USBD_RECIPIENT_INTERFACE);
+	usbd_ncm_put16(&notify_buf[4], cfg->comm_interface_num);
+
+	if (link_up && notify_state == USBD_NCM_NOTIFY_IDLE)
+	{
+		notify_buf[1] = USBD_CDC_CONNECTION_SPEED_CHANGE;
+		usbd_ncm_put16(&notify_buf[2], 0);
+		usbd_ncm_put16(&notify_buf[6], 8);
+		/*Full speed, in both directions.*/
+		usbd_ncm_put32(&notify_buf[8], 12000000UL);
+		usbd_ncm_put32(&notify_buf[12], 12000000UL);
+		notify_state = USBD_NCM_NOTIFY_SPEED;
+		usbd_pma_write(cfg->notify_tx_addr, notify_buf, 16);
+		USBD_PMA_SET_TX_COUNT(cfg->notify_ep, 16);
+	}
+	else
+	{
+		notify_buf[1] = USBD_CDC_NETWORK_CONNECTION;
+		usbd_ncm_put16(&notify_buf[2], link_up ? 1 : 0);
+		usbd_ncm_put16(&notify_buf[6], 0);
+		notify_state = USBD_NCM_NOTIFY_CONNECTION;
+		usbd_pma_write(cfg->notify_tx_addr, notify_buf, 8);
+		USBD_PMA_SET_TX_COUNT(cfg->notify_ep, 8);
+	}
+	USBD_EP_SET_STAT_TX(cfg->notify_ep, USB_EP_STAT_TX_VALID);
+}
+
+/**
+ * @brief Interrupt IN endpoint callback function.
+ * @param
+ */
+static void usbd_ncm_notify_in(void)
+{
+	if (notify_state == USBD_NCM_NOTIFY_SPEED)
+	{
+		usbd_ncm_notify();
+		return;
+	}
+	notify_state = USBD_NCM_NOTIFY_IDLE;
+}
+
+/**
+ * @brief SET_NTB_INPUT_SIZE data stage completion callback function.
+ * @param
+ */
+static void usbd_ncm_set_ntb_input_size_cplt(void)
+{
+	uint32_t size = usbd_ncm_get32(ctrl_buf);
+	/*The host may only lower the size. Its IN buffers are sized to it, so a
+	limit below a full datagram is kept and usbd_ncm_tx_alloc() refuses the
+	datagrams that don't fit an empty NTB.*/
+	ntb_in_max = MIN(USBD_NCM_NTB_IN_SIZE, size);
+}
+
+/**
+ * @brief Initializes the NCM class.
+ * @param config Pointer to usbd_ncm_config struct that describes the NCM function.
+ */
+void usbd_ncm_init(const struct usbd_ncm_config *config)
+{
+	ASSERT(config != NULL);
+	ASSERT(config->max_packet_size && config->max_packet_size <= USBD_FS_MAX_PACKET_SIZE);
+	cfg = config;
+	memset(&stats, 0, sizeof(stats));
+	link_up = false;
+	alt = 0;
+	ntb_in_max = USBD_NCM_NTB_IN_SIZE;
+	usbd_ncm_reset_ntbs();
+}
+
+/**
+ * @brief Registers the notification endpoint, the data interface starts
+ * with no endpoints (alternate setting 0).
+ * @note Should be called from the set_configuration callback.
+ * @param
+ */
+void usbd_ncm_configure(void)
+{
+	ASSERT(cfg != NULL);
+	alt = 0;
+	ntb_in_max = USBD_NCM_NTB_IN_SIZE;
+	notify_state = USBD_NCM_NOTIFY_IDLE;
+	usbd_ncm_reset_ntbs();
+	usbd_register_ep_tx(cfg->notify_ep, USB_EP_TYPE_INTERRUPT, cfg->notify_tx_addr, usbd_ncm_notify_in);
+}
+
+/**
+ * @brief Switch the alternate setting of the data interface.
+ * @note Should be called from the set_interface callback.
+ * @param num Interface number.
+ * @param new_alt Alternate setting.
+ * @return false if the interface isn't the data interface of the function.
+ */
+bool usbd_ncm_set_interface(uint8_t num, uint8_t new_alt)
+{
+	ASSERT(cfg != NULL);
+	if (num != cfg->data_interface_num)
+	{
+		return num == cfg->comm_interface_num;
+	}
+	if (new_alt > 1)
+	{
+		return true;
+	}
+
+	if (alt)
+	{
+		usbd_unregister_ep(cfg->in_ep);
+		usbd_unregister_ep(cfg->out_ep);
+	}
+	usbd_ncm_reset_ntbs();
+	alt = new_alt;
+	if (alt)
+	{
+		usbd_register_ep_tx(cfg->in_ep, USB_EP_TYPE_BULK, cfg->tx_addr, usbd_ncm_ep_in);
+		usbd_register_ep_rx(cfg->out_ep, USB_EP_TYPE_BULK, cfg->rx_addr, cfg->max_packet_size, usbd_ncm_ep_out);
+	}
+	/*Report the link state every time the data interface changes.*/
+	if (notify_state == USBD_NCM_NOTIFY_IDLE)
+	{
+		usbd_ncm_notify();
+	}
+	return true;
+}
+
+/**
+ * @brief Checks an alternate setting of the NCM interfaces.
+ * @note Can be used as the is_alternate_valid callback.
+ * @param num Interface number.
+ * @param new_alt Alternate setting.
+ * @return true if the interface belongs to the function and supports the alternate setting.
+ */
+bool usbd_ncm_is_alternate_valid(uint8_t num, uint8_t new_alt)
+{
+	ASSERT(cfg != NULL);
+	if (num == cfg->data_interface_num)
+	{
+		return new_alt <= 1;
+	}
+	return num == cfg->comm_interface_num && !new_alt;
+}
+
+/**
+ * @brief Returns the alternate setting of the NCM interfaces.
+ * @note Should be called from the get_interface callback.
+ * @param num Interface number.
+ * @param cur_alt Pointer that receives the alternate setting.
+ * @return false if the interface doesn't belong to the function.
+ */
+bool usbd_ncm_get_interface(uint8_t num, uint8_t *cur_alt)
+{
+	ASSERT(cfg != NULL);
+	ASSERT(cur_alt != NULL);
+	if (num == cfg->data_interface_num)
+	{
+		*cur_alt = alt;
+		return true;
+	}
+	if (num == cfg->comm_interface_num)
+	{
+		*cur_alt = 0;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief NCM class specific request handler.
+ * @note Should be called from the class_request callback.
+ * @param setup USB setup packet.
+ * @return false if the request isn't addressed to the communication interface, true otherwise.
+ */
+bool usbd_ncm_class_request(struct usbd_setup_packet_type setup)
+{
+	ASSERT(cfg != NULL);
+	if ((setup.bmRequestType & USBD_RECIPIENT) != USBD_RECIPIENT_INTERFACE || (setup.wIndex & 0xFFU) != cfg->comm_interface_num)
+	{
+		return false;
+	}
+
+	switch (setup.bRequest)
+	{
+		case USBD_NCM_GET_NTB_PARAMETERS:
+		{
+			struct usbd_ncm_ntb_parameters_type params =
+			{
+				.wLength = sizeof(struct usbd_ncm_ntb_parameters_type),
+				.bmNtbFormatsSupported = USBD_NCM_FORMAT_NTB16,
+				.dwNtbInMaxSize = USBD_NCM_NTB_IN_SIZE,
+				.wNdpInDivisor = USBD_NCM_NDP_DIVISOR,
+				.wNdpInPayloadRemainder = 0,
+				.wNdpInAlignment = USBD_NCM_NDP_DIVISOR,
+				.wReserved = 0,
+				.dwNtbOutMaxSize = USBD_NCM_NTB_OUT_SIZE,
+				.wNdpOutDivisor = USBD_NCM_NDP_DIVISOR,
+				.wNdpOutPayloadRemainder = 0,
+				.wNdpOutAlignment = USBD_NCM_NDP_DIVISOR,
+				.wNtbOutMaxDatagrams = 0
+			};
+			memcpy(ctrl_buf, &params, sizeof(params));
+			usbd_prepare_data_in_stage(ctrl_buf, MIN(setup.wLength, sizeof(params)));
+			break;
+		}
+		case USBD_NCM_GET_NTB_FORMAT:
+		{
+			usbd_ncm_put16(ctrl_buf, 0);
+			usbd_prepare_data_in_stage(ctrl_buf, MIN(setup.wLength, USBD_NCM_GET_NTB_FORMAT_LENGTH));
+			break;
+		}
+		case USBD_NCM_SET_NTB_FORMAT:
+		{
+			/*Only the 16 bit NTB format is supported.*/
+			if (setup.wValue)
+			{
+				USBD_EP0_SET_STALL();
+				break;
+			}
+			usbd_prepare_status_in_stage();
+			break;
+		}
+		case USBD_NCM_GET_NTB_INPUT_SIZE:
+		{
+			usbd_ncm_put32(ctrl_buf, ntb_in_max);
+			usbd_prepare_data_in_stage(ctrl_buf, MIN(setup.wLength, USBD_NCM_NTB_INPUT_SIZE_LENGTH));
+			break;
+		}
+		case USBD_NCM_SET_NTB_INPUT_SIZE:
+		{
+			/*wNtbInMaxDatagrams may follow dwNtbInMaxSize, it's ignored.*/
+			if (setup.wLength < USBD_NCM_NTB_INPUT_SIZE_LENGTH || setup.wLength > sizeof(ctrl_buf))
+			{
+				USBD_EP0_SET_STALL();
+				break;
+			}
+			usbd_prepare_data_out_stage(ctrl_buf, setup.wLength, usbd_ncm_set_ntb_input_size_cplt);
+			break;
+		}
+		case USBD_NCM_GET_MAX_DATAGRAM_SIZE:
+		{
+			usbd_ncm_put16(ctrl_buf, USBD_NCM_MAX_DATAGRAM_SIZE);
+			usbd_prepare_data_in_stage(ctrl_buf, MIN(setup.wLength, USBD_NCM_MAX_DATAGRAM_SIZE_LENGTH));
+			break;
+		}
+		case USBD_CDC_SET_ETHERNET_PACKET_FILTER:
+		{
+			/*Every packet is forwarded, filtering is left to the network stack.*/
+			usbd_prepare_status_in_stage();
+			break;
+		}
+		default:
+		{
+			USBD_EP0_SET_STALL();
+			break;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Closes the IN NTB being filled once it has waited
+ * USBD_NCM_TX_FLUSH_FRAMES frames for more datagrams and the endpoint is idle.
+ * While the endpoint is busy datagrams keep being aggregated.
+ * @note Should be called from the sof callback.
+ * @param
+ */
+void usbd_ncm_sof(void)
+{
+	struct usbd_ncm_tx_ntb *ntb;
+
+	if (cfg == NULL || !alt)
+	{
+		return;
+	}
+	ntb = &tx[tx_wr];
+	if (ntb->count && !ntb->closed && !tx_reserved)
+	{
+		if (ntb->age < 0xFFU)
+		{
+			ntb->age++;
+		}
+		if (ntb->age >= USBD_NCM_TX_FLUSH_FRAMES && !tx_busy)
+		{
+			usbd_ncm_tx_close();
+		}
+	}
+	usbd_ncm_tx_start();
+}
+
+/**
+ * @brief Report the link state to the host.
+ * @param up true if the network is connected.
+ */
+void usbd_ncm_set_link(bool up)
+{
+	uint32_t primask;
+
+	ASSERT(cfg != NULL);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	link_up = up;
+	/*If a notification is in progress, the new state is sent after it.*/
+	if (notify_state == USBD_NCM_NOTIFY_IDLE && GET(*USBD_EP_REG(cfg->notify_ep), USB_EP_STAT_TX) != USB_EP_STAT_TX_DISABLED)
+	{
+		usbd_ncm_notify();
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Get the next received datagram (Ethernet frame) without copying it.
+ * @note The frame stays valid until the next call. Once every datagram of an
+ * NTB has been read, the NTB is given back to the OUT endpoint.
+ * @param len Pointer that receives the size of the frame.
+ * @return Pointer to the frame inside the NTB, NULL if there is none.
+ */
+uint8_t *usbd_ncm_rx_frame(uint16_t *len)
+{
+	struct usbd_ncm_rx_ntb *ntb = &rx[rx_rd];
+	uint16_t ntb_len = ntb->len;
+
+	ASSERT(len != NULL);
+	if (!ntb_len)
+	{
+		return NULL;
+	}
+	if (!rx_ndp)
+	{
+		rx_ndp = usbd_ncm_get16(&ntb->buf[10]);
+		rx_idx = 0;
+	}
+
+	while (rx_ndp && (rx_ndp + USBD_NCM_NDP16_LENGTH) <= ntb_len && usbd_ncm_get32(&ntb->buf[rx_ndp]) == USBD_NCM_NDP16_SIGNATURE)
+	{
+		uint16_t ndp_end = rx_ndp + usbd_ncm_get16(&ntb->buf[rx_ndp + 4]);
+		uint16_t entry = rx_ndp + USBD_NCM_NDP16_LENGTH + (rx_idx << 0x2U);
+		uint16_t idx = 0, dlen = 0;
+
+		if ((entry + 4U) <= ndp_end && (entry + 4U) <= ntb_len)
+		{
+			idx = usbd_ncm_get16(&ntb->buf[entry]);
+			dlen = usbd_ncm_get16(&ntb->buf[entry + 2]);
+		}
+		/*A null entry ends the NDP, NDPs have to move forward so a bad NTB can't loop.*/
+		if (!idx || !dlen)
+		{
+			uint16_t next = usbd_ncm_get16(&ntb->buf[rx_ndp + 6]);
+			rx_ndp = (next > rx_ndp) ? next : 0;
+			rx_idx = 0;
+			continue;
+		}
+		rx_idx++;
+		if (((uint32_t)idx + dlen) > ntb_len)
+		{
+			stats.rx_errors++;
+			continue;
+		}
+		stats.rx_frames++;
+		*len = dlen;
+		return &ntb->buf[idx];
+	}
+
+	usbd_ncm_rx_release();
+	return NULL;
+}
+
+/**
+ * @brief Reserve room for a datagram (Ethernet frame) in the IN NTB being
+ * filled. The network stack writes the frame in place and then calls
+ * usbd_ncm_tx_commit().
+ * @param len Maximum size of the frame.
+ * @return Pointer to the frame inside the NTB, NULL if both NTBs are busy or
+ * the frame doesn't fit the dwNtbInMaxSize selected by the host.
+ */
+uint8_t *usbd_ncm_tx_alloc(uint16_t len)
+{
+	struct usbd_ncm_tx_ntb *ntb;
+	uint8_t *frame = NULL;
+	uint32_t primask;
+
+	ASSERT(cfg != NULL);
+	ASSERT(!tx_reserved);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	ntb = &tx[tx_wr];
+	if (alt && !ntb->closed)
+	{
+		tx_offset = ntb->count ? ((ntb->len + (USBD_NCM_NDP_DIVISOR - 1U)) & ~(USBD_NCM_NDP_DIVISOR - 1U)) : USBD_NCM_NTH16_LENGTH;
+		/*Close a full NTB and continue with the other one.*/
+		if (!usbd_ncm_tx_fits(ntb, tx_offset, len) && ntb->count)
+		{
+			usbd_ncm_tx_close();
+			usbd_ncm_tx_start();
+			ntb = &tx[tx_wr];
+			tx_offset = USBD_NCM_NTH16_LENGTH;
+		}
+		if (!ntb->closed && usbd_ncm_tx_fits(ntb, tx_offset, len))
+		{
+			tx_reserved = true;
+			frame = &ntb->buf[tx_offset];
+		}
+	}
+	__set_PRIMASK(primask);
+	return frame;
+}
+
+/**
+ * @brief Add the datagram reserved by usbd_ncm_tx_alloc() to the IN NTB.
+ * @note A SET_INTERFACE of the data interface or a SET_CONFIGURATION
+ * between usbd_ncm_tx_alloc() and this call drops the NTBs and cancels the
+ * reservation, the datagram is then dropped silently and counted in
+ * tx_dropped.
+ * @param len Actual size of the frame, up to the allocated size.
+ */
+void usbd_ncm_tx_commit(uint16_t len)
+{
+	struct usbd_ncm_tx_ntb *ntb;
+	uint32_t primask;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (!tx_reserved)
+	{
+		stats.tx_dropped++;
+		__set_PRIMASK(primask);
+		return;
+	}
+	ntb = &tx[tx_wr];
+	if (!ntb->count)
+	{
+		ntb->age = 0;
+	}
+	ntb->dgram[ntb->count][0] = tx_offset;
+	ntb->dgram[ntb->count][1] = len;
+	ntb->count++;
+	ntb->len = tx_offset + len;
+	tx_reserved = false;
+	if (ntb->count == USBD_NCM_MAX_DATAGRAMS)
+	{
+		usbd_ncm_tx_close();
+		usbd_ncm_tx_start();
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Send the IN NTB being filled without waiting for the flush deadline.
+ * @param
+ */
+void usbd_ncm_tx_flush(void)
+{
+	uint32_t primask;
+
+	ASSERT(cfg != NULL);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (tx[tx_wr].count && !tx[tx_wr].closed && !tx_reserved)
+	{
+		usbd_ncm_tx_close();
+	}
+	usbd_ncm_tx_start();
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Get the NCM counters.
+ * @param stats_out Pointer to usbd_ncm_stats struct that receives the counters.
+ */
+void usbd_ncm_get_stats(struct usbd_ncm_stats *stats_out)
+{
+	ASSERT(stats_out != NULL);
+	*stats_out = stats;
+}
@@ -0,0 +1,213 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_record.h"
+
+#if USBD_RECORD
+
+/************************************************
+ * Static variables used by the recorder.
+ ***********************************************/
+static uint8_t log_buf[USBD_RECORD_SIZE]; /*!< Linear log of the entries.*/
+static uint32_t log_len; /*!< Bytes used in the log.*/
+static uint32_t last_cycles; /*!< DWT cycle counter at the previous entry.*/
+static bool full; /*!< An entry didn't fit, the following ones are dropped too.*/
+static bool replaying; /*!< usbd_record_replay() is running, nothing is logged.*/
+static struct usbd_record_stats stats; /*!< Recorder counters.*/
+
+/**
+ * @brief USB interrupt handler implemented by the usbd_core.
+ * @param
+ */
+void USB_IRQHandler(void);
+
+/**
+ * @brief Empties the log and starts recording.
+ * @note Called by usbd_core_init(), a log replays correctly only from there.
+ * @param
+ */
+void usbd_record_start(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	log_len = 0;
+	full = false;
+	last_cycles = DWT->CYCCNT;
+	stats = (struct usbd_record_stats){ 0 };
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Logs an entry of the interrupt handler, before any event is served.
+ * @param istr ISTR read by the interrupt handler.
+ */
+void usbd_record_irq(uint16_t istr)
+{
+	struct usbd_record_entry_type entry;
+	uint16_t ep_val[8];
+	uint16_t addr = 0;
+	uint32_t size;
+	uint32_t now = DWT->CYCCNT;
+	uint8_t ep = GET(istr, USB_EP_EA);
+
+	if (replaying)
+	{
+		return;
+	}
+	if (full)
+	{
+		stats.dropped++;
+		return;
+	}
+
+	entry.cycles = now - last_cycles;
+	last_cycles = now;
+	entry.istr = istr;
+	entry.fnr = USB->FNR;
+	entry.ep_mask = 0;
+	entry.rx = 0;
+	size = sizeof(entry);
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		ep_val[i] = *USBD_EP_REG(i);
+		if (ep_val[i])
+		{
+			SET(entry.ep_mask, 1U << i);
+			size += sizeof(uint16_t);
+		}
+	}
+
+	/*The core serves a single transaction per interrupt, IN first. An OUT
+	pending together with an IN is recorded on the next interrupt.*/
+	if (GET(istr, USB_ISTR_CTR) && GET(ep_val[ep], USB_EP_CTR_RX) && !GET(ep_val[ep], USB_EP_CTR_TX))
+	{
+		uint16_t type = GET(ep_val[ep], USB_EP_TYPE);
+		bool rx0 = (type == USB_EP_TYPE_ISOCHRONOUS || (type == USB_EP_TYPE_BULK && GET(ep_val[ep], USB_EP_KIND))) &&
+			GET(ep_val[ep], USB_EP_DTOG_RX);
+
+		addr = rx0 ? USBD_PMA_GET_RX0_ADDR(ep) : USBD_PMA_GET_RX1_ADDR(ep);
+		entry.rx = rx0 ? (USBD_PMA_GET_RX0_COUNT(ep) | USBD_RECORD_RX_BUF0) : USBD_PMA_GET_RX1_COUNT(ep);
+		size += GET(entry.rx, USBD_RECORD_RX_COUNT);
+	}
+
+	if (USBD_RECORD_SIZE - log_len < size)
+	{
+		full = true;
+		stats.dropped++;
+		return;
+	}
+
+	memcpy(&log_buf[log_len], &entry, sizeof(entry));
+	log_len += sizeof(entry);
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		if (ep_val[i])
+		{
+			memcpy(&log_buf[log_len], &ep_val[i], sizeof(uint16_t));
+			log_len += sizeof(uint16_t);
+		}
+	}
+	if (GET(entry.rx, USBD_RECORD_RX_COUNT))
+	{
+		/*The PMA is read by halfwords, the last one may be truncated.*/
+		__IO uint16_t *src = (__IO uint16_t*)(PMA_BASE + addr);
+		uint16_t cnt = GET(entry.rx, USBD_RECORD_RX_COUNT);
+		uint16_t tmp_val;
+
+		for (uint16_t i = 0; i < cnt; i += 2U)
+		{
+			tmp_val = *src++;
+			log_buf[log_len + i] = (uint8_t)(tmp_val & 0xFFU);
+			if (i + 1U < cnt)
+			{
+				log_buf[log_len + i + 1U] = (uint8_t)(tmp_val >> 0x8U);
+			}
+		}
+		log_len += cnt;
+	}
+	stats.entries++;
+}
+
+/**
+ * @brief Returns the log, it can be copied out while recording goes on.
+ * @param len Pointer to the variable that receives the bytes used.
+ * @return Pointer to the log.
+ */
+const uint8_t *usbd_record_log(uint32_t *len)
+{
+	ASSERT(len != NULL);
+	*len = log_len;
+	return log_buf;
+}
+
+/**
+ * @brief Feeds a log into the usbd_core, one interrupt per entry. The
+ * endpoint registers, FNR and the received payload are restored before
+ * the interrupt handler runs. The recorded cycles aren't waited for.
+ * @note Only for builds where the USB registers and the Packet Memory Area
+ * are plain memory. usbd_core_init() has to be called first.
+ * @param log Pointer to the log.
+ * @param len Size of the log.
+ */
+void usbd_record_replay(const uint8_t *log, uint32_t len)
+{
+	struct usbd_record_entry_type entry;
+	uint32_t pos = 0;
+	uint16_t ep_val, cnt;
+	uint8_t ep;
+
+	ASSERT(log != NULL);
+	replaying = true;
+	while (len - pos >= sizeof(entry))
+	{
+		memcpy(&entry, &log[pos], sizeof(entry));
+		pos += sizeof(entry);
+		for (uint8_t i = 0; i < 8; i++)
+		{
+			ep_val = 0;
+			if (GET(entry.ep_mask, 1U << i))
+			{
+				ASSERT(len - pos >= sizeof(uint16_t));
+				memcpy(&ep_val, &log[pos], sizeof(uint16_t));
+				pos += sizeof(uint16_t);
+			}
+			*USBD_EP_REG(i) = ep_val;
+		}
+
+		cnt = GET(entry.rx, USBD_RECORD_RX_COUNT);
+		ep = GET(entry.istr, USB_EP_EA);
+		ASSERT(len - pos >= cnt);
+		if (GET(entry.rx, USBD_RECORD_RX_BUF0))
+		{
+			*USBD_PMA_REG_HELPER(ep, 2) = (*USBD_PMA_REG_HELPER(ep, 2) & ~USBD_PMA_COUNT) | cnt;
+			memcpy((uint8_t*)(PMA_BASE + USBD_PMA_GET_RX0_ADDR(ep)), &log[pos], cnt);
+		}
+		else if (cnt)
+		{
+			*USBD_PMA_REG_HELPER(ep, 6) = (*USBD_PMA_REG_HELPER(ep, 6) & ~USBD_PMA_COUNT) | cnt;
+			memcpy((uint8_t*)(PMA_BASE + USBD_PMA_GET_RX1_ADDR(ep)), &log[pos], cnt);
+		}
+		pos += cnt;
+
+		USB->FNR = entry.fnr;
+		USB->ISTR = entry.istr;
+		USB_IRQHandler();
+	}
+	replaying = false;
+}
+
+/**
+ * @brief Get the recorder counters.
+ * @param stats_out Pointer to usbd_record_stats struct that receives the counters.
+ */
+void usbd_record_get_stats(struct usbd_record_stats *stats_out)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	ASSERT(stats_out != NULL);
+	__disable_irq();
+	*stats_out = stats;
+	__set_PRIMASK(primask);
+}
+
+#endif /*USBD_RECORD*/
@@ -0,0 +1,50 @@
+#include "assert_stm32l4xx.h"
+#include "usbd_string.h"
+
+/************************************************
+ * Static variables used by the string
+ * descriptors.
+ ***********************************************/
+static struct __PACKED
+{
+	struct usbd_std_string_descriptor_type header;
+	uint16_t bString[USBD_STRING_SERIAL_LENGTH];
+} serial; /*!< Serial number string descriptor, formatted once from the unique ID.*/
+
+/**
+ * @brief Formats the 96-bit unique ID of the MCU into the serial number
+ * string descriptor, as 24 uppercase hexadecimal characters.
+ * @note Should be called once, before usbd_core_init().
+ * @param
+ */
+void usbd_string_serial_init(void)
+{
+	const __IO uint32_t *uid = (const __IO uint32_t*)UID_BASE;
+	uint32_t word;
+	uint8_t nibble;
+
+	serial.header.bLength = sizeof(serial);
+	serial.header.bDescriptorType = USBD_DESC_TYPE_STRING;
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		word = uid[i];
+		for (uint8_t j = 0; j < 8; j++)
+		{
+			nibble = (uint8_t)(word >> 28);
+			serial.bString[(i << 0x3U) + j] = (nibble < 10) ? (uint16_t)('0' + nibble) : (uint16_t)('A' + nibble - 10);
+			word <<= 4;
+		}
+	}
+}
+
+/**
+ * @brief Returns the serial number string descriptor.
+ * @note Can be returned from the string_descriptor callback.
+ * @param
+ * @return Pointer to the serial number string descriptor.
+ */
+uint8_t *usbd_string_serial(void)
+{
+	ASSERT(serial.header.bLength);
+	return (uint8_t*)&serial;
+}
@@ -0,0 +1,390 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_uvc.h"
+
+#define USBD_UVC_INFO_GET_SET 0x03U /*!< GET_INFO, the control supports GET and SET requests.*/
+#define USBD_UVC_FRAMING_FID_EOF 0x03U /*!< bmFramingInfo, FID and EOF are used.*/
+#define USBD_UVC_CLOCK_FREQUENCY 48000000UL /*!< dwClockFrequency.*/
+
+/************************************************
+ * Static variables used by the Video class.
+ ***********************************************/
+static const struct usbd_uvc_config *cfg; /*!< Pointer to the configuration provided by the user during initialization.*/
+static struct usbd_uvc_probe_type probe; /*!< Current probe state.*/
+static struct usbd_uvc_probe_type commit; /*!< Committed state.*/
+static struct usbd_uvc_probe_type def; /*!< Default (and only) settings.*/
+static struct usbd_uvc_probe_type ctrl; /*!< Buffer used for the SET_CUR data stage.*/
+static uint8_t ctrl_selector; /*!< Control selector of the SET_CUR data stage.*/
+static uint8_t ctrl_buf[USBD_UVC_GET_LEN_LENGTH]; /*!< Buffer used for GET_LEN and GET_INFO.*/
+static uint8_t header[USBD_UVC_HEADER_LENGTH]; /*!< Payload header of the current frame.*/
+static const uint8_t *frame; /*!< Frame being sent, NULL between frames.*/
+static uint32_t pos; /*!< Payload bytes already copied to the PMA, header included.*/
+static uint32_t total; /*!< Size of a payload, header included.*/
+static uint8_t fid; /*!< Frame ID bit of the current frame.*/
+static bool streaming; /*!< Streaming has been committed.*/
+static bool tx_busy; /*!< A packet is armed on the endpoint.*/
+static bool ready; /*!< The next packet has been copied to the PMA.*/
+static uint8_t ready_idx; /*!< PMA buffer holding the next packet.*/
+static uint16_t ready_len[2]; /*!< Size of the packet of each PMA buffer.*/
+static struct usbd_uvc_stats stats; /*!< Counters.*/
+
+/************************************************
+ * Function prototypes.
+ ***********************************************/
+static void usbd_uvc_negotiate(struct usbd_uvc_probe_type *p);
+static bool usbd_uvc_prepare(uint8_t idx);
+static void usbd_uvc_arm(void);
+static void usbd_uvc_ep_in(void);
+static void usbd_uvc_start(void);
+static void usbd_uvc_stop(void);
+static void usbd_uvc_set_cur_cplt(void);
+
+/**
+ * @brief Replaces the fields of a probe or commit request with the
+ * supported values.
+ * @param p Pointer to usbd_uvc_probe_type struct.
+ */
+static void usbd_uvc_negotiate(struct usbd_uvc_probe_type *p)
+{
+	p->bmHint = 0;
+	p->bFormatIndex = 1;
+	p->bFrameIndex = 1;
+	if (p->dwFrameInterval < cfg->frame_interval)
+	{
+		p->dwFrameInterval = cfg->frame_interval;
+	}
+	p->wKeyFrameRate = 0;
+	p->wPFrameRate = 0;
+	p->wCompQuality = 0;
+	p->wCompWindowSize = 0;
+	p->wDelay = 0;
+	p->dwMaxVideoFrameSize = cfg->frame_size;
+	/*A whole frame is a single payload, only one header per frame.*/
+	p->dwMaxPayloadTransferSize = total;
+	p->dwClockFrequency = USBD_UVC_CLOCK_FREQUENCY;
+	p->bmFramingInfo = USBD_UVC_FRAMING_FID_EOF;
+	p->bPreferedVersion = 0;
+	p->bMinVersion = 0;
+	p->bMaxVersion = 0;
+}
+
+/**
+ * @brief Copies the next packet of the payload into a PMA buffer, straight
+ * from the frame buffer. The frame is released as soon as its last packet
+ * is inside the PMA.
+ * @param idx PMA buffer.
+ * @return false if there is no frame to send.
+ */
+static bool usbd_uvc_prepare(uint8_t idx)
+{
+	uint16_t addr = idx ? cfg->tx1_addr : cfg->tx0_addr;
+	uint16_t len;
+
+	if (frame == NULL)
+	{
+		frame = cfg->get_frame();
+		if (frame == NULL)
+		{
+			return false;
+		}
+		pos = 0;
+	}
+
+	len = MIN(cfg->max_packet_size, total - pos);
+	if (!pos)
+	{
+		header[0] = USBD_UVC_HEADER_LENGTH;
+		header[1] = USBD_UVC_HEADER_EOH | USBD_UVC_HEADER_EOF | fid;
+		usbd_pma_write(addr, header, USBD_UVC_HEADER_LENGTH);
+		usbd_pma_write(addr + USBD_UVC_HEADER_LENGTH, (uint8_t*)frame, len - USBD_UVC_HEADER_LENGTH);
+	}
+	else if (len)
+	{
+		usbd_pma_write(addr, (uint8_t*)frame + pos - USBD_UVC_HEADER_LENGTH, len);
+	}
+	pos += len;
+	ready_len[idx] = len;
+	stats.bytes += len;
+
+	/*A short packet (or a zero length packet) ends the payload.*/
+	if (len < cfg->max_packet_size)
+	{
+		if (cfg->frame_done != NULL)
+		{
+			cfg->frame_done(frame);
+		}
+		frame = NULL;
+		fid ^= USBD_UVC_HEADER_FID;
+		stats.frames++;
+	}
+	return true;
+}
+
+/**
+ * @brief Arms the packet that is already inside the PMA, then copies the
+ * following one into the other buffer while the first is on the bus.
+ * @param
+ */
+static void usbd_uvc_arm(void)
+{
+	if (!ready)
+	{
+		tx_busy = false;
+		return;
+	}
+	USBD_PMA_SET_TX_ADDR(cfg->ep, ready_idx ? cfg->tx1_addr : cfg->tx0_addr);
+	USBD_PMA_SET_TX_COUNT(cfg->ep, ready_len[ready_idx]);
+	USBD_EP_SET_STAT_TX(cfg->ep, USB_EP_STAT_TX_VALID);
+	tx_busy = true;
+	ready_idx ^= 1U;
+	ready = usbd_uvc_prepare(ready_idx);
+}
+
+/**
+ * @brief Bulk IN endpoint callback function.
+ * @param
+ */
+static void usbd_uvc_ep_in(void)
+{
+	if (!streaming)
+	{
+		tx_busy = false;
+		return;
+	}
+	usbd_uvc_arm();
+}
+
+/**
+ * @brief Starts streaming with the committed settings.
+ * @param
+ */
+static void usbd_uvc_start(void)
+{
+	streaming = true;
+	ready = usbd_uvc_prepare(ready_idx);
+	usbd_uvc_arm();
+	if (cfg->stream_changed != NULL)
+	{
+		cfg->stream_changed(true, commit.dwFrameInterval);
+	}
+}
+
+/**
+ * @brief Stops streaming and releases the current frame.
+ * @param
+ */
+static void usbd_uvc_stop(void)
+{
+	bool was_streaming = streaming;
+
+	streaming = false;
+	tx_busy = false;
+	ready = false;
+	if (frame != NULL)
+	{
+		if (cfg->frame_done != NULL)
+		{
+			cfg->frame_done(frame);
+		}
+		frame = NULL;
+	}
+	if (was_streaming && cfg->stream_changed != NULL)
+	{
+		cfg->stream_changed(false, commit.dwFrameInterval);
+	}
+}
+
+/**
+ * @brief SET_CUR data stage completion callback function.
+ * @param
+ */
+static void usbd_uvc_set_cur_cplt(void)
+{
+	usbd_uvc_negotiate(&ctrl);
+	if (ctrl_selector == USBD_UVC_VS_PROBE_CONTROL)
+	{
+		probe = ctrl;
+		return;
+	}
+	commit = ctrl;
+	usbd_uvc_stop();
+	usbd_uvc_start();
+}
+
+/**
+ * @brief Initializes the Video class.
+ * @param config Pointer to usbd_uvc_config struct that describes the Video function.
+ */
+void usbd_uvc_init(const struct usbd_uvc_config *config)
+{
+	ASSERT(config != NULL);
+	ASSERT(config->get_frame != NULL);
+	ASSERT(config->frame_size);
+	ASSERT(config->max_packet_size > USBD_UVC_HEADER_LENGTH && config->max_packet_size <= USBD_FS_MAX_PACKET_SIZE);
+	cfg = config;
+	total = config->frame_size + USBD_UVC_HEADER_LENGTH;
+	memset(&stats, 0, sizeof(stats));
+	memset(&def, 0, sizeof(def));
+	def.dwFrameInterval = config->frame_interval;
+	usbd_uvc_negotiate(&def);
+	probe = def;
+	commit = def;
+}
+
+/**
+ * @brief Registers the bulk endpoint, streaming starts with COMMIT.
+ * @note Should be called from the set_configuration callback.
+ * @param
+ */
+void usbd_uvc_configure(void)
+{
+	ASSERT(cfg != NULL);
+	usbd_uvc_stop();
+	probe = def;
+	commit = def;
+	usbd_register_ep_tx(cfg->ep, USB_EP_TYPE_BULK, cfg->tx0_addr, usbd_uvc_ep_in);
+}
+
+/**
+ * @brief Video class specific request handler, the probe and commit
+ * controls of the VideoStreaming interface.
+ * @note Should be called from the class_request callback.
+ * @param setup USB setup packet.
+ * @return false if the request isn't addressed to the VideoStreaming interface, true otherwise.
+ */
+bool usbd_uvc_class_request(struct usbd_setup_packet_type setup)
+{
+	uint8_t cs = ((setup.wValue >> 0x8U) & 0xFFU);
+	struct usbd_uvc_probe_type *p = (cs == USBD_UVC_VS_PROBE_CONTROL) ? &probe : &commit;
+
+	ASSERT(cfg != NULL);
+	if ((setup.bmRequestType & USBD_RECIPIENT) != USBD_RECIPIENT_INTERFACE || (setup.wIndex & 0xFFU) != cfg->vs_interface_num)
+	{
+		return false;
+	}
+	if (cs != USBD_UVC_VS_PROBE_CONTROL && cs != USBD_UVC_VS_COMMIT_CONTROL)
+	{
+		USBD_EP0_SET_STALL();
+		return true;
+	}
+
+	switch (setup.bRequest)
+	{
+		case USBD_UVC_SET_CUR:
+		{
+			/*UVC 1.0 hosts send the first 26 bytes only.*/
+			if (!setup.wLength || setup.wLength > sizeof(ctrl))
+			{
+				USBD_EP0_SET_STALL();
+				break;
+			}
+			ctrl = *p;
+			ctrl_selector = cs;
+			usbd_prepare_data_out_stage((uint8_t*)&ctrl, setup.wLength, usbd_uvc_set_cur_cplt);
+			break;
+		}
+		case USBD_UVC_GET_CUR:
+		{
+			usbd_prepare_data_in_stage((uint8_t*)p, MIN(setup.wLength, sizeof(*p)));
+			break;
+		}
+		case USBD_UVC_GET_MIN:
+		case USBD_UVC_GET_MAX:
+		case USBD_UVC_GET_DEF:
+		{
+			if (cs != USBD_UVC_VS_PROBE_CONTROL)
+			{
+				USBD_EP0_SET_STALL();
+				break;
+			}
+			usbd_prepare_data_in_stage((uint8_t*)&def, MIN(setup.wLength, sizeof(def)));
+			break;
+		}
+		case USBD_UVC_GET_LEN:
+		{
+			ctrl_buf[0] = (sizeof(struct usbd_uvc_probe_type) & 0xFFU);
+			ctrl_buf[1] = ((sizeof(struct usbd_uvc_probe_type) >> 0x8U) & 0xFFU);
+			usbd_prepare_data_in_stage(ctrl_buf, MIN(setup.wLength, USBD_UVC_GET_LEN_LENGTH));
+			break;
+		}
+		case USBD_UVC_GET_INFO:
+		{
+			ctrl_buf[0] = USBD_UVC_INFO_GET_SET;
+			usbd_prepare_data_in_stage(ctrl_buf, MIN(setup.wLength, USBD_UVC_GET_INFO_LENGTH));
+			break;
+		}
+		default:
+		{
+			USBD_EP0_SET_STALL();
+			break;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief A bulk VideoStreaming interface is stopped with
+ * CLEAR_FEATURE(ENDPOINT_HALT) on its endpoint.
+ * @note Should be called from the clear_stall callback.
+ * @param num Endpoint number.
+ * @param dir Endpoint direction.
+ */
+void usbd_uvc_clear_stall(uint8_t num, uint8_t dir)
+{
+	ASSERT(cfg != NULL);
+	if (num == cfg->ep && dir)
+	{
+		usbd_uvc_stop();
+		/*Going through STALL drops an armed packet and resets the data toggle, the endpoint ends up NAK.*/
+		USBD_EP_SET_TX_STALL(num);
+		USBD_EP_CLEAR_TX_STALL(num);
+	}
+}
+
+/**
+ * @brief Restarts an idle stream once the next frame is ready.
+ * @note Should be called from the sof callback.
+ * @param
+ */
+void usbd_uvc_sof(void)
+{
+	if (cfg == NULL || !streaming)
+	{
+		return;
+	}
+	stats.sof++;
+	if (tx_busy)
+	{
+		return;
+	}
+	/*Skip until the endpoint has been registered again after a bus reset.*/
+	if (GET(*USBD_EP_REG(cfg->ep), USB_EP_STAT_TX) == USB_EP_STAT_TX_DISABLED)
+	{
+		return;
+	}
+	if (!ready)
+	{
+		ready = usbd_uvc_prepare(ready_idx);
+	}
+	if (!ready)
+	{
+		stats.starved++;
+		return;
+	}
+	usbd_uvc_arm();
+}
+
+/**
+ * @brief Returns a copy of the counters.
+ * @param stats_out Pointer to usbd_uvc_stats struct that receives the counters.
+ */
+void usbd_uvc_get_stats(struct usbd_uvc_stats *stats_out)
+{
+	uint32_t primask;
+
+	ASSERT(stats_out != NULL);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	*stats_out = stats;
+	__set_PRIMASK(primask);
+}
@@ -0,0 +1,310 @@
+#include <string.h>
+#include "assert_stm32l4xx.h"
+#include "usbd_zero.h"
+
+/************************************************
+ * Static variables used by the test function.
+ ***********************************************/
+static const struct usbd_zero_config *cfg; /*!< Pointer to the configuration provided by the user during initialization.*/
+static struct usbd_zero_params params; /*!< Current parameters.*/
+static struct usbd_zero_params ctrl_params; /*!< Buffer used for the SET_PARAMS data stage.*/
+static struct usbd_zero_stats stats; /*!< Counters.*/
+static uint8_t buf[USBD_FS_MAX_PACKET_SIZE]; /*!< Packet buffer.*/
+static uint16_t tx_len; /*!< Size of the packet armed on the IN endpoint.*/
+static uint32_t tx_pos; /*!< Offset of the next IN packet inside the transfer.*/
+static uint32_t rx_pos; /*!< Offset of the next OUT packet inside the transfer.*/
+static bool tx_static; /*!< The IN buffer inside the PMA already holds the pattern.*/
+
+/************************************************
+ * Function prototypes.
+ ***********************************************/
+static void usbd_zero_pattern(uint8_t *dst, uint32_t pos, uint16_t len);
+static void usbd_zero_source_packet(void);
+static void usbd_zero_ep_in(void);
+static void usbd_zero_ep_out(void);
+static void usbd_zero_set_params_cplt(void);
+
+/**
+ * @brief Generate the selected pattern.
+ * @param dst Pointer to the buffer that receives the pattern.
+ * @param pos Offset of the buffer inside the transfer.
+ * @param len Size of the buffer.
+ */
+static void usbd_zero_pattern(uint8_t *dst, uint32_t pos, uint16_t len)
+{
+	uint8_t val;
+
+	if (params.pattern != USBD_ZERO_PATTERN_MOD63)
+	{
+		memset(dst, 0, len);
+		return;
+	}
+	val = pos % 63U;
+	while (len--)
+	{
+		*dst++ = val++;
+		if (val == 63U)
+		{
+			val = 0;
+		}
+	}
+}
+
+/**
+ * @brief Arm the next packet of source mode. The zero pattern is only
+ * copied once, so the measurement shows the cost of the stack itself.
+ * @param
+ */
+static void usbd_zero_source_packet(void)
+{
+	tx_len = MIN(params.packet_size, params.transfer_size - tx_pos);
+
+	if (params.pattern == USBD_ZERO_PATTERN_MOD63)
+	{
+		usbd_zero_pattern(buf, tx_pos, tx_len);
+		usbd_pma_write(cfg->tx_addr, buf, tx_len);
+	}
+	else if (!tx_static)
+	{
+		usbd_zero_pattern(buf, 0, params.packet_size);
+		usbd_pma_write(cfg->tx_addr, buf, params.packet_size);
+		tx_static = true;
+	}
+
+	tx_pos += tx_len;
+	if (tx_pos >= params.transfer_size)
+	{
+		tx_pos = 0;
+	}
+	USBD_PMA_SET_TX_COUNT(cfg->in_ep, tx_len);
+	USBD_EP_SET_STAT_TX(cfg->in_ep, USB_EP_STAT_TX_VALID);
+}
+
+/**
+ * @brief Bulk IN endpoint callback function.
+ * @param
+ */
+static void usbd_zero_ep_in(void)
+{
+	stats.packets_in++;
+	stats.bytes_in += tx_len;
+
+	if (params.mode == USBD_ZERO_MODE_SOURCE)
+	{
+		usbd_zero_source_packet();
+	}
+	else if (params.mode == USBD_ZERO_MODE_LOOPBACK)
+	{
+		/*The packet has been echoed, accept the next one.*/
+		USBD_EP_SET_STAT_RX(cfg->out_ep, USB_EP_STAT_RX_VALID);
+	}
+}
+
+/**
+ * @brief Bulk OUT endpoint callback function.
+ * @param
+ */
+static void usbd_zero_ep_out(void)
+{
+	uint16_t cnt = MIN(USBD_PMA_GET_RX_COUNT(cfg->out_ep), sizeof(buf));
+
+	stats.packets_out++;
+	stats.bytes_out += cnt;
+
+	if (params.mode == USBD_ZERO_MODE_LOOPBACK)
+	{
+		/*The OUT endpoint stays NAK until the IN endpoint has echoed the packet.*/
+		usbd_pma_read(cfg->rx_addr, buf, cnt);
+		usbd_pma_write(cfg->tx_addr, buf, cnt);
+		tx_len = cnt;
+		USBD_PMA_SET_TX_COUNT(cfg->in_ep, cnt);
+		USBD_EP_SET_STAT_TX(cfg->in_ep, USB_EP_STAT_TX_VALID);
+		return;
+	}
+	if (params.mode != USBD_ZERO_MODE_SINK)
+	{
+		return;
+	}
+
+	if (params.verify)
+	{
+		uint8_t expected[USBD_FS_MAX_PACKET_SIZE];
+		usbd_pma_read(cfg->rx_addr, buf, cnt);
+		usbd_zero_pattern(expected, rx_pos, cnt);
+		if (memcmp(buf, expected, cnt))
+		{
+			stats.errors++;
+		}
+	}
+	/*A short packet or the last packet ends the transfer.*/
+	rx_pos += cnt;
+	if (cnt < params.packet_size || rx_pos >= params.transfer_size)
+	{
+		rx_pos = 0;
+	}
+	USBD_EP_SET_STAT_RX(cfg->out_ep, USB_EP_STAT_RX_VALID);
+}
+
+/**
+ * @brief SET_PARAMS data stage completion callback function.
+ * @param
+ */
+static void usbd_zero_set_params_cplt(void)
+{
+	usbd_zero_set_params(&ctrl_params);
+}
+
+/**
+ * @brief Initializes the test function.
+ * @param config Pointer to usbd_zero_config struct that describes the test function.
+ */
+void usbd_zero_init(const struct usbd_zero_config *config)
+{
+	ASSERT(config != NULL);
+	ASSERT(config->max_packet_size && config->max_packet_size <= USBD_FS_MAX_PACKET_SIZE);
+	cfg = config;
+	memset(&params, 0, sizeof(params));
+	memset(&stats, 0, sizeof(stats));
+	params.mode = USBD_ZERO_MODE_IDLE;
+	params.packet_size = config->max_packet_size;
+	params.transfer_size = config->max_packet_size;
+}
+
+/**
+ * @brief Registers the bulk endpoints and restarts the current mode.
+ * @note Should be called from the set_configuration callback.
+ * @param
+ */
+void usbd_zero_configure(void)
+{
+	struct usbd_zero_params cur = params;
+
+	ASSERT(cfg != NULL);
+	if (cfg->in_ep == cfg->out_ep)
+	{
+		usbd_register_ep(cfg->in_ep, USB_EP_TYPE_BULK, cfg->tx_addr, cfg->rx_addr, cfg->max_packet_size, usbd_zero_ep_in, usbd_zero_ep_out);
+	}
+	else
+	{
+		usbd_register_ep_tx(cfg->in_ep, USB_EP_TYPE_BULK, cfg->tx_addr, usbd_zero_ep_in);
+		usbd_register_ep_rx(cfg->out_ep, USB_EP_TYPE_BULK, cfg->rx_addr, cfg->max_packet_size, usbd_zero_ep_out);
+	}
+	usbd_zero_set_params(&cur);
+}
+
+/**
+ * @brief Test function vendor request handler.
+ * @note Should be called from the vendor_request callback.
+ * @param setup USB setup packet.
+ * @return false if the request isn't addressed to the test function, true otherwise.
+ */
+bool usbd_zero_vendor_request(struct usbd_setup_packet_type setup)
+{
+	ASSERT(cfg != NULL);
+	if ((setup.bmRequestType & USBD_RECIPIENT) != USBD_RECIPIENT_INTERFACE || (setup.wIndex & 0xFFU) != cfg->interface_num)
+	{
+		return false;
+	}
+
+	switch (setup.bRequest)
+	{
+		case USBD_ZERO_SET_PARAMS:
+		{
+			if (setup.wLength != sizeof(ctrl_params))
+			{
+				USBD_EP0_SET_STALL();
+				break;
+			}
+			usbd_prepare_data_out_stage((uint8_t*)&ctrl_params, sizeof(ctrl_params), usbd_zero_set_params_cplt);
+			break;
+		}
+		case USBD_ZERO_GET_PARAMS:
+		{
+			usbd_prepare_data_in_stage((uint8_t*)&params, MIN(setup.wLength, sizeof(params)));
+			break;
+		}
+		case USBD_ZERO_GET_STATS:
+		{
+			struct usbd_core_stats core;
+			usbd_core_get_stats(&core);
+			stats.irq_count = core.irq_count;
+			stats.irq_cycles = core.irq_cycles;
+			stats.pma_bytes = core.pma_read_bytes + core.pma_write_bytes;
+			stats.core_clock = cfg->core_clock;
+			usbd_prepare_data_in_stage((uint8_t*)&stats, MIN(setup.wLength, sizeof(stats)));
+			break;
+		}
+		case USBD_ZERO_RESET_STATS:
+		{
+			memset(&stats, 0, sizeof(stats));
+			usbd_core_reset_stats();
+			usbd_prepare_status_in_stage();
+			break;
+		}
+		default:
+		{
+			USBD_EP0_SET_STALL();
+			break;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Counts the frames, used to compute the bytes per frame.
+ * @note Should be called from the sof callback.
+ * @param
+ */
+void usbd_zero_sof(void)
+{
+	stats.frames++;
+}
+
+/**
+ * @brief Select a mode, a pattern and the packet and transfer sizes.
+ * @note Also used by the SET_PARAMS vendor request.
+ * @param new_params Pointer to usbd_zero_params struct with the new parameters.
+ */
+void usbd_zero_set_params(const struct usbd_zero_params *new_params)
+{
+	ASSERT(cfg != NULL);
+	ASSERT(new_params != NULL);
+
+	/*Stop the current mode.*/
+	USBD_EP_SET_STAT_TX(cfg->in_ep, USB_EP_STAT_TX_NAK);
+	USBD_EP_SET_STAT_RX(cfg->out_ep, USB_EP_STAT_RX_NAK);
+
+	params = *new_params;
+	if (!params.packet_size || params.packet_size > cfg->max_packet_size)
+	{
+		params.packet_size = cfg->max_packet_size;
+	}
+	if (!params.transfer_size)
+	{
+		params.transfer_size = params.packet_size;
+	}
+	tx_pos = 0;
+	rx_pos = 0;
+	tx_len = 0;
+	tx_static = false;
+
+	switch (params.mode)
+	{
+		case USBD_ZERO_MODE_SOURCE:
+		{
+			usbd_zero_source_packet();
+			break;
+		}
+		case USBD_ZERO_MODE_SINK:
+		case USBD_ZERO_MODE_LOOPBACK:
+		{
+			USBD_EP_SET_STAT_RX(cfg->out_ep, USB_EP_STAT_RX_VALID);
+			break;
+		}
+		default:
+		{
+			params.mode = USBD_ZERO_MODE_IDLE;
+			break;
+		}
+	}
+}